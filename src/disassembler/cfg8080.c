@@ -0,0 +1,199 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "cfg8080.h"
+
+/* data bytes on a line of the listing */
+#define DATA_PER_LINE 8
+
+#define TEST(bits, addr) ((bits)[(addr) >> 3] & 1 << ((addr) & 7))
+#define SET(bits, addr) ((bits)[(addr) >> 3] |= 1 << ((addr) & 7))
+
+static void push (struct cfg8080 *cfg, int *top, uint32_t addr)
+{
+	if (addr >= cfg->size || TEST(cfg->queued, addr))
+		return;
+	SET(cfg->queued, addr);
+	cfg->work[(*top)++] = addr;
+}
+
+static void refer (struct cfg8080 *cfg, uint16_t from, uint16_t to)
+{
+	cfg->xrefs[cfg->xref_count].from = from;
+	cfg->xrefs[cfg->xref_count].to = to;
+	cfg->xref_count++;
+	SET(cfg->label, to);
+	SET(cfg->leader, to);
+}
+
+/* can the instruction go on to the one after it */
+static int falls_through (const struct insn8080 *insn)
+{
+	return FLOW8080_JUMP != insn->flow && FLOW8080_RET != insn->flow &&
+		FLOW8080_PCHL != insn->flow;
+}
+
+/*
+ * Decodes from addr on until the code leaves for good, queueing every
+ * target on the way
+ */
+static void follow (struct cfg8080 *cfg, int *top, uint32_t addr)
+{
+	struct insn8080 insn;
+
+	while (addr < cfg->size && !TEST(cfg->start, addr)) {
+		if (!decode8080(cfg->image + addr, cfg->size - addr, addr, &insn))
+			return;
+		SET(cfg->start, addr);
+		for (int i = 0; i < insn.length; i++)
+			SET(cfg->code, (addr + i) & 0xffff);
+		if (insn.target >= 0) {
+			refer(cfg, addr, insn.target);
+			push(cfg, top, insn.target);
+		}
+		addr += insn.length;
+		if (FLOW8080_NEXT != insn.flow && addr < cfg->size)
+			SET(cfg->leader, addr);
+		if (!falls_through(&insn))
+			return;
+	}
+}
+
+static int by_target (const void *a, const void *b)
+{
+	const struct xref8080 *x = a;
+	const struct xref8080 *y = b;
+
+	if (x->to != y->to)
+		return x->to - y->to;
+	return x->from - y->from;
+}
+
+/* cuts the decoded instructions into blocks at every leader */
+static void make_blocks (struct cfg8080 *cfg)
+{
+	struct block8080 *blk = NULL;
+	struct insn8080 insn;
+	uint32_t addr = 0;
+
+	cfg->block_count = 0;
+	while (addr < cfg->size) {
+		if (!TEST(cfg->start, addr)) {
+			blk = NULL;
+			addr++;
+			continue;
+		}
+		if (NULL == blk || TEST(cfg->leader, addr)) {
+			blk = &cfg->blocks[cfg->block_count++];
+			blk->start = addr;
+			blk->next = -1;
+			blk->target = -1;
+		}
+		decode8080(cfg->image + addr, cfg->size - addr, addr, &insn);
+		blk->end = addr;
+		addr += insn.length;
+		if (FLOW8080_NEXT == insn.flow && addr < cfg->size &&
+		    TEST(cfg->start, addr) && !TEST(cfg->leader, addr))
+			continue;
+
+		/* the block ends here */
+		if (falls_through(&insn) && addr < cfg->size &&
+		    TEST(cfg->start, addr))
+			blk->next = addr;
+		blk->target = insn.target;
+		blk = NULL;
+	}
+}
+
+void cfg8080_analyze (struct cfg8080 *cfg, const uint8_t *image,
+		      size_t size)
+{
+	int top = 0;
+
+	cfg->image = image;
+	cfg->size = size < CFG8080_SPACE ? size : CFG8080_SPACE;
+	memset(cfg->code, 0, sizeof(cfg->code));
+	memset(cfg->start, 0, sizeof(cfg->start));
+	memset(cfg->label, 0, sizeof(cfg->label));
+	memset(cfg->leader, 0, sizeof(cfg->leader));
+	memset(cfg->queued, 0, sizeof(cfg->queued));
+	cfg->xref_count = 0;
+
+	/* reset, then the RST vectors interrupts go through */
+	for (uint32_t vector = 0; vector < 0x40; vector += 8) {
+		if (vector < cfg->size)
+			SET(cfg->leader, vector);
+		push(cfg, &top, vector);
+	}
+	while (top)
+		follow(cfg, &top, cfg->work[--top]);
+
+	qsort(cfg->xrefs, cfg->xref_count, sizeof(*cfg->xrefs), by_target);
+	make_blocks(cfg);
+}
+
+/* unreached bytes from addr on, up to a line of them */
+static uint32_t write_data (const struct cfg8080 *cfg, uint32_t addr,
+			    FILE *out)
+{
+	int n = 0;
+
+	fprintf(out, "%04x DB     ", addr);
+	do {
+		fprintf(out, n ? ",$%02x" : "$%02x", cfg->image[addr]);
+		addr++;
+		n++;
+	} while (n < DATA_PER_LINE && addr < cfg->size &&
+		 !TEST(cfg->code, addr));
+	fputc('\n', out);
+	return addr;
+}
+
+int cfg8080_write (const struct cfg8080 *cfg, FILE *out)
+{
+	struct insn8080 insn;
+	char line[LINE8080_MAX];
+	uint32_t addr = 0;
+
+	while (addr < cfg->size) {
+		if (!TEST(cfg->code, addr)) {
+			addr = write_data(cfg, addr, out);
+			continue;
+		}
+		if (!TEST(cfg->start, addr)) {
+			/* the middle of an instruction jumped into elsewhere */
+			addr++;
+			continue;
+		}
+		if (TEST(cfg->leader, addr))
+			fputc('\n', out);
+		if (TEST(cfg->label, addr))
+			fprintf(out, "L%04x:\n", addr);
+		decode8080(cfg->image + addr, cfg->size - addr, addr, &insn);
+		fwrite(line, 1, format8080_line(&insn, line), out);
+		addr += insn.length;
+	}
+
+	fprintf(out, "\n; %d blocks\n", cfg->block_count);
+	for (int i = 0; i < cfg->block_count; i++) {
+		const struct block8080 *blk = &cfg->blocks[i];
+
+		fprintf(out, "; %04x-%04x ->", blk->start, blk->end);
+		if (blk->next >= 0)
+			fprintf(out, " %04x", blk->next);
+		if (blk->target >= 0)
+			fprintf(out, " L%04x", blk->target);
+		fputc('\n', out);
+	}
+
+	fprintf(out, "\n; cross references\n");
+	for (int i = 0; i < cfg->xref_count; ) {
+		uint16_t to = cfg->xrefs[i].to;
+
+		fprintf(out, "; L%04x:", to);
+		for (; i < cfg->xref_count && cfg->xrefs[i].to == to; i++)
+			fprintf(out, " %04x", cfg->xrefs[i].from);
+		fputc('\n', out);
+	}
+	return ferror(out) ? -1 : 0;
+}
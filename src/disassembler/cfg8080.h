@@ -0,0 +1,69 @@
+#ifndef CFG8080_H
+#define CFG8080_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "disassembler.h"
+
+/*
+ * Recursive traversal of an 8080 image loaded at address 0: code is
+ * what can be reached from the reset and interrupt vectors by
+ * following jumps, calls and RSTs, everything else is data. Calls are
+ * taken to return, jumps through HL (PCHL) are not followed.
+ */
+
+#define CFG8080_SPACE 0x10000
+
+struct xref8080 {
+	uint16_t to;
+	uint16_t from;
+};
+
+/* a run of instructions only entered at start and only left at end */
+struct block8080 {
+	uint16_t start;
+	uint16_t end;		/* the address of its last instruction */
+	int32_t next;		/* where it falls through to, or -1 */
+	int32_t target;		/* where it jumps or calls to, or -1 */
+};
+
+struct cfg8080 {
+	const uint8_t *image;
+	size_t size;		/* up to CFG8080_SPACE */
+
+	/* a bit per address */
+	uint8_t code[CFG8080_SPACE / 8];	/* in a decoded instruction */
+	uint8_t start[CFG8080_SPACE / 8];	/* the first byte of one */
+	uint8_t label[CFG8080_SPACE / 8];	/* jumped or called to */
+	uint8_t leader[CFG8080_SPACE / 8];	/* starts a block */
+
+	/* references, by target once the analysis is done */
+	struct xref8080 xrefs[CFG8080_SPACE];
+	int xref_count;
+
+	/* in address order */
+	struct block8080 blocks[CFG8080_SPACE];
+	int block_count;
+
+	/* addresses waiting to be decoded */
+	uint16_t work[CFG8080_SPACE];
+	uint8_t queued[CFG8080_SPACE / 8];
+};
+
+/*
+ * Analyses size bytes of image, of which only the first CFG8080_SPACE
+ * are addressable. cfg is large, it is best allocated.
+ */
+void cfg8080_analyze (struct cfg8080 *cfg, const uint8_t *image,
+		      size_t size);
+
+/*
+ * Writes the listing: labels, instructions, data bytes, then the
+ * blocks with their successors and every label with the addresses
+ * referring to it. Returns 0 on success, -1 on a write error.
+ */
+int cfg8080_write (const struct cfg8080 *cfg, FILE *out);
+
+#endif
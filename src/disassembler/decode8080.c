@@ -0,0 +1,415 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "disassembler.h"
+
+struct op8080 {
+	uint8_t mnemonic;
+	uint8_t operand;
+	uint8_t flow;
+	uint8_t length;
+	const char *regs;
+};
+
+/*
+ * Every opcode, undocumented ones as the instruction they alias
+ */
+static const struct op8080 ops[256] = {
+	[0x00] = { I8080_NOP, OPERAND8080_NONE, FLOW8080_NEXT, 1, "" },
+	[0x01] = { I8080_LXI, OPERAND8080_D16, FLOW8080_NEXT, 3, "B" },
+	[0x02] = { I8080_STAX, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B" },
+	[0x03] = { I8080_INX, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B" },
+	[0x04] = { I8080_INR, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B" },
+	[0x05] = { I8080_DCR, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B" },
+	[0x06] = { I8080_MVI, OPERAND8080_D8, FLOW8080_NEXT, 2, "B" },
+	[0x07] = { I8080_RLC, OPERAND8080_NONE, FLOW8080_NEXT, 1, "" },
+	[0x08] = { I8080_NOP, OPERAND8080_NONE, FLOW8080_NEXT, 1, "" },
+	[0x09] = { I8080_DAD, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B" },
+	[0x0a] = { I8080_LDAX, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B" },
+	[0x0b] = { I8080_DCX, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B" },
+	[0x0c] = { I8080_INR, OPERAND8080_NONE, FLOW8080_NEXT, 1, "C" },
+	[0x0d] = { I8080_DCR, OPERAND8080_NONE, FLOW8080_NEXT, 1, "C" },
+	[0x0e] = { I8080_MVI, OPERAND8080_D8, FLOW8080_NEXT, 2, "C" },
+	[0x0f] = { I8080_RRC, OPERAND8080_NONE, FLOW8080_NEXT, 1, "" },
+	[0x10] = { I8080_NOP, OPERAND8080_NONE, FLOW8080_NEXT, 1, "" },
+	[0x11] = { I8080_LXI, OPERAND8080_D16, FLOW8080_NEXT, 3, "D" },
+	[0x12] = { I8080_STAX, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D" },
+	[0x13] = { I8080_INX, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D" },
+	[0x14] = { I8080_INR, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D" },
+	[0x15] = { I8080_DCR, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D" },
+	[0x16] = { I8080_MVI, OPERAND8080_D8, FLOW8080_NEXT, 2, "D" },
+	[0x17] = { I8080_RAL, OPERAND8080_NONE, FLOW8080_NEXT, 1, "" },
+	[0x18] = { I8080_NOP, OPERAND8080_NONE, FLOW8080_NEXT, 1, "" },
+	[0x19] = { I8080_DAD, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D" },
+	[0x1a] = { I8080_LDAX, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D" },
+	[0x1b] = { I8080_DCX, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D" },
+	[0x1c] = { I8080_INR, OPERAND8080_NONE, FLOW8080_NEXT, 1, "E" },
+	[0x1d] = { I8080_DCR, OPERAND8080_NONE, FLOW8080_NEXT, 1, "E" },
+	[0x1e] = { I8080_MVI, OPERAND8080_D8, FLOW8080_NEXT, 2, "E" },
+	[0x1f] = { I8080_RAR, OPERAND8080_NONE, FLOW8080_NEXT, 1, "" },
+	[0x20] = { I8080_NOP, OPERAND8080_NONE, FLOW8080_NEXT, 1, "" },
+	[0x21] = { I8080_LXI, OPERAND8080_D16, FLOW8080_NEXT, 3, "H" },
+	[0x22] = { I8080_SHLD, OPERAND8080_ADDR, FLOW8080_NEXT, 3, "" },
+	[0x23] = { I8080_INX, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H" },
+	[0x24] = { I8080_INR, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H" },
+	[0x25] = { I8080_DCR, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H" },
+	[0x26] = { I8080_MVI, OPERAND8080_D8, FLOW8080_NEXT, 2, "H" },
+	[0x27] = { I8080_DAA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "" },
+	[0x28] = { I8080_NOP, OPERAND8080_NONE, FLOW8080_NEXT, 1, "" },
+	[0x29] = { I8080_DAD, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H" },
+	[0x2a] = { I8080_LHLD, OPERAND8080_ADDR, FLOW8080_NEXT, 3, "" },
+	[0x2b] = { I8080_DCX, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H" },
+	[0x2c] = { I8080_INR, OPERAND8080_NONE, FLOW8080_NEXT, 1, "L" },
+	[0x2d] = { I8080_DCR, OPERAND8080_NONE, FLOW8080_NEXT, 1, "L" },
+	[0x2e] = { I8080_MVI, OPERAND8080_D8, FLOW8080_NEXT, 2, "L" },
+	[0x2f] = { I8080_CMA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "" },
+	[0x30] = { I8080_NOP, OPERAND8080_NONE, FLOW8080_NEXT, 1, "" },
+	[0x31] = { I8080_LXI, OPERAND8080_D16, FLOW8080_NEXT, 3, "SP" },
+	[0x32] = { I8080_STA, OPERAND8080_ADDR, FLOW8080_NEXT, 3, "" },
+	[0x33] = { I8080_INX, OPERAND8080_NONE, FLOW8080_NEXT, 1, "SP" },
+	[0x34] = { I8080_INR, OPERAND8080_NONE, FLOW8080_NEXT, 1, "M" },
+	[0x35] = { I8080_DCR, OPERAND8080_NONE, FLOW8080_NEXT, 1, "M" },
+	[0x36] = { I8080_MVI, OPERAND8080_D8, FLOW8080_NEXT, 2, "M" },
+	[0x37] = { I8080_STC, OPERAND8080_NONE, FLOW8080_NEXT, 1, "" },
+	[0x38] = { I8080_NOP, OPERAND8080_NONE, FLOW8080_NEXT, 1, "" },
+	[0x39] = { I8080_DAD, OPERAND8080_NONE, FLOW8080_NEXT, 1, "SP" },
+	[0x3a] = { I8080_LDA, OPERAND8080_ADDR, FLOW8080_NEXT, 3, "" },
+	[0x3b] = { I8080_DCX, OPERAND8080_NONE, FLOW8080_NEXT, 1, "SP" },
+	[0x3c] = { I8080_INR, OPERAND8080_NONE, FLOW8080_NEXT, 1, "A" },
+	[0x3d] = { I8080_DCR, OPERAND8080_NONE, FLOW8080_NEXT, 1, "A" },
+	[0x3e] = { I8080_MVI, OPERAND8080_D8, FLOW8080_NEXT, 2, "A" },
+	[0x3f] = { I8080_CMC, OPERAND8080_NONE, FLOW8080_NEXT, 1, "" },
+	[0x40] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B,B" },
+	[0x41] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B,C" },
+	[0x42] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B,D" },
+	[0x43] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B,E" },
+	[0x44] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B,H" },
+	[0x45] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B,L" },
+	[0x46] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B,M" },
+	[0x47] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B,A" },
+	[0x48] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "C,B" },
+	[0x49] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "C,C" },
+	[0x4a] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "C,D" },
+	[0x4b] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "C,E" },
+	[0x4c] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "C,H" },
+	[0x4d] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "C,L" },
+	[0x4e] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "C,M" },
+	[0x4f] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "C,A" },
+	[0x50] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D,B" },
+	[0x51] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D,C" },
+	[0x52] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D,D" },
+	[0x53] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D,E" },
+	[0x54] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D,H" },
+	[0x55] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D,L" },
+	[0x56] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D,M" },
+	[0x57] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D,A" },
+	[0x58] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "E,B" },
+	[0x59] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "E,C" },
+	[0x5a] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "E,D" },
+	[0x5b] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "E,E" },
+	[0x5c] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "E,H" },
+	[0x5d] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "E,L" },
+	[0x5e] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "E,M" },
+	[0x5f] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "E,A" },
+	[0x60] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H,B" },
+	[0x61] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H,C" },
+	[0x62] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H,D" },
+	[0x63] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H,E" },
+	[0x64] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H,H" },
+	[0x65] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H,L" },
+	[0x66] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H,M" },
+	[0x67] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H,A" },
+	[0x68] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "L,B" },
+	[0x69] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "L,C" },
+	[0x6a] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "L,D" },
+	[0x6b] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "L,E" },
+	[0x6c] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "L,H" },
+	[0x6d] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "L,L" },
+	[0x6e] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "L,M" },
+	[0x6f] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "L,A" },
+	[0x70] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "M,B" },
+	[0x71] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "M,C" },
+	[0x72] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "M,D" },
+	[0x73] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "M,E" },
+	[0x74] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "M,H" },
+	[0x75] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "M,L" },
+	[0x76] = { I8080_HLT, OPERAND8080_NONE, FLOW8080_HLT, 1, "" },
+	[0x77] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "M,A" },
+	[0x78] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "A,B" },
+	[0x79] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "A,C" },
+	[0x7a] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "A,D" },
+	[0x7b] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "A,E" },
+	[0x7c] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "A,H" },
+	[0x7d] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "A,L" },
+	[0x7e] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "A,M" },
+	[0x7f] = { I8080_MOV, OPERAND8080_NONE, FLOW8080_NEXT, 1, "A,A" },
+	[0x80] = { I8080_ADD, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B" },
+	[0x81] = { I8080_ADD, OPERAND8080_NONE, FLOW8080_NEXT, 1, "C" },
+	[0x82] = { I8080_ADD, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D" },
+	[0x83] = { I8080_ADD, OPERAND8080_NONE, FLOW8080_NEXT, 1, "E" },
+	[0x84] = { I8080_ADD, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H" },
+	[0x85] = { I8080_ADD, OPERAND8080_NONE, FLOW8080_NEXT, 1, "L" },
+	[0x86] = { I8080_ADD, OPERAND8080_NONE, FLOW8080_NEXT, 1, "M" },
+	[0x87] = { I8080_ADD, OPERAND8080_NONE, FLOW8080_NEXT, 1, "A" },
+	[0x88] = { I8080_ADC, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B" },
+	[0x89] = { I8080_ADC, OPERAND8080_NONE, FLOW8080_NEXT, 1, "C" },
+	[0x8a] = { I8080_ADC, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D" },
+	[0x8b] = { I8080_ADC, OPERAND8080_NONE, FLOW8080_NEXT, 1, "E" },
+	[0x8c] = { I8080_ADC, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H" },
+	[0x8d] = { I8080_ADC, OPERAND8080_NONE, FLOW8080_NEXT, 1, "L" },
+	[0x8e] = { I8080_ADC, OPERAND8080_NONE, FLOW8080_NEXT, 1, "M" },
+	[0x8f] = { I8080_ADC, OPERAND8080_NONE, FLOW8080_NEXT, 1, "A" },
+	[0x90] = { I8080_SUB, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B" },
+	[0x91] = { I8080_SUB, OPERAND8080_NONE, FLOW8080_NEXT, 1, "C" },
+	[0x92] = { I8080_SUB, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D" },
+	[0x93] = { I8080_SUB, OPERAND8080_NONE, FLOW8080_NEXT, 1, "E" },
+	[0x94] = { I8080_SUB, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H" },
+	[0x95] = { I8080_SUB, OPERAND8080_NONE, FLOW8080_NEXT, 1, "L" },
+	[0x96] = { I8080_SUB, OPERAND8080_NONE, FLOW8080_NEXT, 1, "M" },
+	[0x97] = { I8080_SUB, OPERAND8080_NONE, FLOW8080_NEXT, 1, "A" },
+	[0x98] = { I8080_SBB, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B" },
+	[0x99] = { I8080_SBB, OPERAND8080_NONE, FLOW8080_NEXT, 1, "C" },
+	[0x9a] = { I8080_SBB, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D" },
+	[0x9b] = { I8080_SBB, OPERAND8080_NONE, FLOW8080_NEXT, 1, "E" },
+	[0x9c] = { I8080_SBB, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H" },
+	[0x9d] = { I8080_SBB, OPERAND8080_NONE, FLOW8080_NEXT, 1, "L" },
+	[0x9e] = { I8080_SBB, OPERAND8080_NONE, FLOW8080_NEXT, 1, "M" },
+	[0x9f] = { I8080_SBB, OPERAND8080_NONE, FLOW8080_NEXT, 1, "A" },
+	[0xa0] = { I8080_ANA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B" },
+	[0xa1] = { I8080_ANA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "C" },
+	[0xa2] = { I8080_ANA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D" },
+	[0xa3] = { I8080_ANA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "E" },
+	[0xa4] = { I8080_ANA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H" },
+	[0xa5] = { I8080_ANA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "L" },
+	[0xa6] = { I8080_ANA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "M" },
+	[0xa7] = { I8080_ANA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "A" },
+	[0xa8] = { I8080_XRA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B" },
+	[0xa9] = { I8080_XRA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "C" },
+	[0xaa] = { I8080_XRA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D" },
+	[0xab] = { I8080_XRA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "E" },
+	[0xac] = { I8080_XRA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H" },
+	[0xad] = { I8080_XRA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "L" },
+	[0xae] = { I8080_XRA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "M" },
+	[0xaf] = { I8080_XRA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "A" },
+	[0xb0] = { I8080_ORA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B" },
+	[0xb1] = { I8080_ORA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "C" },
+	[0xb2] = { I8080_ORA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D" },
+	[0xb3] = { I8080_ORA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "E" },
+	[0xb4] = { I8080_ORA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H" },
+	[0xb5] = { I8080_ORA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "L" },
+	[0xb6] = { I8080_ORA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "M" },
+	[0xb7] = { I8080_ORA, OPERAND8080_NONE, FLOW8080_NEXT, 1, "A" },
+	[0xb8] = { I8080_CMP, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B" },
+	[0xb9] = { I8080_CMP, OPERAND8080_NONE, FLOW8080_NEXT, 1, "C" },
+	[0xba] = { I8080_CMP, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D" },
+	[0xbb] = { I8080_CMP, OPERAND8080_NONE, FLOW8080_NEXT, 1, "E" },
+	[0xbc] = { I8080_CMP, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H" },
+	[0xbd] = { I8080_CMP, OPERAND8080_NONE, FLOW8080_NEXT, 1, "L" },
+	[0xbe] = { I8080_CMP, OPERAND8080_NONE, FLOW8080_NEXT, 1, "M" },
+	[0xbf] = { I8080_CMP, OPERAND8080_NONE, FLOW8080_NEXT, 1, "A" },
+	[0xc0] = { I8080_RNZ, OPERAND8080_NONE, FLOW8080_RET_IF, 1, "" },
+	[0xc1] = { I8080_POP, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B" },
+	[0xc2] = { I8080_JNZ, OPERAND8080_ADDR, FLOW8080_JUMP_IF, 3, "" },
+	[0xc3] = { I8080_JMP, OPERAND8080_ADDR, FLOW8080_JUMP, 3, "" },
+	[0xc4] = { I8080_CNZ, OPERAND8080_ADDR, FLOW8080_CALL_IF, 3, "" },
+	[0xc5] = { I8080_PUSH, OPERAND8080_NONE, FLOW8080_NEXT, 1, "B" },
+	[0xc6] = { I8080_ADI, OPERAND8080_D8, FLOW8080_NEXT, 2, "" },
+	[0xc7] = { I8080_RST, OPERAND8080_NONE, FLOW8080_RST, 1, "0" },
+	[0xc8] = { I8080_RZ, OPERAND8080_NONE, FLOW8080_RET_IF, 1, "" },
+	[0xc9] = { I8080_RET, OPERAND8080_NONE, FLOW8080_RET, 1, "" },
+	[0xca] = { I8080_JZ, OPERAND8080_ADDR, FLOW8080_JUMP_IF, 3, "" },
+	[0xcb] = { I8080_JMP, OPERAND8080_ADDR, FLOW8080_JUMP, 3, "" },
+	[0xcc] = { I8080_CZ, OPERAND8080_ADDR, FLOW8080_CALL_IF, 3, "" },
+	[0xcd] = { I8080_CALL, OPERAND8080_ADDR, FLOW8080_CALL, 3, "" },
+	[0xce] = { I8080_ACI, OPERAND8080_D8, FLOW8080_NEXT, 2, "" },
+	[0xcf] = { I8080_RST, OPERAND8080_NONE, FLOW8080_RST, 1, "1" },
+	[0xd0] = { I8080_RNC, OPERAND8080_NONE, FLOW8080_RET_IF, 1, "" },
+	[0xd1] = { I8080_POP, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D" },
+	[0xd2] = { I8080_JNC, OPERAND8080_ADDR, FLOW8080_JUMP_IF, 3, "" },
+	[0xd3] = { I8080_OUT, OPERAND8080_D8, FLOW8080_NEXT, 2, "" },
+	[0xd4] = { I8080_CNC, OPERAND8080_ADDR, FLOW8080_CALL_IF, 3, "" },
+	[0xd5] = { I8080_PUSH, OPERAND8080_NONE, FLOW8080_NEXT, 1, "D" },
+	[0xd6] = { I8080_SUI, OPERAND8080_D8, FLOW8080_NEXT, 2, "" },
+	[0xd7] = { I8080_RST, OPERAND8080_NONE, FLOW8080_RST, 1, "2" },
+	[0xd8] = { I8080_RC, OPERAND8080_NONE, FLOW8080_RET_IF, 1, "" },
+	[0xd9] = { I8080_RET, OPERAND8080_NONE, FLOW8080_RET, 1, "" },
+	[0xda] = { I8080_JC, OPERAND8080_ADDR, FLOW8080_JUMP_IF, 3, "" },
+	[0xdb] = { I8080_IN, OPERAND8080_D8, FLOW8080_NEXT, 2, "" },
+	[0xdc] = { I8080_CC, OPERAND8080_ADDR, FLOW8080_CALL_IF, 3, "" },
+	[0xdd] = { I8080_CALL, OPERAND8080_ADDR, FLOW8080_CALL, 3, "" },
+	[0xde] = { I8080_SBI, OPERAND8080_D8, FLOW8080_NEXT, 2, "" },
+	[0xdf] = { I8080_RST, OPERAND8080_NONE, FLOW8080_RST, 1, "3" },
+	[0xe0] = { I8080_RPO, OPERAND8080_NONE, FLOW8080_RET_IF, 1, "" },
+	[0xe1] = { I8080_POP, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H" },
+	[0xe2] = { I8080_JPO, OPERAND8080_ADDR, FLOW8080_JUMP_IF, 3, "" },
+	[0xe3] = { I8080_XTHL, OPERAND8080_NONE, FLOW8080_NEXT, 1, "" },
+	[0xe4] = { I8080_CPO, OPERAND8080_ADDR, FLOW8080_CALL_IF, 3, "" },
+	[0xe5] = { I8080_PUSH, OPERAND8080_NONE, FLOW8080_NEXT, 1, "H" },
+	[0xe6] = { I8080_ANI, OPERAND8080_D8, FLOW8080_NEXT, 2, "" },
+	[0xe7] = { I8080_RST, OPERAND8080_NONE, FLOW8080_RST, 1, "4" },
+	[0xe8] = { I8080_RPE, OPERAND8080_NONE, FLOW8080_RET_IF, 1, "" },
+	[0xe9] = { I8080_PCHL, OPERAND8080_NONE, FLOW8080_PCHL, 1, "" },
+	[0xea] = { I8080_JPE, OPERAND8080_ADDR, FLOW8080_JUMP_IF, 3, "" },
+	[0xeb] = { I8080_XCHG, OPERAND8080_NONE, FLOW8080_NEXT, 1, "" },
+	[0xec] = { I8080_CPE, OPERAND8080_ADDR, FLOW8080_CALL_IF, 3, "" },
+	[0xed] = { I8080_CALL, OPERAND8080_ADDR, FLOW8080_CALL, 3, "" },
+	[0xee] = { I8080_XRI, OPERAND8080_D8, FLOW8080_NEXT, 2, "" },
+	[0xef] = { I8080_RST, OPERAND8080_NONE, FLOW8080_RST, 1, "5" },
+	[0xf0] = { I8080_RP, OPERAND8080_NONE, FLOW8080_RET_IF, 1, "" },
+	[0xf1] = { I8080_POP, OPERAND8080_NONE, FLOW8080_NEXT, 1, "PSW" },
+	[0xf2] = { I8080_JP, OPERAND8080_ADDR, FLOW8080_JUMP_IF, 3, "" },
+	[0xf3] = { I8080_DI, OPERAND8080_NONE, FLOW8080_NEXT, 1, "" },
+	[0xf4] = { I8080_CP, OPERAND8080_ADDR, FLOW8080_CALL_IF, 3, "" },
+	[0xf5] = { I8080_PUSH, OPERAND8080_NONE, FLOW8080_NEXT, 1, "PSW" },
+	[0xf6] = { I8080_ORI, OPERAND8080_D8, FLOW8080_NEXT, 2, "" },
+	[0xf7] = { I8080_RST, OPERAND8080_NONE, FLOW8080_RST, 1, "6" },
+	[0xf8] = { I8080_RM, OPERAND8080_NONE, FLOW8080_RET_IF, 1, "" },
+	[0xf9] = { I8080_SPHL, OPERAND8080_NONE, FLOW8080_NEXT, 1, "" },
+	[0xfa] = { I8080_JM, OPERAND8080_ADDR, FLOW8080_JUMP_IF, 3, "" },
+	[0xfb] = { I8080_EI, OPERAND8080_NONE, FLOW8080_NEXT, 1, "" },
+	[0xfc] = { I8080_CM, OPERAND8080_ADDR, FLOW8080_CALL_IF, 3, "" },
+	[0xfd] = { I8080_CALL, OPERAND8080_ADDR, FLOW8080_CALL, 3, "" },
+	[0xfe] = { I8080_CPI, OPERAND8080_D8, FLOW8080_NEXT, 2, "" },
+	[0xff] = { I8080_RST, OPERAND8080_NONE, FLOW8080_RST, 1, "7" },
+};
+
+static const char *const names[I8080_MNEMONICS] = {
+	"ACI", "ADC", "ADD", "ADI", "ANA", "ANI", "CALL", "CC", "CM",
+	"CMA", "CMC", "CMP", "CNC", "CNZ", "CP", "CPE", "CPI", "CPO",
+	"CZ", "DAA", "DAD", "DCR", "DCX", "DI", "EI", "HLT", "IN",
+	"INR", "INX", "JC", "JM", "JMP", "JNC", "JNZ", "JP", "JPE",
+	"JPO", "JZ", "LDA", "LDAX", "LHLD", "LXI", "MOV", "MVI", "NOP",
+	"ORA", "ORI", "OUT", "PCHL", "POP", "PUSH", "RAL", "RAR", "RC",
+	"RET", "RLC", "RM", "RNC", "RNZ", "RP", "RPE", "RPO", "RRC",
+	"RST", "RZ", "SBB", "SBI", "SHLD", "SPHL", "STA", "STAX",
+	"STC", "SUB", "SUI", "XCHG", "XRA", "XRI", "XTHL",
+};
+
+static const char hex[] = "0123456789abcdef";
+
+const char *mnemonic8080 (enum mnemonic8080 mnemonic)
+{
+	return names[mnemonic];
+}
+
+int decode8080 (const uint8_t *code, size_t size, uint16_t pc,
+		struct insn8080 *insn)
+{
+	const struct op8080 *op;
+
+	if (0 == size)
+		return 0;
+	op = &ops[code[0]];
+	insn->pc = pc;
+	insn->opcode = code[0];
+	insn->mnemonic = op->mnemonic;
+	insn->operand = op->operand;
+	insn->flow = op->flow;
+	insn->length = op->length;
+	insn->regs = op->regs;
+	insn->imm = 0;
+	insn->target = -1;
+	if (FLOW8080_RST == op->flow)
+		insn->target = code[0] & 0x38;
+	if (op->length > size)
+		return 0;
+
+	if (2 == op->length)
+		insn->imm = code[1];
+	else if (3 == op->length)
+		insn->imm = code[1] | code[2] << 8;
+	if (FLOW8080_JUMP <= op->flow && op->flow <= FLOW8080_CALL_IF)
+		insn->target = insn->imm;
+	return op->length;
+}
+
+static char *put_hex (char *p, unsigned val, int digits)
+{
+	while (digits--)
+		*p++ = hex[(val >> (4 * digits)) & 0xf];
+	return p;
+}
+
+int format8080 (const struct insn8080 *insn, char *buf)
+{
+	const char *s = names[insn->mnemonic];
+	char *p = buf;
+
+	while (*s)
+		*p++ = *s++;
+	if (!insn->regs[0] && OPERAND8080_NONE == insn->operand)
+		return p - buf;
+
+	/* operands line up in the 8th column */
+	while (p - buf < 7)
+		*p++ = ' ';
+	for (s = insn->regs; *s; )
+		*p++ = *s++;
+	if (insn->regs[0] && OPERAND8080_NONE != insn->operand)
+		*p++ = ',';
+	if (OPERAND8080_ADDR != insn->operand && OPERAND8080_NONE != insn->operand)
+		*p++ = '#';
+	if (OPERAND8080_NONE != insn->operand) {
+		*p++ = '$';
+		p = put_hex(p, insn->imm, OPERAND8080_D8 == insn->operand ? 2 : 4);
+	}
+	return p - buf;
+}
+
+int format8080_line_size (const struct insn8080 *insn)
+{
+	int size = strlen(names[insn->mnemonic]);
+
+	if (insn->regs[0] || OPERAND8080_NONE != insn->operand) {
+		if (size < 7)
+			size = 7;
+		size += strlen(insn->regs);
+		if (insn->regs[0] && OPERAND8080_NONE != insn->operand)
+			size++;
+		if (OPERAND8080_D8 == insn->operand)
+			size += 4;		/* #$xx */
+		else if (OPERAND8080_D16 == insn->operand)
+			size += 6;		/* #$xxxx */
+		else if (OPERAND8080_ADDR == insn->operand)
+			size += 5;		/* $xxxx */
+	}
+	/* the address, a space and the newline */
+	return size + 6;
+}
+
+int format8080_line (const struct insn8080 *insn, char *buf)
+{
+	char *p = put_hex(buf, insn->pc, 4);
+
+	*p++ = ' ';
+	p += format8080(insn, p);
+	*p++ = '\n';
+	return p - buf;
+}
+
+int format8080_data (const uint8_t *code, size_t size, uint16_t pc,
+		     char *buf)
+{
+	char *p = put_hex(buf, pc, 4);
+
+	memcpy(p, " DB     ", 8);
+	p += 8;
+	for (size_t i = 0; i < size; i++) {
+		if (i)
+			*p++ = ',';
+		*p++ = '$';
+		p = put_hex(p, code[i], 2);
+	}
+	*p++ = '\n';
+	return p - buf;
+}
+
+int disassembler8080 (unsigned char *memory, uint16_t pc)
+{
+	struct insn8080 insn;
+	char line[LINE8080_MAX];
+
+	decode8080(memory + pc, 3, pc, &insn);
+	fwrite(line, 1, format8080_line(&insn, line), stdout);
+	return insn.length;
+}
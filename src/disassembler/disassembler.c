@@ -1,45 +1,105 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "cfg8080.h"
 #include "disassembler.h"
+#include "listing.h"
+#include "window.h"
 
+/*
+ * dis [-r] file
+ * dis [-r] -o [-j threads] path...
+ * Lists every byte of the file as code, or with -r only what can be
+ * reached from the reset and interrupt vectors, the rest as data.
+ * With -o, the files named and those under the directories named are
+ * listed on threads threads (one per CPU by default), each into a file
+ * next to it, see listing.h.
+ */
 int main (int argc, char *argv[])
 {
-	FILE *rom = fopen(argv[1], "rb");
-	if (NULL == rom) {
-		fprintf(stderr, "Couldn't open file: %s\n", argv[1]);
+	int recursive = 0;
+	int many = 0;
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int arg = 1;
+
+	for (; arg < argc && '-' == argv[arg][0]; arg++) {
+		if (0 == strcmp(argv[arg], "-r"))
+			recursive = 1;
+		else if (0 == strcmp(argv[arg], "-o"))
+			many = 1;
+		else if (0 == strcmp(argv[arg], "-j") && arg + 1 < argc)
+			threads = atoi(argv[++arg]);
+		else
+			break;
+	}
+	if (arg == argc || (!many && arg + 1 != argc) || threads < 1) {
+		fprintf(stderr, "usage: dis [-r] file\n"
+			"       dis [-r] -o [-j threads] path...\n");
 		return -1;
 	}
+	if (many)
+		return listing_run(argv + arg, argc - arg, recursive, threads);
 
-	/* get file size */
-	fseek(rom, 0, SEEK_END);
-	int fsize = ftell(rom);
-	rewind(rom);
+	struct window win;
+	if (window_open(&win, argv[arg]) < 0)
+		return -1;
+	printf("Loaded ROM into buffer.\n");
 
-	/* read file into memory */
-	unsigned char *buffer = malloc(fsize);
-	if (NULL == buffer) {
-		fprintf(stderr, "Failed to alloc mem for ROM\n");
-		goto error1;
+	if (recursive) {
+		/* only the first 64K are addressable, all in the window */
+		size_t avail;
+		const uint8_t *image = window_at(&win, 0, &avail);
+		struct cfg8080 *cfg = malloc(sizeof(*cfg));
+		if (NULL == image || NULL == cfg) {
+			fprintf(stderr, "Failed to alloc mem for the analysis\n");
+			free(cfg);
+			window_close(&win);
+			return -1;
+		}
+		cfg8080_analyze(cfg, image, avail);
+		int ret = cfg8080_write(cfg, stdout);
+		free(cfg);
+		window_close(&win);
+		return ret;
 	}
 
-	size_t result = fread(buffer, sizeof(char), fsize, rom);
-	if (result != fsize) {
-		fprintf(stderr, "Failed to read ROM!\n");
-		goto error1;
-	}
+	/* diassemble file, a window and a buffer of lines at a time */
+	static char out[1 << 16];
+	size_t used = 0;
+	uint64_t pc = 0;
+	while (pc < win.size) {
+		size_t avail;
+		const uint8_t *code = window_at(&win, pc, &avail);
+		if (NULL == code) {
+			window_close(&win);
+			return -1;
+		}
 
-	/* clean up */
-	fclose(rom);
-	printf("Loaded ROM into buffer.\n");
+		/* whole instructions only, unless the file ends first */
+		size_t stop = pc + avail == win.size ? avail : avail - 2;
+		size_t i = 0;
+		while (i < stop) {
+			struct insn8080 insn;
 
-	/* diassemble file */
-	int pc = 0;
-	while (pc < fsize)
-		pc += disassembler8080(buffer, pc);
+			/* a cut short last instruction is listed as its bytes */
+			if (!decode8080(code + i, avail - i, pc + i, &insn)) {
+				used += format8080_data(code + i, avail - i,
+							pc + i, out + used);
+				i = avail;
+				break;
+			}
+			used += format8080_line(&insn, out + used);
+			if (sizeof(out) - used < LINE8080_MAX) {
+				fwrite(out, 1, used, stdout);
+				used = 0;
+			}
+			i += insn.length;
+		}
+		pc += i;
+	}
+	fwrite(out, 1, used, stdout);
+	window_close(&win);
 	return 0;
-
-error1:
-	fclose(rom);
-	return -1;
 }
@@ -0,0 +1,555 @@
+#define _DEFAULT_SOURCE
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cfg8080.h"
+#include "disassembler.h"
+#include "listing.h"
+
+struct file {
+	char *in;
+	char *out;
+	const uint8_t *image;
+	size_t size;
+	int status;		/* -1 once anything failed */
+
+	/* where the pieces start in the image, the first at 0 */
+	size_t *starts;
+	int pieces;
+	int first;		/* index of its first piece */
+
+	/* the recursive listing, made whole */
+	char *text;
+	size_t text_size;
+
+	char *map;
+	size_t map_size;
+};
+
+/* LISTING_CHUNK bytes of an image, and where the sweep leaves them */
+struct chunk {
+	struct file *file;
+	size_t start;
+	/* the sweep entering at start + i goes on from land[i] */
+	size_t land[3];
+};
+
+struct piece {
+	struct file *file;
+	size_t start;
+	size_t end;
+	size_t offset;		/* of its lines in the listing */
+	size_t size;
+};
+
+struct job {
+	struct file *files;
+	int file_count;
+	struct chunk *chunks;
+	int chunk_count;
+	struct piece *pieces;
+	int piece_count;
+	int recursive;
+};
+
+/* runs fn on every index below count, on threads threads */
+struct pool {
+	int next;
+	int count;
+	void (*fn) (struct job *job, int i);
+	struct job *job;
+};
+
+static void *worker (void *arg)
+{
+	struct pool *pool = arg;
+	int i;
+
+	while ((i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED)) <
+	       pool->count)
+		pool->fn(pool->job, i);
+	return NULL;
+}
+
+static void run_pool (int threads, int count,
+		      void (*fn) (struct job *job, int i), struct job *job)
+{
+	struct pool pool = { 0, count, fn, job };
+	pthread_t tids[threads];
+	int started = 0;
+
+	/* this thread is one of them */
+	for (; started < threads - 1 && started < count - 1; started++)
+		if (pthread_create(&tids[started], NULL, worker, &pool))
+			break;
+	worker(&pool);
+	while (started--)
+		pthread_join(tids[started], NULL);
+}
+
+static int add_file (struct job *job, const char *path)
+{
+	struct file *files = realloc(job->files,
+				     (job->file_count + 1) * sizeof(*files));
+
+	if (NULL == files)
+		return -1;
+	job->files = files;
+	memset(&files[job->file_count], 0, sizeof(*files));
+	files[job->file_count].in = strdup(path);
+	files[job->file_count].out = malloc(strlen(path) +
+					    sizeof(LISTING_SUFFIX));
+	if (!files[job->file_count].in || !files[job->file_count].out) {
+		free(files[job->file_count].in);
+		free(files[job->file_count].out);
+		return -1;
+	}
+	strcpy(files[job->file_count].out, path);
+	strcat(files[job->file_count].out, LISTING_SUFFIX);
+	job->file_count++;
+	return 0;
+}
+
+static int by_name (const void *a, const void *b)
+{
+	return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+/*
+ * Adds path, or the files under it, in name order. Hidden files and
+ * listings are left out, and so are symbolic links met in directories,
+ * which could lead back up the tree: only paths named follow them.
+ */
+static int collect (struct job *job, const char *path, int named)
+{
+	struct stat st;
+	struct dirent *entry;
+	char **names = NULL;
+	int count = 0;
+	int ret = 0;
+	DIR *dir;
+
+	if ((named ? stat(path, &st) : lstat(path, &st)) < 0) {
+		fprintf(stderr, "Couldn't open file: %s\n", path);
+		return -1;
+	}
+	if (S_ISLNK(st.st_mode))
+		return 0;
+	if (!S_ISDIR(st.st_mode))
+		return add_file(job, path);
+
+	dir = opendir(path);
+	if (NULL == dir) {
+		fprintf(stderr, "Couldn't open directory: %s\n", path);
+		return -1;
+	}
+	while ((entry = readdir(dir))) {
+		size_t len = strlen(entry->d_name);
+		char **more;
+
+		if ('.' == entry->d_name[0] ||
+		    (len >= strlen(LISTING_SUFFIX) &&
+		     0 == strcmp(entry->d_name + len - strlen(LISTING_SUFFIX),
+				 LISTING_SUFFIX)))
+			continue;
+		more = realloc(names, (count + 1) * sizeof(*names));
+		if (NULL == more) {
+			ret = -1;
+			break;
+		}
+		names = more;
+		names[count] = malloc(strlen(path) + len + 2);
+		if (NULL == names[count]) {
+			ret = -1;
+			break;
+		}
+		sprintf(names[count++], "%s/%s", path, entry->d_name);
+	}
+	closedir(dir);
+
+	qsort(names, count, sizeof(*names), by_name);
+	for (int i = 0; i < count; i++) {
+		if (0 == ret)
+			ret = collect(job, names[i], 0);
+		free(names[i]);
+	}
+	free(names);
+	return ret;
+}
+
+/*
+ * Maps the file whole: its pages are only read, the kernel can drop
+ * and read them again as it likes, however large the file
+ */
+static int load (struct file *file)
+{
+	struct stat st;
+	int fd = open(file->in, O_RDONLY);
+
+	if (fd < 0) {
+		fprintf(stderr, "Couldn't open file: %s\n", file->in);
+		return -1;
+	}
+	if (fstat(fd, &st) < 0) {
+		fprintf(stderr, "Couldn't stat file: %s\n", file->in);
+		close(fd);
+		return -1;
+	}
+	file->size = st.st_size;
+	if (file->size) {
+		file->image = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE,
+				   fd, 0);
+		if (MAP_FAILED == file->image) {
+			fprintf(stderr, "Couldn't map %s\n", file->in);
+			file->image = NULL;
+			close(fd);
+			return -1;
+		}
+	}
+	close(fd);
+	return 0;
+}
+
+/*
+ * Unmaps the pages of a range of a file mapping from the process once
+ * it is done with them. They stay in the page cache, written pages
+ * too, so however large the files only the pieces being worked on
+ * take up memory.
+ */
+static void release (const void *start, size_t size)
+{
+	uintptr_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t from = (uintptr_t) start & ~(page - 1);
+
+	if (size)
+		madvise((void *) from, (uintptr_t) start + size - from,
+			MADV_DONTNEED);
+}
+
+/*
+ * Follows the linear sweep through a chunk from each of its first three
+ * bytes, where it can enter (instructions are 1 to 3 bytes long), to
+ * where it goes on in the next chunk. The three soon meet: the one the
+ * furthest behind is moved on, and it is dropped once it reaches
+ * another.
+ */
+static void trace (struct job *job, int i)
+{
+	struct chunk *chunk = &job->chunks[i];
+	const struct file *file = chunk->file;
+	size_t end = chunk->start + LISTING_CHUNK;
+	size_t pc[3];
+	int same[3];		/* the one each has met, or itself */
+
+	for (int k = 0; k < 3; k++) {
+		pc[k] = chunk->start + k;
+		same[k] = k;
+	}
+	for (;;) {
+		struct insn8080 insn;
+		int low = -1;
+
+		for (int k = 0; k < 3; k++)
+			if (same[k] == k && pc[k] < end &&
+			    (low < 0 || pc[k] < pc[low]))
+				low = k;
+		if (low < 0)
+			break;
+		decode8080(file->image + pc[low], file->size - pc[low],
+			   pc[low], &insn);
+		pc[low] += insn.length;
+		for (int k = 0; k < 3; k++)
+			if (k != low && same[k] == k && pc[k] == pc[low])
+				same[low] = k;
+	}
+	for (int k = 0; k < 3; k++) {
+		int to = k;
+
+		while (same[to] != to)
+			to = same[to];
+		chunk->land[k] = pc[to];
+	}
+	release(file->image + chunk->start, LISTING_CHUNK);
+}
+
+/*
+ * Cuts the images where the linear sweep starts an instruction, at the
+ * first it starts in each LISTING_CHUNK bytes. The chunks are traced
+ * on threads, then chained from the start of each image.
+ */
+static int split (struct job *job, int threads)
+{
+	int count = 0;
+
+	for (int i = 0; i < job->file_count; i++) {
+		struct file *file = &job->files[i];
+
+		if (file->status < 0)
+			continue;
+		file->pieces = file->size ?
+			(file->size - 1) / LISTING_CHUNK + 1 : 1;
+		file->starts = malloc(file->pieces * sizeof(*file->starts));
+		if (NULL == file->starts)
+			return -1;
+		count += file->pieces - 1;
+	}
+	job->chunks = malloc((count ? count : 1) * sizeof(*job->chunks));
+	if (NULL == job->chunks)
+		return -1;
+	job->chunk_count = 0;
+	for (int i = 0; i < job->file_count; i++) {
+		struct file *file = &job->files[i];
+
+		if (file->status < 0)
+			continue;
+		/* the last chunk leads nowhere */
+		for (int k = 0; k + 1 < file->pieces; k++) {
+			struct chunk *chunk = &job->chunks[job->chunk_count++];
+
+			chunk->file = file;
+			chunk->start = (size_t) k * LISTING_CHUNK;
+		}
+	}
+
+	run_pool(threads, job->chunk_count, trace, job);
+	for (int i = 0, c = 0; i < job->file_count; i++) {
+		struct file *file = &job->files[i];
+		int chunks;
+
+		if (file->status < 0)
+			continue;
+		chunks = file->pieces;
+		file->starts[0] = 0;
+		file->pieces = 1;
+		for (int k = 0; k + 1 < chunks; k++, c++) {
+			const struct chunk *chunk = &job->chunks[c];
+			size_t at = file->starts[file->pieces - 1];
+
+			/* an instruction reaching past the image ends it */
+			if (at < chunk->start || at >= file->size)
+				continue;
+			at = chunk->land[at - chunk->start];
+			if (at < file->size)
+				file->starts[file->pieces++] = at;
+		}
+	}
+	return 0;
+}
+
+/* the whole recursive listing, into memory */
+static int analyze (struct file *file)
+{
+	struct cfg8080 *cfg = malloc(sizeof(*cfg));
+	FILE *out;
+
+	if (NULL == cfg)
+		return -1;
+	out = open_memstream(&file->text, &file->text_size);
+	if (NULL == out) {
+		free(cfg);
+		return -1;
+	}
+	cfg8080_analyze(cfg, file->image, file->size);
+	int ret = cfg8080_write(cfg, out);
+	if (fclose(out))
+		ret = -1;
+	free(cfg);
+	return ret;
+}
+
+static void prepare (struct job *job, int i)
+{
+	struct file *file = &job->files[i];
+
+	if (load(file) < 0)
+		file->status = -1;
+	else if (job->recursive)
+		file->status = analyze(file);
+}
+
+/*
+ * The lines of the sweep from start to end, written to out, or only
+ * measured if out is NULL, which decodes without formatting. Returns
+ * their size.
+ */
+static size_t sweep (const struct file *file, size_t start, size_t end,
+		     char *out)
+{
+	char line[LINE8080_MAX];
+	size_t used = 0;
+	size_t pc = start;
+
+	while (pc < end) {
+		struct insn8080 insn;
+
+		/* a cut short last instruction is listed as its bytes */
+		if (!decode8080(file->image + pc, file->size - pc, pc, &insn)) {
+			used += format8080_data(file->image + pc,
+						file->size - pc, pc,
+						out ? out + used : line);
+			break;
+		}
+		if (out)
+			used += format8080_line(&insn, out + used);
+		else
+			used += format8080_line_size(&insn);
+		pc += insn.length;
+	}
+	return used;
+}
+
+static void measure (struct job *job, int i)
+{
+	struct piece *piece = &job->pieces[i];
+
+	if (job->recursive) {
+		piece->size = piece->file->text_size;
+		return;
+	}
+	piece->size = sweep(piece->file, piece->start, piece->end, NULL);
+	release(piece->file->image + piece->start, piece->end - piece->start);
+}
+
+/* formats the piece straight into the mapped listing */
+static void write_piece (struct job *job, int i)
+{
+	struct piece *piece = &job->pieces[i];
+
+	if (piece->file->status < 0)
+		return;
+	if (job->recursive) {
+		memcpy(piece->file->map + piece->offset, piece->file->text,
+		       piece->size);
+	} else {
+		sweep(piece->file, piece->start, piece->end,
+		      piece->file->map + piece->offset);
+		release(piece->file->image + piece->start,
+			piece->end - piece->start);
+	}
+	release(piece->file->map + piece->offset, piece->size);
+}
+
+/* creates the listing of the file, size bytes mapped to be filled in */
+static int map_output (struct file *file, size_t size)
+{
+	int fd = open(file->out, O_RDWR | O_CREAT | O_TRUNC, 0666);
+
+	if (fd < 0) {
+		fprintf(stderr, "Couldn't create %s\n", file->out);
+		return -1;
+	}
+	if (ftruncate(fd, size) < 0) {
+		fprintf(stderr, "Couldn't grow %s\n", file->out);
+		close(fd);
+		return -1;
+	}
+	file->map_size = size;
+	file->map = NULL;
+	if (size) {
+		file->map = mmap(NULL, size, PROT_READ | PROT_WRITE,
+				 MAP_SHARED, fd, 0);
+		if (MAP_FAILED == file->map) {
+			fprintf(stderr, "Couldn't map %s\n", file->out);
+			file->map = NULL;
+			close(fd);
+			return -1;
+		}
+	}
+	close(fd);
+	return 0;
+}
+
+int listing_run (char *paths[], int count, int recursive, int threads)
+{
+	struct job job = { 0 };
+	int ret = 0;
+
+	job.recursive = recursive;
+	for (int i = 0; i < count && 0 == ret; i++)
+		ret = collect(&job, paths[i], 1);
+	if (ret < 0)
+		goto out;
+
+	/* load every file, then analyze or split them */
+	run_pool(threads, job.file_count, prepare, &job);
+	if (!recursive && split(&job, threads) < 0) {
+		ret = -1;
+		goto out;
+	}
+	for (int i = 0; i < job.file_count; i++) {
+		struct file *file = &job.files[i];
+
+		file->first = job.piece_count;
+		if (file->status < 0)
+			continue;
+		job.piece_count += recursive ? 1 : file->pieces;
+	}
+	job.pieces = calloc(job.piece_count ? job.piece_count : 1,
+			    sizeof(*job.pieces));
+	if (NULL == job.pieces) {
+		ret = -1;
+		goto out;
+	}
+	for (int i = 0; i < job.file_count; i++) {
+		struct file *file = &job.files[i];
+		int pieces = recursive ? 1 : file->pieces;
+
+		if (file->status < 0)
+			continue;
+		for (int k = 0; k < pieces; k++) {
+			struct piece *piece = &job.pieces[file->first + k];
+
+			piece->file = file;
+			if (!recursive) {
+				piece->start = file->starts[k];
+				piece->end = k + 1 < pieces ?
+					file->starts[k + 1] : file->size;
+			}
+		}
+	}
+
+	/* size every piece, then lay them out in their file */
+	run_pool(threads, job.piece_count, measure, &job);
+	for (int i = 0; i < job.file_count; i++) {
+		struct file *file = &job.files[i];
+		int pieces = recursive ? 1 : file->pieces;
+		size_t size = 0;
+
+		if (file->status < 0)
+			continue;
+		for (int k = 0; k < pieces; k++) {
+			job.pieces[file->first + k].offset = size;
+			size += job.pieces[file->first + k].size;
+		}
+		file->status = map_output(file, size);
+	}
+	run_pool(threads, job.piece_count, write_piece, &job);
+
+out:
+	for (int i = 0; i < job.file_count; i++) {
+		struct file *file = &job.files[i];
+
+		if (file->status < 0)
+			ret = -1;
+		if (file->map && munmap(file->map, file->map_size) < 0)
+			ret = -1;
+		free(file->in);
+		free(file->out);
+		if (file->image)
+			munmap((void *) file->image, file->size);
+		free(file->starts);
+		free(file->text);
+	}
+	free(job.files);
+	free(job.chunks);
+	free(job.pieces);
+	return ret;
+}
@@ -0,0 +1,28 @@
+#ifndef LISTING_H
+#define LISTING_H
+
+/*
+ * Listings of many files at once, on a pool of threads: every file
+ * named, and every file under a directory named (but not behind a
+ * symbolic link in it), gets its listing written next to it, with
+ * LISTING_SUFFIX added to the name. Large images are cut at
+ * instruction boundaries of the linear sweep into pieces listed in
+ * parallel, and every listing is written straight into a mapping of
+ * its file. Only the pieces being listed stay mapped in, so memory
+ * doesn't grow with the files. Listings come out byte for byte the
+ * same whatever the number of threads.
+ */
+
+#define LISTING_SUFFIX ".dis"
+
+/* bytes of an image listed as one piece */
+#define LISTING_CHUNK (1 << 20)
+
+/*
+ * Lists the files at paths, recursively (see cfg8080.h) if recursive
+ * is set, on threads threads. Returns 0 on success, -1 if any of them
+ * failed.
+ */
+int listing_run (char *paths[], int count, int recursive, int threads);
+
+#endif
@@ -0,0 +1,70 @@
+#define _DEFAULT_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "window.h"
+
+/* the longest 8080 instruction */
+#define INSN_MAX 3
+
+int window_open (struct window *win, const char *path)
+{
+	struct stat st;
+
+	win->fd = open(path, O_RDONLY);
+	if (win->fd < 0) {
+		fprintf(stderr, "Couldn't open file: %s\n", path);
+		return -1;
+	}
+	if (fstat(win->fd, &st) < 0) {
+		fprintf(stderr, "Couldn't stat file: %s\n", path);
+		close(win->fd);
+		return -1;
+	}
+	win->size = st.st_size;
+	win->map = NULL;
+	win->start = 0;
+	win->length = 0;
+	return 0;
+}
+
+const uint8_t *window_at (struct window *win, uint64_t pos, size_t *avail)
+{
+	uint64_t want = win->size - pos < INSN_MAX ? win->size : pos + INSN_MAX;
+
+	*avail = 0;
+	if (pos >= win->size)
+		return (const uint8_t *) "";
+	if (pos < win->start || want > win->start + win->length) {
+		/* mappings start on a page */
+		uint64_t start = pos & ~(uint64_t) (sysconf(_SC_PAGESIZE) - 1);
+		size_t length = win->size - start < WINDOW_SIZE ?
+			win->size - start : WINDOW_SIZE;
+
+		if (win->map)
+			munmap((void *) win->map, win->length);
+		win->map = mmap(NULL, length, PROT_READ, MAP_PRIVATE, win->fd,
+				start);
+		if (MAP_FAILED == win->map) {
+			fprintf(stderr, "Couldn't map the file\n");
+			win->map = NULL;
+			win->length = 0;
+			return NULL;
+		}
+		madvise((void *) win->map, length, MADV_SEQUENTIAL);
+		win->start = start;
+		win->length = length;
+	}
+	*avail = win->start + win->length - pos;
+	return win->map + (pos - win->start);
+}
+
+void window_close (struct window *win)
+{
+	if (win->map)
+		munmap((void *) win->map, win->length);
+	close(win->fd);
+}
@@ -0,0 +1,36 @@
+#ifndef WINDOW_H
+#define WINDOW_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A file read through a mapping of at most WINDOW_SIZE bytes of it at
+ * a time, slid forward as it is read, so files of any size are listed
+ * in the same memory.
+ */
+#define WINDOW_SIZE (16 << 20)
+
+struct window {
+	int fd;
+	uint64_t size;		/* of the file */
+	const uint8_t *map;
+	uint64_t start;		/* offset in the file of map */
+	size_t length;		/* of map */
+};
+
+/*
+ * Opens the file at path. Returns 0 on success, -1 on failure.
+ */
+int window_open (struct window *win, const char *path);
+
+/*
+ * The bytes of the file from offset pos on, *avail of them (0 at the
+ * end of the file). At least an instruction's worth are there, or all
+ * that is left of the file. Returns NULL if the file can't be mapped.
+ */
+const uint8_t *window_at (struct window *win, uint64_t pos, size_t *avail);
+
+void window_close (struct window *win);
+
+#endif
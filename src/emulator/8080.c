@@ -1,133 +1,338 @@
+#define _DEFAULT_SOURCE
 #include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
 
-#include "../disassembler/disassembler.h"
+#include "8080.h"
+#include "flags8080.h"
+#include "profile.h"
+#include "trace.h"
+#ifdef JIT
+#ifndef BLOCK_CACHE
+#error "JIT builds on the block cache, build with -DBLOCK_CACHE too"
+#endif
+#include "jit.h"
+#endif
 
 /*
- * Flags of the machine
- * it isvery important for the flags to be in the exact
- * right bits
+ * Instructions are run straight from memory, and those in the last two
+ * bytes have operands past its end: memory is followed by a copy of
+ * its first FETCH_TAIL bytes, which wraps them around to 0x0000.
  */
-typedef struct FLAGS {
-	uint8_t cy:1;
-	uint8_t pad1:1;
-	uint8_t p:1;
-	uint8_t pad2:1;
-	uint8_t ac:1;
-	uint8_t pad3:1;
-	uint8_t z:1;
-	uint8_t s:1;
-} FLAGS;
-
-uint8_t a;
-uint8_t b;
-uint8_t c;
-uint8_t d;
-uint8_t e;
-uint8_t h;
-uint8_t l;
-uint16_t sp;
-uint16_t pc;
-uint8_t *memory;
-FLAGS flags;
-uint8_t int_enable;
+#define FETCH_TAIL 2
 
+/* the flags as the byte PUSH PSW sees */
+#define FLAGS_BYTE(state) (*(uint8_t *) &(state)->flags)
+
+#ifdef LAZY_FLAGS
 /*
- * function for handling unknown instructions
+ * Lazy flags: ALU instructions only record what they did, the flags
+ * are worked out when something actually looks at them. Conditional
+ * instructions only need one flag, which is cheap to get straight from
+ * the recorded result; CY lives in bit 8 of it for every kind.
  */
-void unknown_instruction ()
+enum {
+	LAZY_NONE,
+	LAZY_ADD,
+	LAZY_SUB,
+	LAZY_INR,
+	LAZY_DCR,
+	LAZY_LOGIC,
+};
+
+#define GET_CY(state) ((state)->lazy_op ?				\
+		((state)->lazy_res >> 8) & 1 : (state)->flags.cy)
+#define GET_Z(state) ((state)->lazy_op ?				\
+		((state)->lazy_res & 0xff) == 0 : (state)->flags.z)
+#define GET_S(state) ((state)->lazy_op ?				\
+		((state)->lazy_res >> 7) & 1 : (state)->flags.s)
+#define GET_P(state) ((state)->lazy_op ?				\
+		(zsp_table[(state)->lazy_res & 0xff] & FLAG_P) != 0 :	\
+		(state)->flags.p)
+
+static inline void record (cpu8080_state *state, uint8_t op, uint8_t val,
+			   uint16_t result)
 {
-	fprintf(stderr, "Unknown instruction!\n");
-	pc--;
-	disassembler8080(memory, pc);
-	printf("\n");
-	exit(1);
+	state->lazy_op = op;
+	state->lazy_a = state->a;
+	state->lazy_val = val;
+	state->lazy_res = result;
 }
 
 /*
- * Writes to memory, at a given address
+ * writes the pending flags, if any, to state->flags
  */
-void write_mem (uint16_t addr, uint8_t val)
+static inline void flags_sync (cpu8080_state *state)
 {
-	if (addr < 0x2000) {
-		/* I always wanted to be the one that gives a segfault
-		 * and not the one who receives it.
-		 */
-		fprintf(stderr, "SEGFAULT: Writing to ROM not allowed!\n");
+	uint16_t res = state->lazy_res;
+	uint8_t f = zsp_table[res & 0xff];
+
+	switch (state->lazy_op) {
+	case LAZY_NONE:
 		return;
+	case LAZY_ADD:
+		f |= (state->lazy_a ^ state->lazy_val ^ res) & FLAG_AC;
+		break;
+	case LAZY_SUB:
+		f |= ~(state->lazy_a ^ state->lazy_val ^ res) & FLAG_AC;
+		break;
+	case LAZY_INR:
+		f = inr_table[res & 0xff];
+		break;
+	case LAZY_DCR:
+		f = dcr_table[res & 0xff];
+		break;
 	}
-	else if (addr >= 0x4000) {
-		fprintf(stderr, "SEGFAULT: Writing out of Space Invaders RAM not allowed");
+	FLAGS_BYTE(state) = f | ((res >> 8) & FLAG_CY);
+	state->lazy_op = LAZY_NONE;
+}
+#else
+#define GET_CY(state) ((state)->flags.cy)
+#define GET_Z(state) ((state)->flags.z)
+#define GET_S(state) ((state)->flags.s)
+#define GET_P(state) ((state)->flags.p)
+
+static inline void flags_sync (cpu8080_state *state)
+{
+}
+#endif
+
+/* flags written by anything other than the ALU go straight to flags */
+#define SET_CY(state, val) do {				\
+		flags_sync(state);			\
+		(state)->flags.cy = (val);		\
+	} while (0)
+
+/*
+ * function for handling unknown instructions
+ * the core is not stopped from here, since that would take down
+ * every other core in the process; the caller gets -1 instead
+ */
+int unknown_instruction (cpu8080_state *state)
+{
+	flags_sync(state);
+	state->pc--;
+	/* the byte, the disassembler lists it as the opcode it aliases */
+	fprintf(stderr, "Unknown instruction at %04x: %02x\n", state->pc,
+		state->memory[state->pc]);
+	return -1;
+}
+
+/*
+ * Reads from memory, at a given address
+ */
+static inline uint8_t read_mem (cpu8080_state *state, uint16_t addr)
+{
+	return cpu8080_read(state, addr);
+}
+
+#ifdef BLOCK_CACHE
+/*
+ * Block cache: straight runs of instructions, up to and including the
+ * first one that can jump, are decoded once into arrays of micro-ops
+ * (the opcode followed by its operand bytes, so the handlers can read
+ * them through opcode[1] and opcode[2] as usual).
+ * The cache is direct mapped on the start pc.
+ */
+#define BLOCK_CACHE_SIZE 1024
+#define BLOCK_MAX_OPS 16
+
+#ifdef JIT
+/* a block is compiled once it has run this many times */
+#define JIT_THRESHOLD 16
+#endif
+
+struct block {
+	uint16_t start;
+	uint16_t cycles;	/* total for the whole block */
+	uint8_t count;		/* 0 when the slot is empty */
+	uint8_t len;		/* bytes of guest code covered */
+	unsigned char ops[BLOCK_MAX_OPS][4];
+#ifdef JIT
+	jit_fn native;		/* compiled code from start, NULL if none */
+	uint8_t tried;		/* compiled or given up on */
+	uint8_t idle;		/* an idle loop, never compiled */
+	uint16_t hits;
+#endif
+};
+
+struct block_cache {
+	struct block blocks[BLOCK_CACHE_SIZE];
+	/* pages (256 bytes) that some cached block was decoded from */
+	uint8_t code_pages[256];
+#ifdef JIT
+	struct jit *jit;	/* NULL if no executable memory was given */
+	/* DIRECT_READ and DIRECT_WRITE of each page, see direct_access */
+	uint8_t direct_pages[256];
+#endif
+};
+
+#ifdef JIT
+/*
+ * What compiled code may do to a page by itself, in the direct_pages
+ * table: load from it when it is memory at its own address, and store
+ * to it too if that holds for stores and no block comes from it
+ */
+static uint8_t direct_access (cpu8080_state *state, int page)
+{
+	const mem_page *p = &state->map->pages[page];
+	uint8_t direct = 0;
+
+	if (0 == p->read) {
+		direct |= DIRECT_READ;
+		/* the first page also has its copy past the end to keep */
+		if (0 == p->write && !state->blocks->code_pages[page] &&
+		    page != 0)
+			direct |= DIRECT_WRITE;
+	}
+	return direct;
+}
+#endif
+
+/*
+ * Drops every block decoded from the page of addr.
+ * ROM is never written, so in practice this is only hit by code
+ * running from RAM that rewrites itself. Emptying the slot of the
+ * block that is running is also what stops it.
+ */
+static void block_invalidate (cpu8080_state *state, uint16_t addr)
+{
+	struct block_cache *cache = state->blocks;
+	uint8_t page = addr >> 8;
+
+	for (int i = 0; i < BLOCK_CACHE_SIZE; i++) {
+		struct block *blk = &cache->blocks[i];
+		uint16_t end = blk->start + blk->len - 1;
+
+		if (blk->count && (blk->start >> 8) <= page && page <= (end >> 8))
+			blk->count = 0;
+	}
+	cache->code_pages[page] = 0;
+#ifdef JIT
+	cache->direct_pages[page] = direct_access(state, page);
+	if (cache->jit)
+		jit_invalidate(cache->jit, page);
+#endif
+}
+#endif
+
+/*
+ * Writes to memory, at a given address
+ */
+void write_mem (cpu8080_state *state, uint16_t addr, uint8_t val)
+{
+	const mem_page *page = &state->map->pages[addr >> 8];
+
+	if (NO_MEMORY == page->write) {
+		if (page->write_fn)
+			page->write_fn(state->io, addr, val);
+		else
+			state->illegal_writes++;
 		return;
 	}
 
-	memory[addr] = val;
+	addr += page->write;
+	state->memory[addr] = val;
+	if (addr < FETCH_TAIL)
+		state->memory[MEMORY_SIZE + addr] = val;
+	if ((uint16_t) (addr - VIDEO_START) < VIDEO_END - VIDEO_START)
+		state->video_dirty |= 1u << (addr & 31);
+#ifdef BLOCK_CACHE
+	if (state->blocks->code_pages[addr >> 8])
+		block_invalidate(state, addr);
+#endif
 }
 
 /*
- * The n.o. 1 bits is counted and if the total is odd the bit is set to 0
- * otherwise, it is set to 1.
+ * set flags after an INR, the carry is left alone
  */
-int parity (int x, int size)
+void flags_inr (cpu8080_state *state, uint8_t val)
 {
-	int p = 0;
-	x = (x & ((1<<size) - 1));
-	for (int i = 0; i < size; i++) {
-		if (x & 0x1) p++;
-		x = x >> 1;
-	}
-	return (0 == (p & 0x1));
+#ifdef LAZY_FLAGS
+	record(state, LAZY_INR, 1, val | (GET_CY(state) << 8));
+#else
+	FLAGS_BYTE(state) = (FLAGS_BYTE(state) & FLAG_CY) | inr_table[val];
+#endif
 }
 
 /*
- * set flags after an operation
+ * set flags after a DCR, the carry is left alone
  */
-void flags_zsp (uint8_t val)
+void flags_dcr (cpu8080_state *state, uint8_t val)
 {
-	flags.z = (val == 0);
-	flags.s = (0x80 == (val & 0x80));
-	flags.p = parity(val, 8);
+#ifdef LAZY_FLAGS
+	record(state, LAZY_DCR, 1, val | (GET_CY(state) << 8));
+#else
+	FLAGS_BYTE(state) = (FLAGS_BYTE(state) & FLAG_CY) | dcr_table[val];
+#endif
 }
 
 /*
  * reads from HL addres in memory
  */ 
-uint8_t read_from_hl ()
+uint8_t read_from_hl (cpu8080_state *state)
 {
-	uint16_t mem_addr = (h << 8) | l;
-	return memory[mem_addr];
+	uint16_t mem_addr = (state->h << 8) | state->l;
+	return read_mem(state, mem_addr);
 }
 
 /*
  * writes to HL addres in memory
  */ 
-void write_to_hl (uint8_t val)
+void write_to_hl (cpu8080_state *state, uint8_t val)
+{
+	uint16_t mem_addr = (state->h << 8) | state->l;
+	write_mem(state, mem_addr, val);
+}
+
+/*
+ * returns A + val + carry and sets every flag
+ * the auxiliary carry is the carry into bit 4, which is what
+ * is left in that bit once both operands are xored out of the result
+ */
+uint8_t arith_add (cpu8080_state *state, uint8_t val, uint8_t carry)
 {
-	uint16_t mem_addr = (h << 8) | l;
-	write_mem(mem_addr, val);
+	uint16_t result = state->a + val + carry;
+#ifdef LAZY_FLAGS
+	record(state, LAZY_ADD, val, result);
+#else
+	FLAGS_BYTE(state) = zsp_table[result & 0xff] |
+		((state->a ^ val ^ result) & FLAG_AC) |
+		((result >> 8) & FLAG_CY);
+#endif
+	return result & 0xff;
 }
 
 /*
- * set flags after an arithmetic operation
+ * returns A - val - borrow and sets every flag
+ * the 8080 subtracts by adding the complement, so CY is the borrow
+ * and AC is the opposite of the borrow into bit 4
  */
-void arith_flags (uint16_t val)
+uint8_t arith_sub (cpu8080_state *state, uint8_t val, uint8_t borrow)
 {
-	flags.cy = (val > 0xff);
-	flags.z  = ((val & 0xff) == 0);
-	flags.s  = (0x80 == (val & 0x80));
-	flags.p  = parity(val & 0xff, 8);
+	uint16_t result = state->a - val - borrow;
+#ifdef LAZY_FLAGS
+	record(state, LAZY_SUB, val, result);
+#else
+	FLAGS_BYTE(state) = zsp_table[result & 0xff] |
+		(~(state->a ^ val ^ result) & FLAG_AC) |
+		((result >> 8) & FLAG_CY);
+#endif
+	return result & 0xff;
 }
 
 /*
  * set flags after a logic operation
  */
-void logic_flags ()
+void logic_flags (cpu8080_state *state)
 {
-	flags.cy = flags.ac = 0;
-	flags.z  = (a == 0);
-	flags.s  = (0x80 == (a & 0x80));
-	flags.p  = parity(a, 8);
+#ifdef LAZY_FLAGS
+	record(state, LAZY_LOGIC, 0, state->a);
+#else
+	FLAGS_BYTE(state) = zsp_table[state->a];
+#endif
 }
 
 /*
@@ -135,21 +340,21 @@ void logic_flags ()
  * (basically from the memory address pointed
  * by the stack pointer)
  */
-void pop (uint8_t *high, uint8_t *low)
+void pop (cpu8080_state *state, uint8_t *high, uint8_t *low)
 {
-	*low  = memory[sp];
-	*high = memory[sp+1];
-	sp += 2;
+	*low  = read_mem(state, state->sp);
+	*high = read_mem(state, state->sp + 1);
+	state->sp += 2;
 }
 
 /*
  * push pair of registers in the stack
  */
-void push (uint8_t high, uint8_t low)
+void push (cpu8080_state *state, uint8_t high, uint8_t low)
 {
-	write_mem(sp-1, high);
-	write_mem(sp-2, low);
-	sp -= 2;
+	write_mem(state, state->sp-1, high);
+	write_mem(state, state->sp-2, low);
+	state->sp -= 2;
 }
 
 unsigned char cycles8080[] = {
@@ -174,1281 +379,954 @@ unsigned char cycles8080[] = {
 	11, 10, 10, 4, 17, 11, 7, 11, 11, 5, 10, 4, 17, 17, 7, 11, 
 };
 
-int emulate8080 ()
+/*
+ * instruction sizes in bytes, 0 for opcodes the core doesn't know
+ */
+const unsigned char length8080[] = {
+	1, 3, 1, 1, 1, 1, 2, 1, 0, 1, 1, 1, 1, 1, 2, 1, //0x00..0x0f
+	0, 3, 1, 1, 1, 1, 2, 1, 0, 1, 1, 1, 1, 1, 2, 1,
+	0, 3, 3, 1, 1, 1, 2, 1, 0, 1, 3, 1, 1, 1, 2, 1,
+	0, 3, 3, 1, 1, 1, 2, 1, 0, 1, 3, 1, 1, 1, 2, 1,
+
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, //0x40..0x4f
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, //0x80..0x8f
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+
+	1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 0, 3, 3, 2, 1, //0xc0..0xcf
+	1, 1, 3, 2, 3, 1, 2, 1, 1, 0, 3, 2, 3, 0, 2, 1,
+	1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 0, 2, 1,
+	1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 0, 2, 1,
+};
+
+/*
+ * Idle loops: a jump back over a few instructions with no jumps, no
+ * stores and no I/O among them, or a HLT. Once a round of one ends
+ * with the registers as they were at its start, nothing it reads can
+ * change until the next interrupt, which only comes between two runs,
+ * so every round after it goes the very same way. Those that fit in
+ * what is left of the budget are skipped, only adding their cycles;
+ * the last one is run, so the run stops on the same instruction with
+ * the same cycles as it would without the skip.
+ */
+#define IDLE_SPAN 16
+
+/* register pairs, as bits */
+#define PAIR_BC 1
+#define PAIR_DE 2
+#define PAIR_HL 4
+#define PAIR_SP 8
+
+struct idle {
+	int32_t branch;		/* pc of the last jump back, -1 for none */
+	int period;		/* cycles of a round, 0 if not an idle loop */
+	int at;			/* cycles run when it was last taken */
+	uint64_t regs;		/* the registers then */
+	uint16_t sp;
+
+	/*
+	 * The pairs a round reads memory through as they are at its
+	 * start, and the POPs among them, checked against the map
+	 * before rounds are skipped
+	 */
+	int reads;
+	int pops;
+};
+
+/* the pairs an instruction idle_op takes writes, but SP moved by POP */
+static int pairs_written (uint8_t op)
 {
-	unsigned char *opcode = (memory + pc);
-	pc ++;
-	
-	switch (*opcode) {
-		/* nop */
-	case 0x00:
-		break;
-		/* LXI B, D16 */
-	case 0x01:
-		c = opcode[1];
-		b = opcode[2];
-		pc += 2;
-		break;
-		/* STAX B */
-	case 0x02:
-	{
-		uint16_t mem_addr = (b << 8) | c;
-		write_mem(mem_addr, a);
-		break;
-	}
-		/* INX B */
-	case 0x03:
-		c++;
-		if (c == 0)
-			b++;
-		break;
-		/* INR B */
-	case 0x04:
-		b++;
-		flags_zsp(b);
-		break;
-		/* DCR B */
-	case 0x05:
-		b--;
-		flags_zsp(b);
-		/* MVI B, byte */
-	case 0x06:
-		b = opcode[1];
-		pc++;
-		break;
-		/* RLC */
-	case 0x07:
-	{
-		uint8_t aux = a;
-		a = ((aux & 0x80) >> 7) | (aux << 1);
-		flags.cy = (0x80 == (aux & 0x80));
-		break;
-	}
-	case 0x08:
-		unknown_instruction();
-		break;
-		/* DAD B */
-	case 0x09:
-	{
-		uint32_t hl = (h << 8) | l;
-		uint32_t bc = (b << 8) | c;
-		uint32_t result = hl + bc;
-		h = (result & 0xff00) >> 8;
-		l = result & 0xff;
-		flags.cy = ((result & 0xffff0000) != 0);
-		break;
-	}
-		/* LDAX B */
-	case 0x0a:
-	{
-		uint16_t mem_addr = (b << 8) | c;
-		a = memory[mem_addr];
-		break;
-	}
-		/* DCX B */
-	case 0x0b:
-		c--;
-		if (c == 0xff)
-			b--;
-		break;
-		/* INR C */
-	case 0x0c:
-		c++;
-		flags_zsp(c);
-		break;
-		/* DCR C */
-	case 0x0d:
-		c--;
-		flags_zsp(c);
-		break;
-		/* MVI C, byte */
-	case 0x0e:
-		c = opcode[1];
-		pc++;
-		break;
-		/* RRC */
-	case 0x0f:
-	{
-		uint8_t aux = a;
-		a = ((aux & 1) << 7) | (aux >> 1);
-		flags.cy = (1 == (aux & 1));
-		break;
-	}
-	case 0x10:
-		unknown_instruction();
-		break;
-		/* LXI D, word */
-	case 0x11:
-		e = opcode[1];
-		d = opcode[2];
-		pc += 2;
-		break;
-		/* STAX D */
-	case 0x12:
-	{
-		uint16_t mem_addr = (d << 8) | e;
-		write_mem(mem_addr, a);
-		break;
-	}
-		/* INX D */
-	case 0x13:
-		e++;
-		if (e == 0)
-			d++;
-		break;
-		/* INR D */
-	case 0x14:
-		d++;
-		flags_zsp(d);
-		break;
-		/* DCR D */
-	case 0x15:
-		d--;
-		flags_zsp(d);
-		break;
-		/* MVI D, byte */
-	case 0x16:
-		d = opcode[1];
-		pc++;
-		break;
-		/* RAL */
-	case 0x17:
-	{
-		uint8_t aux = a;
-		a = flags.cy | (aux << 1);
-		flags.cy = (0x80 == (aux & 0x80));
-	}
-	case 0x18:
-		unknown_instruction();
-		break;
-		/* DAD D */
-	case 0x19:
-	{
-		uint32_t hl = (h << 8) | l;
-		uint32_t de = (d << 8) | e;
-		uint32_t result = hl + de;
-		h = (result & 0xff00) >> 8;
-		l = result & 0xff;
-		flags.cy = ((result & 0xffff0000) != 0);
-		break;
+	static const uint8_t pair[8] = {
+		PAIR_BC, PAIR_BC, PAIR_DE, PAIR_DE, PAIR_HL, PAIR_HL, 0, 0
+	};
+
+	if (op >= 0x40 && op < 0x80)		/* MOV */
+		return pair[(op >> 3) & 7];
+	switch (op & 0xcf) {
+	case 0x01: case 0x03: case 0x0b:	/* LXI, INX, DCX */
+		return 1 << ((op >> 4) & 3);
+	case 0x09: 				/* DAD */
+		return PAIR_HL;
+	case 0xc1:				/* POP */
+		return 0xf1 == op ? 0 : 1 << ((op >> 4) & 3);
+	}
+	switch (op & 0xc7) {
+	case 0x04: case 0x05: case 0x06:	/* INR, DCR, MVI */
+		return pair[(op >> 3) & 7];
+	}
+	switch (op) {
+	case 0x2a:				/* LHLD */
+		return PAIR_HL;
+	case 0xeb:				/* XCHG */
+		return PAIR_DE | PAIR_HL;
+	case 0xf9:				/* SPHL */
+		return PAIR_SP;
 	}
-	/* LDAX D */
+	return 0;
+}
+
+/*
+ * A read through pair, in a round where the pairs of written have
+ * changed before it. Unchanged, it is left for reads_memory to check
+ * once the pair is known, otherwise it could be anywhere.
+ */
+static int pair_read (const cpu8080_state *state, struct idle *idle,
+		      int pair, int written)
+{
+	if (written & pair)
+		return state->plain_reads;
+	idle->reads |= pair;
+	if (PAIR_SP == pair)
+		idle->pops++;
+	return 1;
+}
+
+/*
+ * true for an instruction that can be in an idle loop: one that only
+ * changes registers, reading memory at most
+ */
+static int idle_op (const cpu8080_state *state, struct idle *idle,
+		    const uint8_t *code, int written)
+{
+	const memory_map *map = state->map;
+	uint8_t op = code[0];
+	uint16_t addr;
+
+	/* MOV and the ALU, but MOV M, r and HLT */
+	if (op >= 0x40 && op < 0xc0) {
+		if (op >= 0x70 && op < 0x78)
+			return 0;
+		return 6 == (op & 7) ?
+			pair_read(state, idle, PAIR_HL, written) : 1;
+	}
+	switch (op) {
+	case 0x3a:		/* LDA */
+	case 0x2a:		/* LHLD */
+		addr = code[1] | code[2] << 8;
+		return NO_MEMORY != map->pages[addr >> 8].read &&
+			(0x3a == op ||
+			 NO_MEMORY != map->pages[(uint16_t) (addr + 1) >> 8].read);
+	case 0x0a:		/* LDAX */
+		return pair_read(state, idle, PAIR_BC, written);
 	case 0x1a:
-	{
-		uint16_t mem_addr = (d << 8) | e;
-		a = memory[mem_addr];
-		break;
+		return pair_read(state, idle, PAIR_DE, written);
+	case 0xc1: case 0xd1: case 0xe1: case 0xf1:	/* POP */
+		return pair_read(state, idle, PAIR_SP, written);
+	case 0x00:
+	case 0x01: case 0x11: case 0x21: case 0x31:	/* LXI */
+	case 0x03: case 0x13: case 0x23: case 0x33:	/* INX */
+	case 0x0b: case 0x1b: case 0x2b: case 0x3b:	/* DCX */
+	case 0x09: case 0x19: case 0x29: case 0x39:	/* DAD */
+	case 0x04: case 0x0c: case 0x14: case 0x1c:	/* INR */
+	case 0x24: case 0x2c: case 0x3c:
+	case 0x05: case 0x0d: case 0x15: case 0x1d:	/* DCR */
+	case 0x25: case 0x2d: case 0x3d:
+	case 0x06: case 0x0e: case 0x16: case 0x1e:	/* MVI */
+	case 0x26: case 0x2e: case 0x3e:
+	case 0x07: case 0x0f: case 0x17: case 0x1f:	/* rotates */
+	case 0x27: case 0x2f: case 0x37: case 0x3f:	/* DAA, CMA, STC, CMC */
+	case 0xc6: case 0xce: case 0xd6: case 0xde:	/* ALU immediate */
+	case 0xe6: case 0xee: case 0xf6: case 0xfe:
+	case 0xeb: case 0xf9:	/* XCHG, SPHL */
+		return 1;
 	}
-	/* DCX D */
-	case 0x1b:
-		e--;
-		if (e == 0xff)
-			d--;
-		break;
-		/* INR E */
-	case 0x1c:
-		e++;
-		flags_zsp(e);
-		break;
-		/* DCR E */
-	case 0x1d:
-		e--;
-		flags_zsp(e);
-		break;
-		/* MVI E, byte */
-	case 0x1e:
-		e = opcode[1];
-		pc++;
-		break;
-		/* RAR */
-	case 0x1f:
-	{
-		uint8_t aux = a;
-		a = (flags.cy << 7) | (aux >> 1);
-		flags.cy = (1 == (aux & 1));
-		break;
+	return 0;
+}
+
+/*
+ * true if the reads of a round through its pairs, as they are at its
+ * start, all go to memory
+ */
+static int reads_memory (const cpu8080_state *state, const struct idle *idle)
+{
+	const mem_page *pages = state->map->pages;
+	uint16_t top = state->sp + 2 * idle->pops - 1;
+
+	if ((idle->reads & PAIR_BC) && NO_MEMORY == pages[state->b].read)
+		return 0;
+	if ((idle->reads & PAIR_DE) && NO_MEMORY == pages[state->d].read)
+		return 0;
+	if ((idle->reads & PAIR_HL) && NO_MEMORY == pages[state->h].read)
+		return 0;
+	if ((idle->reads & PAIR_SP) &&
+	    (NO_MEMORY == pages[state->sp >> 8].read ||
+	     NO_MEMORY == pages[top >> 8].read))
+		return 0;
+	return 1;
+}
+
+/*
+ * The cycles of a round of the loop from head to the jump back (or
+ * HLT) at branch, 0 if it can't be an idle loop. What the round reads
+ * through its pairs goes in idle.
+ */
+static int loop_period (cpu8080_state *state, struct idle *idle,
+			uint16_t head, uint16_t branch)
+{
+	uint8_t op = state->memory[branch];
+	int period = cycles8080[op];
+	int written = 0;
+	int pc = head;
+
+	idle->reads = 0;
+	idle->pops = 0;
+	if (branch - head > IDLE_SPAN)
+		return 0;
+	if (op != 0x76 && op != 0xc3 && (op & 0xc7) != 0xc2)
+		return 0;
+	while (pc < branch) {
+		const uint8_t *code = state->memory + pc;
+
+		if (0 == length8080[*code] || pc + length8080[*code] > branch ||
+		    !idle_op(state, idle, code, written))
+			return 0;
+		written |= pairs_written(*code);
+		period += cycles8080[*code];
+		pc += length8080[*code];
+	}
+	return period;
+}
+
+/*
+ * Called as the jump back at branch is taken, with pc at its target
+ * and cycles run so far. Returns them, with the rounds of an idle
+ * loop that fit in the budget added.
+ */
+static inline int idle_skip (cpu8080_state *state, struct idle *idle,
+			     uint16_t branch, int cycles, int budget)
+{
+	int again = branch == idle->branch;
+	uint64_t regs;
+
+	if (!again) {
+		idle->branch = branch;
+		idle->period = loop_period(state, idle, state->pc, branch);
 	}
-	case 0x20:
-		unknown_instruction();
-		break;
-		/* LXI H, word */
-	case 0x21:
-		l = opcode[1];
-		h = opcode[2];
-		pc += 2;
-		break;
-		/* SHLD */
-	case 0x22:
-	{
-		uint16_t mem_addr = opcode[1] | (opcode[2] << 8);
-		write_mem(mem_addr, l);
-		write_mem(mem_addr+1, l);
-		pc += 2;
-		break;
+	if (0 == idle->period)
+		return cycles;
+
+	flags_sync(state);
+	regs = (uint64_t) state->a | (uint64_t) state->b << 8
+		| (uint64_t) state->c << 16 | (uint64_t) state->d << 24
+		| (uint64_t) state->e << 32 | (uint64_t) state->h << 40
+		| (uint64_t) state->l << 48
+		| (uint64_t) FLAGS_BYTE(state) << 56;
+	/*
+	 * A round is straight code up to the jump, so it being taken
+	 * again a round later means nothing else ran in between
+	 */
+	if (again && cycles - idle->at == idle->period && regs == idle->regs &&
+	    state->sp == idle->sp && reads_memory(state, idle)) {
+		int rounds = (budget - 1 - cycles) / idle->period;
+
+		if (rounds > 0)
+			cycles += rounds * idle->period;
 	}
-	/* INX H */
-	case 0x23:
-		l++;
-		if (l == 0)
-			h++;
-		break;
-		/* INR H */
-	case 0x24:
-		h += 1;
-		flags_zsp(h);
-		break;
-		/* MVI H, byte */
-	case 0x26:
-		h = opcode[1];
-		pc++;
-		break;
-		/* DAA */
-	case 0x27:
-		if ((a & 0xf) > 9)
-			a += 6;
-		if ((a & 0xf0) > 0x90) {
-			uint16_t result = (uint16_t) a + 0x60;
-			a = result & 0xff;
-			arith_flags(result);
+	idle->at = cycles;
+	idle->regs = regs;
+	idle->sp = state->sp;
+	return cycles;
+}
+
+/*
+ * Fetches the next opcode and moves pc past it. The opcode is kept
+ * apart from memory, which the instruction may overwrite before its
+ * cycles are counted.
+ */
+#define FETCH() do {						\
+		opcode = state->memory + state->pc;		\
+		op = *opcode;					\
+		state->pc++;					\
+	} while (0)
+
+#if defined(__GNUC__) && !defined(DISPATCH_SWITCH)
+/*
+ * Threaded code: every handler ends with its own copy of the
+ * accounting + fetch + indirect jump, so each opcode gets its own
+ * branch prediction slot instead of sharing the one of the switch.
+ */
+#define OP(n) op_##n
+/* the handler labels, in opcode order */
+#define DISPATCH_TABLE {										\
+		&&op_0x00, &&op_0x01, &&op_0x02, &&op_0x03, &&op_0x04, &&op_0x05, &&op_0x06, &&op_0x07,	\
+		&&op_0x08, &&op_0x09, &&op_0x0a, &&op_0x0b, &&op_0x0c, &&op_0x0d, &&op_0x0e, &&op_0x0f,	\
+		&&op_0x10, &&op_0x11, &&op_0x12, &&op_0x13, &&op_0x14, &&op_0x15, &&op_0x16, &&op_0x17,	\
+		&&op_0x18, &&op_0x19, &&op_0x1a, &&op_0x1b, &&op_0x1c, &&op_0x1d, &&op_0x1e, &&op_0x1f,	\
+		&&op_0x20, &&op_0x21, &&op_0x22, &&op_0x23, &&op_0x24, &&op_0x25, &&op_0x26, &&op_0x27,	\
+		&&op_0x28, &&op_0x29, &&op_0x2a, &&op_0x2b, &&op_0x2c, &&op_0x2d, &&op_0x2e, &&op_0x2f,	\
+		&&op_0x30, &&op_0x31, &&op_0x32, &&op_0x33, &&op_0x34, &&op_0x35, &&op_0x36, &&op_0x37,	\
+		&&op_0x38, &&op_0x39, &&op_0x3a, &&op_0x3b, &&op_0x3c, &&op_0x3d, &&op_0x3e, &&op_0x3f,	\
+		&&op_0x40, &&op_0x41, &&op_0x42, &&op_0x43, &&op_0x44, &&op_0x45, &&op_0x46, &&op_0x47,	\
+		&&op_0x48, &&op_0x49, &&op_0x4a, &&op_0x4b, &&op_0x4c, &&op_0x4d, &&op_0x4e, &&op_0x4f,	\
+		&&op_0x50, &&op_0x51, &&op_0x52, &&op_0x53, &&op_0x54, &&op_0x55, &&op_0x56, &&op_0x57,	\
+		&&op_0x58, &&op_0x59, &&op_0x5a, &&op_0x5b, &&op_0x5c, &&op_0x5d, &&op_0x5e, &&op_0x5f,	\
+		&&op_0x60, &&op_0x61, &&op_0x62, &&op_0x63, &&op_0x64, &&op_0x65, &&op_0x66, &&op_0x67,	\
+		&&op_0x68, &&op_0x69, &&op_0x6a, &&op_0x6b, &&op_0x6c, &&op_0x6d, &&op_0x6e, &&op_0x6f,	\
+		&&op_0x70, &&op_0x71, &&op_0x72, &&op_0x73, &&op_0x74, &&op_0x75, &&op_0x76, &&op_0x77,	\
+		&&op_0x78, &&op_0x79, &&op_0x7a, &&op_0x7b, &&op_0x7c, &&op_0x7d, &&op_0x7e, &&op_0x7f,	\
+		&&op_0x80, &&op_0x81, &&op_0x82, &&op_0x83, &&op_0x84, &&op_0x85, &&op_0x86, &&op_0x87,	\
+		&&op_0x88, &&op_0x89, &&op_0x8a, &&op_0x8b, &&op_0x8c, &&op_0x8d, &&op_0x8e, &&op_0x8f,	\
+		&&op_0x90, &&op_0x91, &&op_0x92, &&op_0x93, &&op_0x94, &&op_0x95, &&op_0x96, &&op_0x97,	\
+		&&op_0x98, &&op_0x99, &&op_0x9a, &&op_0x9b, &&op_0x9c, &&op_0x9d, &&op_0x9e, &&op_0x9f,	\
+		&&op_0xa0, &&op_0xa1, &&op_0xa2, &&op_0xa3, &&op_0xa4, &&op_0xa5, &&op_0xa6, &&op_0xa7,	\
+		&&op_0xa8, &&op_0xa9, &&op_0xaa, &&op_0xab, &&op_0xac, &&op_0xad, &&op_0xae, &&op_0xaf,	\
+		&&op_0xb0, &&op_0xb1, &&op_0xb2, &&op_0xb3, &&op_0xb4, &&op_0xb5, &&op_0xb6, &&op_0xb7,	\
+		&&op_0xb8, &&op_0xb9, &&op_0xba, &&op_0xbb, &&op_0xbc, &&op_0xbd, &&op_0xbe, &&op_0xbf,	\
+		&&op_0xc0, &&op_0xc1, &&op_0xc2, &&op_0xc3, &&op_0xc4, &&op_0xc5, &&op_0xc6, &&op_0xc7,	\
+		&&op_0xc8, &&op_0xc9, &&op_0xca, &&op_0xcb, &&op_0xcc, &&op_0xcd, &&op_0xce, &&op_0xcf,	\
+		&&op_0xd0, &&op_0xd1, &&op_0xd2, &&op_0xd3, &&op_0xd4, &&op_0xd5, &&op_0xd6, &&op_0xd7,	\
+		&&op_0xd8, &&op_0xd9, &&op_0xda, &&op_0xdb, &&op_0xdc, &&op_0xdd, &&op_0xde, &&op_0xdf,	\
+		&&op_0xe0, &&op_0xe1, &&op_0xe2, &&op_0xe3, &&op_0xe4, &&op_0xe5, &&op_0xe6, &&op_0xe7,	\
+		&&op_0xe8, &&op_0xe9, &&op_0xea, &&op_0xeb, &&op_0xec, &&op_0xed, &&op_0xee, &&op_0xef,	\
+		&&op_0xf0, &&op_0xf1, &&op_0xf2, &&op_0xf3, &&op_0xf4, &&op_0xf5, &&op_0xf6, &&op_0xf7,	\
+		&&op_0xf8, &&op_0xf9, &&op_0xfa, &&op_0xfb, &&op_0xfc, &&op_0xfd, &&op_0xfe, &&op_0xff,	\
+	}
+#define NEXT do {						\
+		cycles += cycles8080[op];			\
+		if (cycles >= budget)				\
+			goto done;				\
+		FETCH();					\
+		goto *dispatch[op];				\
+	} while (0)
+#else
+/*
+ * Reference mode: one big switch in a loop.
+ */
+#define OP(n) case n
+#define NEXT break
+#endif
+#define LOOP() do {							\
+		uint16_t from = opcode - state->memory;			\
+									\
+		if (state->pc <= from)					\
+			cycles = idle_skip(state, &idle, from, cycles, budget);	\
+	} while (0)
+
+/*
+ * Runs instructions until at least budget cycles have passed and
+ * returns the number of cycles actually spent (an instruction is never
+ * split, so this can overshoot the budget by a few cycles), or -1 if
+ * an unknown instruction was hit.
+ */
+static int execute (cpu8080_state *state, int budget)
+{
+	struct idle idle = { -1 };
+	unsigned char *opcode;
+	uint8_t op;
+	int cycles = 0;
+
+#if defined(__GNUC__) && !defined(DISPATCH_SWITCH)
+	static void *const dispatch[256] = DISPATCH_TABLE;
+
+	FETCH();
+	goto *dispatch[op];
+#include "ops8080.h"
+#else
+	for (;;) {
+		FETCH();
+		switch (op) {
+#include "ops8080.h"
 		}
-		break;
-	case 0x28:
-		unknown_instruction();
-		break;
-		/* DAD H */
-	case 0x29:
-	{
-		uint32_t hl = (h << 8) | l;
-		uint32_t result = 2 * hl;
-		h = (result & 0xff00) >> 8;
-		l = (result & 0xff);
-		flags.cy = ((result & 0xffff0000) != 0);
-		break;
+		cycles += cycles8080[op];
+		if (cycles >= budget)
+			goto done;
 	}
-	/* LHLD addr */
-	case 0x2a:
-	{
-		uint16_t mem_addr = opcode[1] | (opcode[2] << 8);
-		l = memory[mem_addr];
-		h = memory[mem_addr+1]; 
-		pc += 2;
-		break;
+#endif
+
+done:
+	flags_sync(state);
+	return cycles;
+
+unknown:
+	/* what ran before it still counts */
+	state->cycles += cycles;
+	return unknown_instruction(state);
+}
+
+#undef OP
+#undef NEXT
+#undef LOOP
+
+/*
+ * The loops of execute() again, recording every instruction into the
+ * profile and the trace of the core on the way. A copy of their own, so
+ * profiling and tracing add nothing to execute() when they are off.
+ */
+#define INSTRUMENT() do {						\
+		if (prof)						\
+			profile_step(prof, state, opcode - state->memory,	\
+				     op, cycles8080[op]);		\
+		if (trace) {						\
+			flags_sync(state);				\
+			trace_step(trace, state, opcode, FLAGS_BYTE(state),	\
+				   state->cycles + cycles);		\
+		}							\
+	} while (0)
+
+#if defined(__GNUC__) && !defined(DISPATCH_SWITCH)
+#define OP(n) op_##n
+#define NEXT do {						\
+		cycles += cycles8080[op];			\
+		INSTRUMENT();					\
+		if (cycles >= budget)				\
+			goto done;				\
+		FETCH();					\
+		goto *dispatch[op];				\
+	} while (0)
+#else
+#define OP(n) case n
+#define NEXT break
+#endif
+/* every round of an idle loop is recorded, none is skipped */
+#define LOOP() do { } while (0)
+
+static int execute_instrumented (cpu8080_state *state, int budget)
+{
+	struct profile *prof = state->profile;
+	struct trace *trace = state->trace;
+	unsigned char *opcode;
+	uint8_t op;
+	int cycles = 0;
+
+	if (prof)
+		profile_resume(prof, state);
+#if defined(__GNUC__) && !defined(DISPATCH_SWITCH)
+	static void *const dispatch[256] = DISPATCH_TABLE;
+
+	FETCH();
+	goto *dispatch[op];
+#include "ops8080.h"
+#else
+	for (;;) {
+		FETCH();
+		switch (op) {
+#include "ops8080.h"
+		}
+		cycles += cycles8080[op];
+		INSTRUMENT();
+		if (cycles >= budget)
+			goto done;
 	}
-	/* DCX H */
-	case 0x2b:
-		l--;
-		if (l == 0xff)
-			h--;
-		break;
-		/* INR L */
-	case 0x2c:
-		l++;
-		flags_zsp(l);
-		break;
-		/* DCR L */
-	case 0x2d:
-		l--;
-		flags_zsp(l);
-		break;
-		/* MVI L, byte */
-	case 0x2e:
-		l = opcode[1];
-		pc++;
-		break;
-		/* CMA */
-	case 0x2f:
-		a = ~a;
-		break;
-	case 0x30:
-		unknown_instruction();
-		break;
-		/* LXI SP, word */
-	case 0x31:
-		sp = (opcode[2] << 8) | opcode[1];
-		pc += 2;
-		break;
-		/* STA (word) */
-	case 0x32:
-	{
-		uint16_t mem_addr = (opcode[2] << 8) | opcode[1];
-		write_mem(mem_addr, a);
-		pc += 2;
-		break;
-	}	
-	/* INX SP */
-	case 0x33:
-		sp++;
-		break;
-		/* INR M */
-	case 0x34:
-	{
-		uint8_t result = read_from_hl() + 1;
-		flags_zsp(result);
-		write_to_hl(result);
-		break;
+#endif
+
+done:
+	if (prof)
+		profile_pause(prof, state);
+	flags_sync(state);
+	return cycles;
+
+unknown:
+	/* paused on the opcode, where pc is left */
+	unknown_instruction(state);
+	if (prof)
+		profile_pause(prof, state);
+	state->cycles += cycles;
+	return -1;
+}
+
+#undef OP
+#undef NEXT
+#undef LOOP
+#undef INSTRUMENT
+#undef FETCH
+
+#ifdef BLOCK_CACHE
+/*
+ * true for the instructions that can move pc anywhere else than
+ * the next instruction: jumps, calls, returns, RST, PCHL and HLT
+ */
+static int ends_block (uint8_t op)
+{
+	if (op == 0x76)
+		return 1;
+	if (op < 0xc0)
+		return 0;
+	switch (op & 7) {
+	case 0: case 2: case 4: case 7:
+		return 1;
+	}
+	return op == 0xc3 || op == 0xc9 || op == 0xcd || op == 0xe9;
+}
+
+/*
+ * Decodes the block starting at pc into blk.
+ * Returns NULL if pc is on an opcode the core doesn't know.
+ */
+static struct block *block_decode (cpu8080_state *state, struct block *blk,
+				   uint16_t pc)
+{
+	uint16_t addr = pc;
+
+	blk->start = pc;
+	blk->count = 0;
+	blk->cycles = 0;
+#ifdef JIT
+	blk->native = NULL;
+	blk->tried = 0;
+	blk->hits = 0;
+#endif
+	while (blk->count < BLOCK_MAX_OPS) {
+		uint8_t op = state->memory[addr];
+		unsigned char *uop = blk->ops[blk->count];
+
+		if (0 == length8080[op])
+			break;
+		uop[0] = op;
+		uop[1] = state->memory[(uint16_t) (addr + 1)];
+		uop[2] = state->memory[(uint16_t) (addr + 2)];
+		blk->count++;
+		blk->cycles += cycles8080[op];
+		addr += length8080[op];
+		if (ends_block(op))
+			break;
+	}
+	blk->len = addr - pc;
+#ifdef JIT
+	/*
+	 * An idle loop on its own is left to the interpreter, compiled
+	 * code would go round it until the budget runs out
+	 */
+	blk->idle = 0;
+	if (blk->count) {
+		unsigned char *uop = blk->ops[blk->count - 1];
+		uint16_t last = addr - length8080[uop[0]];
+		uint16_t target = 0x76 == uop[0] ? last : uop[1] | uop[2] << 8;
+		struct idle idle;
+
+		if (target == pc && loop_period(state, &idle, pc, last))
+			blk->idle = blk->tried = 1;
 	}
-	/* DCR M */
-	case 0x35:
-	{
-		uint8_t result = read_from_hl() - 1;
-		flags_zsp(result);
-		write_to_hl(result);
-		break;
+#endif
+
+	for (int page = pc >> 8; page <= ((addr - 1) & 0xffff) >> 8; page++) {
+		state->blocks->code_pages[page] = 1;
+#ifdef JIT
+		state->blocks->direct_pages[page] &= ~DIRECT_WRITE;
+#endif
 	}
-	/* MVI M, byte */
-	case 0x36:
-	{
-		write_to_hl(opcode[1]);
-		pc++;
-		break;
-	}
-	/* STC */
-	case 0x37:
-		flags.cy = 1;
-		break;
-	case 0x38:
-		unknown_instruction();
-		break;
-		/* DAD SP */
-	case 0x39:
-	{
-		uint32_t hl = (h << 8) | l;
-		uint32_t result = hl + sp;
-		h = (result & 0xff00) >> 8;
-		l = result & 0xff00;
-		flags.cy = ((result & 0xffff0000) > 0);
-	}
-	case 0x3a:
-	{
-		uint16_t mem_addr = (opcode[2] << 8) | opcode[1];
-		a = memory[mem_addr];
-		pc += 2;
-	}
-	/* DCX SP */
-	case 0x3b:
-		sp--;
-		break;
-		/* INR A */
-	case 0x3c:
-		a++;
-		flags_zsp(a);
-		break;
-		/* DCR A */
-	case 0x3d:
-		a--;
-		flags_zsp(a);
-		break;
-		/* MVI A, byte */
-	case 0x3e:
-		a = opcode[1];
-		pc++;
-		break;
-		/* MOV B, ? */
-	case 0x40: b = b; break;
-	case 0x41: b = c; break;
-	case 0x42: b = d; break;
-	case 0x43: b = e; break;
-	case 0x44: b = h; break;
-	case 0x45: b = l; break;
-	case 0x46: b = read_from_hl(); break;
-	case 0x47: b = a; break;
-		/* MOV C, ? */
-	case 0x48: c = b; break;
-	case 0x49: c = c; break;
-	case 0x4a: c = d; break;
-	case 0x4b: c = e; break;
-	case 0x4c: c = h; break;
-	case 0x4d: c = l; break;
-	case 0x4e: c = read_from_hl(); break;
-	case 0x4f: c = a; break;
-		/* MOV D, ? */
-	case 0x50: d = b; break;
-	case 0x51: d = c; break;
-	case 0x52: d = d; break;
-	case 0x53: d = e; break;
-	case 0x54: d = h; break;
-	case 0x55: d = l; break;
-	case 0x56: d = read_from_hl(); break;
-	case 0x57: d = a; break;
-		/* MOV E, ? */
-	case 0x58: e = b; break;
-	case 0x59: e = c; break;
-	case 0x5a: e = d; break;
-	case 0x5b: e = e; break;
-	case 0x5c: e = h; break;
-	case 0x5d: e = l; break;
-	case 0x5e: e = read_from_hl(); break;
-	case 0x5f: e = a; break;
-		/* MOV H, ? */
-	case 0x60: h = b; break;
-	case 0x61: h = c; break;
-	case 0x62: h = d; break;
-	case 0x63: h = e; break;
-	case 0x64: h = h; break;
-	case 0x65: h = l; break;
-	case 0x66: h = read_from_hl(); break;
-	case 0x67: h = a; break;
-		/* MOV L, ? */
-	case 0x68: l = b; break;
-	case 0x69: l = c; break;
-	case 0x6a: l = d; break;
-	case 0x6b: l = e; break;
-	case 0x6c: l = h; break;
-	case 0x6d: l = l; break;
-	case 0x6e: l = read_from_hl(); break;
-	case 0x6f: l = a; break;
-		/* MOV M, ? */
-	case 0x70: write_to_hl(b); break;
-	case 0x71: write_to_hl(c); break;
-	case 0x72: write_to_hl(d); break;
-	case 0x73: write_to_hl(e); break;
-	case 0x74: write_to_hl(h); break;
-	case 0x75: write_to_hl(l); break;
-	case 0x76: break;
-	case 0x77: write_to_hl(a); break;
-		/* MOV A, ? */
-	case 0x78: a = b; break;
-	case 0x79: a = c; break;
-	case 0x7a: a = d; break;
-	case 0x7b: a = e; break;
-	case 0x7c: a = h; break;
-	case 0x7d: a = l; break;
-	case 0x7e: a = read_from_hl(); break;
-	case 0x7f: a = a; break;
-		/* ADD ? */
-	case 0x80: { uint16_t result = (uint16_t) a + (uint16_t) b;
-			arith_flags(result); a = (result & 0xff); break; }
-	case 0x81: { uint16_t result = (uint16_t) a + (uint16_t) c;
-			arith_flags(result); a = (result & 0xff); break; }
-	case 0x82: { uint16_t result = (uint16_t) a + (uint16_t) d;
-			arith_flags(result); a = (result & 0xff); break; }
-	case 0x83: { uint16_t result = (uint16_t) a + (uint16_t) e;
-			arith_flags(result); a = (result & 0xff); break; }
-	case 0x84: { uint16_t result = (uint16_t) a + (uint16_t) h;
-			arith_flags(result); a = (result & 0xff); break; }
-	case 0x85: { uint16_t result = (uint16_t) a + (uint16_t) l;
-			arith_flags(result); a = (result & 0xff); break; }
-	case 0x86: { uint16_t result = (uint16_t) a + (uint16_t) read_from_hl();
-			arith_flags(result); a = (result & 0xff); break; }
-	case 0x87: { uint16_t result = (uint16_t) a + (uint16_t) a;
-			arith_flags(result); a = (result & 0xff); break; }
-
-		/* ADC ? */
-	case 0x88:
-	{
-		uint16_t result = (uint16_t) a + (uint16_t) b +
-			flags.cy;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	case 0x89:
-	{
-		uint16_t result = (uint16_t) a + (uint16_t) c +
-			flags.cy;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	case 0x8a:
-	{
-		uint16_t result = (uint16_t) a + (uint16_t) d +
-			flags.cy;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	case 0x8b:
-	{
-		uint16_t result = (uint16_t) a + (uint16_t) e +
-			flags.cy;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	case 0x8c:
-	{
-		uint16_t result = (uint16_t) a + (uint16_t) h +
-			flags.cy;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	case 0x8d:
-	{
-		uint16_t result = (uint16_t) a + (uint16_t) l +
-			flags.cy;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	case 0x8e:
-	{
-		uint16_t result = (uint16_t) a + (uint16_t) read_from_hl() +
-			flags.cy;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	case 0x8f:
-	{
-		uint16_t result = (uint16_t) a + (uint16_t) a +
-			flags.cy;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	/* SUB ? */
-	case 0x90:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) b;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	case 0x91:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) c;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	case 0x92:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) d;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	case 0x93:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) e;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	case 0x94:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) h;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	case 0x95:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) l;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	case 0x96:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) read_from_hl();
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	case 0x97:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) a;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	/* SBB ? */
-	case 0x98:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) b - flags.cy;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	case 0x99:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) c - flags.cy;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	case 0x9a:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) d - flags.cy;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	case 0x9b:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) e - flags.cy;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	case 0x9c:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) h - flags.cy;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	case 0x9d:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) l - flags.cy;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	case 0x9e:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) read_from_hl() - flags.cy;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	case 0x9f:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) a - flags.cy;
-		arith_flags(result);
-		a = (result & 0xff);
-		break;
-	}
-	/* ANA ? */
-	case 0xa0:
-		a = a & b;
-		logic_flags();
-		break;
-	case 0xa1:
-		a = a & c;
-		logic_flags();
-		break;
-	case 0xa2:
-		a = a & d;
-		logic_flags();
-		break;
-	case 0xa3:
-		a = a & e;
-		logic_flags();
-		break;
-	case 0xa4:
-		a = a & h;
-		logic_flags();
-		break;
-	case 0xa5:
-		a = a & l;
-		logic_flags();
-		break;
-	case 0xa6:
-		a = a & read_from_hl();
-		logic_flags();
-		break;
-	case 0xa7:
-		a = a & a;
-		logic_flags();
-		break;
-		/* XRA ? */
-	case 0xa8:
-		a ^= b;
-		logic_flags();
-		break;
-	case 0xa9:
-		a ^= c;
-		logic_flags();
-		break;
-	case 0xaa:
-		a ^= d;
-		logic_flags();
-		break;
-	case 0xab:
-		a ^= e;
-		logic_flags();
-		break;
-	case 0xac:
-		a ^= h;
-		logic_flags();
-		break;
-	case 0xad:
-		a ^= l;
-		logic_flags();
-		break;
-	case 0xae:
-		a ^= read_from_hl();
-		logic_flags();
-		break;
-	case 0xaf:
-		a ^= a;
-		logic_flags();
-		break;
-		/* ORA ? */
-		/* ^ not a Jojo reference */
-	case 0xb0:
-		a |= b;
-		logic_flags();
-		break;
-	case 0xb1:
-		a |= c;
-		logic_flags();
-		break;
-	case 0xb2:
-		a |= d;
-		logic_flags();
-		break;
-	case 0xb3:
-		a |= e;
-		logic_flags();
-		break;
-	case 0xb4:
-		a |= h;
-		logic_flags();
-		break;
-	case 0xb5:
-		a |= l;
-		logic_flags();
-		break;
-	case 0xb6:
-		a |= read_from_hl();
-		logic_flags();
-		break;
-	case 0xb7:
-		a |= a;
-		logic_flags();
-		break;
-		/* CMP ? */
-	case 0xb8:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) b;
-		arith_flags(result);
-		break;
-	}
-	case 0xb9:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) c;
-		arith_flags(result);
-		break;
-	}
-	case 0xba:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) d;
-		arith_flags(result);
-		break;
-	}
-	case 0xbb:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) e;
-		arith_flags(result);
-		break;
-	}
-	case 0xbc:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) h;
-		arith_flags(result);
-		break;
-	}
-	case 0xbd:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) l;
-		arith_flags(result);
-		break;
-	}
-	case 0xbe:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) read_from_hl();
-		arith_flags(result);
-		break;
-	}
-	case 0xbf:
-	{
-		uint16_t result = (uint16_t) a - (uint16_t) a;
-		arith_flags(result);
-		break;
-	}
-	/* RNZ */
-	case 0xc0:
-		if (!flags.z) {
-			pc = memory[sp] | (memory[sp+1] << 8);
-			sp += 2;
-		}
-		break;
-		/* POP B */
-	case 0xc1:
-		pop(&b, &c);
-		break;
-		/* JNZ addr */
-	case 0xc2:
-		if (!flags.z)
-			pc = (opcode[2] << 8) | opcode[1];
-		else
-			pc += 2;
-		break;
-		/* JMP addr */
-	case 0xc3:
-		pc = (opcode[2] << 8) | opcode[1];
-		break;
-		/* CNZ addr */
-	case 0xc4:
-		if (!flags.z) {
-			/* will return to the next instruction */
-			uint16_t return_addr = pc + 2;
-			write_mem(sp-1, (return_addr >> 8) & 0xff);
-			write_mem(sp-2, (return_addr & 0xff));
-			sp = sp - 2;
-			pc = (opcode[2] << 8) | opcode[1];
-		} else
-			pc += 2;
-		break;
-		/* PUSH B */
-	case 0xc5:
-		push(b, c);
-		break;
-		/* ADI byte */
-	case 0xc6:
-	{
-		uint16_t result = (uint16_t) a + (uint16_t) opcode[1];
-		flags_zsp(result & 0xff);
-		flags.cy = (result > 0xff);
-		a = result & 0xff;
-		pc++;
-		break;
-	}
-	/* RST 0 */
-	case 0xc7:
-	{
-		uint16_t return_addr = pc + 2;
-		write_mem(sp-1, (return_addr >> 8) & 0xff);
-		write_mem(sp-2, (return_addr & 0xff));
-		sp -= 2;
-		pc = 0x0000;
-		break;
-	}
-	/* RZ */
-	case 0xc8:
-		if (flags.z) {
-			pc = memory[sp] | (memory[sp+1] << 8);
-			sp += 2;
-		}
-		break;
-		/* RET */
-	case 0xc9:
-		pc = memory[sp] | (memory[sp + 1] << 8);
-		sp += 2;
-		break;
-		/* JZ addr */
-	case 0xca:
-		if (flags.z) {
-			pc = (opcode[2] << 8) | opcode[1];
-		} else
-			pc += 2;
-		break;
-	case 0xcb:
-		unknown_instruction();
-		break;
-		/* CZ addr */
-	case 0xcc:
-		if (flags.z == 1) {
-			uint16_t return_addr = pc + 2;
-			write_mem(sp-1, (return_addr >> 8) & 0xff);
-			write_mem(sp-2, (return_addr & 0xff));
-			sp -= 2;
-			pc = (opcode[2] << 8) | opcode[1];
-		} else
-			pc += 2;
-		break;
-		/* CALL addr */
-	case 0xcd:
-	{
-		uint16_t return_addr = pc + 2;
-		write_mem(sp-1, (return_addr >> 8) & 0xff);
-		write_mem(sp-2, (return_addr & 0xff));
-		sp -= 2;
-		pc = (opcode[2] << 8) | opcode[1];
-		break;
-	}
-	/* ACI byte */
-	case 0xce:
-	{
-		uint16_t result = a + opcode[1] + flags.cy;
-		flags_zsp(result & 0xff);
-		flags.cy = (result > 0xff);
-		a = result & 0xff;
-		pc++;
-	}
-	/* RST 1 */
-	case 0xcf:
-	{
-		uint16_t return_addr = pc + 2;
-		write_mem(sp-1, (return_addr >> 8) & 0xff);
-		write_mem(sp-2, (return_addr & 0xff));
-		sp -= 2;
-		pc = 0x0008;
-		break;
-	}
-	/* RNC */
-	case 0xd0:
-		if (!flags.cy) {
-			pc = memory[sp] | (memory[sp+1] << 8);
-			sp += 2;
+	return blk->count ? blk : NULL;
+}
+
+#ifdef JIT
+/*
+ * Compiles what it can of a hot block, unless it still is from before
+ * the slot was taken by another block. When the buffer is full every
+ * compiled block is forgotten and the buffer starts over.
+ */
+static void block_compile (struct block_cache *cache, struct block *blk)
+{
+	jit_fn native;
+	int count;
+
+	blk->tried = 1;
+	if (NULL == cache->jit)
+		return;
+	blk->native = jit_lookup(cache->jit, blk->start);
+	if (blk->native)
+		return;
+	native = jit_compile(cache->jit, blk->start, blk->ops, blk->count, &count);
+	if (count < 0) {
+		for (int i = 0; i < BLOCK_CACHE_SIZE; i++) {
+			cache->blocks[i].native = NULL;
+			cache->blocks[i].tried = cache->blocks[i].idle;
+			cache->blocks[i].hits = 0;
 		}
-		break;
-		/* POP D */
-	case 0xd1:
-		pop(&d, &e);
-		break;
-		/* JNC */
-	case 0xd2:
-		if (!flags.cy)
-			pc = (opcode[2] << 8) | opcode[1];
-		else
-			pc += 2;
-		break;
-		/* OUT d8 */
-	case 0xd3:
-		pc++;
-		break;
-		/* CNC addr */
-	case 0xd4:
-		if (!flags.cy) {
-			uint16_t return_addr = pc + 2;
-			write_mem(sp-1, (return_addr >> 8) & 0xff);
-			write_mem(sp-2, (return_addr & 0xff));
-			sp -= 2;
-			pc = (opcode[2] << 8) | opcode[1];
-		} else
-			pc += 2;
-		break;
-		/* PUSH D */
-	case 0xd5:
-		push(d, e);
-		break;
-		/* SUI byte */
-	case 0xd6:
-	{
-		uint8_t result = a - opcode[1];
-		flags_zsp(result & 0xff);
-		flags.cy = (a < opcode[1]);
-		a = result;
-		pc++;
-		break;
+		blk->tried = 1;
+		jit_flush(cache->jit);
+		native = jit_compile(cache->jit, blk->start, blk->ops, blk->count, &count);
 	}
-	/* RST 2 */
-	case 0xd7:
-	{
-		uint16_t return_addr = pc + 2;
-		write_mem(sp-1, (return_addr >> 8) & 0xff);
-		write_mem(sp-2, (return_addr & 0xff));
-		sp -= 2;
-		pc = 0x10;
-		break;
-	}
-	/* RN */
-	case 0xd8:
-		if (flags.cy) {
-			pc = memory[sp] | (memory[sp+1] << 8);
-			sp += 2;
+	blk->native = native;
+}
+#endif
+
+#if defined(__GNUC__) && !defined(DISPATCH_SWITCH)
+#define OP(n) op_##n
+#define NEXT do {						\
+		if (++i >= blk->count)				\
+			goto block_done;			\
+		opcode = blk->ops[i];				\
+		state->pc++;					\
+		goto *dispatch[*opcode];			\
+	} while (0)
+#else
+#define OP(n) case n
+#define NEXT break
+#endif
+/* cycles are only known between blocks, loops are looked for there */
+#define LOOP() do { } while (0)
+
+/*
+ * Same contract as execute(), but runs whole cached blocks and adds
+ * their cycles once per block. The block that would cross the budget
+ * is handed to execute(), so the run stops on the very same
+ * instruction as it would without the cache.
+ */
+static int execute_blocks (cpu8080_state *state, int budget)
+{
+	struct block_cache *cache = state->blocks;
+	struct idle idle = { -1 };
+	struct block *blk;
+	unsigned char *opcode;
+	int cycles = 0;
+	int i;
+#if defined(__GNUC__) && !defined(DISPATCH_SWITCH)
+	static void *const dispatch[256] = DISPATCH_TABLE;
+#endif
+
+	while (cycles < budget) {
+		blk = &cache->blocks[state->pc & (BLOCK_CACHE_SIZE - 1)];
+		if (0 == blk->count || blk->start != state->pc)
+			blk = block_decode(state, blk, state->pc);
+		if (NULL == blk || cycles + blk->cycles > budget) {
+			int rest = execute(state, budget - cycles);
+
+			if (rest < 0) {
+				state->cycles += cycles;
+				return rest;
+			}
+			return cycles + rest;
 		}
-		break;
-	case 0xd9:
-		unknown_instruction();
-		/* JC */
-	case 0xda:
-		if (flags.cy)
-			pc = (opcode[2] << 8) | opcode[1];
-		else
-			pc += 2;
-		break;
-		/* IN d8 */
-	case 0xdb:
-		pc++;
-		break;
-		/* CC addr */
-	case 0xdc:
-		if (flags.cy) {
-			uint16_t return_addr = pc + 2;
-			write_mem(sp-1, (return_addr >> 8) & 0xff);
-			write_mem(sp-2, (return_addr & 0xff));
-			sp -= 2;
-			pc = (opcode[2] << 8) | opcode[1];
-		} else
-			pc += 2;
-		break;
-	case 0xdd:
-		unknown_instruction();
-		break;
-		/* SBI byte */
-	case 0xde:
-	{
-		uint16_t result = a - opcode[1] - flags.cy;
-		flags_zsp(result & 0xff);
-		flags.cy = (result > 0xff);
-		a = result & 0xff;
-		pc++;
-		break;
-	}
-		/* RST 3 */
-	case 0xdf:
-	{
-		uint16_t return_addr = pc + 2;
-		write_mem(sp-1, (return_addr >> 8) & 0xff);
-		write_mem(sp-2, (return_addr & 0xff));
-		sp -= 2;
-		pc = 0x18;
-		break;
-	}
-	/* RPO */
-	case 0xe0:
-		if (flags.p == 0) {
-			pc = memory[sp] | (memory[sp + 1] << 8);
-			sp += 2;
+
+		i = 0;
+#ifdef JIT
+		if (!blk->tried && ++blk->hits >= JIT_THRESHOLD)
+			block_compile(cache, blk);
+		if (blk->native) {
+			int done;
+
+			/* the native code works on the flags byte */
+			flags_sync(state);
+			done = blk->native(state, budget - cycles);
+			if (done) {
+				cycles += done;
+				continue;
+			}
 		}
-		break;
-		/* POP H */
-	case 0xe1:
-		pop(&h, &l);
-		break;
-		/* LPO */
-	case 0xe2:
-		if (flags.p == 0)
-			pc = (opcode[2] << 8) | opcode[1];
-		else
-			pc += 2;
-		break;
-		/* XTHL */
-	case 0xe3:
-	{
-		uint8_t h = h;
-		uint8_t l = l;
-		l = memory[sp];
-		h = memory[sp+1];
-		write_mem(sp, l);
-		write_mem(sp + 1, h);
-		break;
-	}
-	/* CPO addr */
-	case 0xe4:
-		if (flags.p == 0) {
-			uint16_t return_addr = pc + 2;
-			write_mem(sp - 1, (return_addr >> 8) & 0xff);
-			write_mem(sp - 2, (return_addr & 0xff));
-			sp -= 2;
-			pc = (opcode[2] << 8) | opcode[1];
-		} else
-			pc += 2;
-		break;
-		/* PUSH H */
-	case 0xe5:
-		push(h, l);
-		break;
-		/* ANI byte */
-	case 0xe6:
-	{
-		a &= opcode[1];
-		logic_flags();
-		pc++;
-		break;
-	}
-	/* RST 4 */
-	case 0xe7:
-	{
-		uint16_t return_addr = pc + 2;
-		write_mem(sp - 1, (return_addr >> 8) & 0xff);
-		write_mem(sp - 2, (return_addr & 0xff));
-		pc = 0x20;
-		break;
-	}
-	/* RPE */
-	case 0xe8:
-		if (flags.p) {
-			pc = memory[sp] | (memory[sp + 1] << 8);
-			sp += 2;
+#endif
+#if defined(__GNUC__) && !defined(DISPATCH_SWITCH)
+		opcode = blk->ops[0];
+		state->pc++;
+		goto *dispatch[*opcode];
+#include "ops8080.h"
+block_done:
+#else
+		for (;;) {
+			opcode = blk->ops[i];
+			state->pc++;
+			switch (*opcode) {
+#include "ops8080.h"
+			}
+			if (++i >= blk->count)
+				break;
 		}
-		break;
-		/* PCHL */
-	case 0xe9:
-		pc = (h << 8) | l;
-		break;
-		/* JPE addr */
-	case 0xea:
-		if (flags.p)
-			pc = (opcode[2] << 8) | opcode[1];
-		else
-			pc += 2;
-		break;
-		/* XCHG */
-	case 0xeb:
-	{
-		uint8_t aux = d;
-		d = h;
-		h = aux;
-		aux = e;
-		e = l;
-		l = aux;
-		break;
-	}
-	/* CPE addr */
-	case 0xec:
-		if (flags.p) {
-			uint16_t return_addr = pc + 2;
-			write_mem(sp - 1, (return_addr >> 8) & 0xff);
-			write_mem(sp - 2, (return_addr & 0xff));
-			sp -= 2;
-			pc = (opcode[2] << 8) | opcode[1];
-		} else
-			pc += 2;
-		break;
-	case 0xed:
-		unknown_instruction();
-		/* XRI data */
-	case 0xee:
-	{
-		uint8_t x = a ^ opcode[1];
-		flags_zsp(x);
-		flags.cy = 0;
-		a = x;
-		pc++;
-		break;
-	}
-	/* RST 5 */
-	case 0xef:
-	{
-		uint16_t return_addr = pc + 2;
-		write_mem(sp - 1, (return_addr >> 8) & 0xff);
-		write_mem(sp - 2, (return_addr & 0xff));
-		sp -= 2;
-		pc = 0x28;
-	}
-	/* RP */
-	case 0xf0:
-		if (!flags.s) {
-			pc = memory[sp] | (memory[sp + 1] << 8);
-			sp += 2;
+#endif
+		if (i == blk->count) {
+			uint16_t last = blk->start + blk->len -
+				length8080[blk->ops[i - 1][0]];
+
+			cycles += blk->cycles;
+			/* the jump or HLT it ends with went back */
+			if (state->pc <= last)
+				cycles = idle_skip(state, &idle, last, cycles, budget);
+		} else {
+			/* cut short by a write to its own code */
+			for (int k = 0; k < i; k++)
+				cycles += cycles8080[blk->ops[k][0]];
 		}
-		break;
-		/* POP PSW */
-	case 0xf1:
-		pop(&a, (unsigned char *) &flags);
-		break;
-		/* JP addr */
-	case 0xf2:
-		if (!flags.s)
-			pc = (opcode[2] << 8) | opcode[1];
-		else
-			pc += 2;
-		break;
-		/* DI */
-	case 0xf3:
-		int_enable = 0;
-		break;
-		/* CP addr */
-	case 0xf4:
-		if (!flags.s) {
-			uint16_t return_addr = pc + 2;
-			write_mem(sp - 1, (return_addr >> 8) & 0xff);
-			write_mem(sp - 2, (return_addr & 0xff));
-			sp -= 2;
-			pc = (opcode[2] << 8) | opcode[1];
-		} else
-			pc += 2;
-		break;
-		/* PUSH PSW */
-	case 0xf5:
-		push(a, *(unsigned char *) &flags);
-		break;
-		/* ORI byte */
-	case 0xf6:
-	{
-		uint8_t x = a | opcode[1];
-		flags_zsp(x);
-		flags.cy = 0;
-		a = x;
-		pc++;
-		break;
 	}
-	/* RST 6 */
-	case 0xf7:
-	{
-		uint16_t return_addr = pc + 2;
-		write_mem(sp - 1, (return_addr >> 8) & 0xff);
-		write_mem(sp - 2, (return_addr & 0xff));
-		sp -= 2;
-		pc = 0x30;
-		break;
-	}
-	/* RM */
-	case 0xf8:
-		if (flags.s) {
-			pc = memory[sp] | (memory[sp+1] << 8);
-			sp += 2;
+
+	flags_sync(state);
+	return cycles;
+
+	/* blocks end before an opcode the core doesn't run */
+unknown:
+	state->cycles += cycles;
+	return unknown_instruction(state);
+}
+
+#undef OP
+#undef NEXT
+#undef LOOP
+#endif
+
+/*
+ * Runs for at least budget cycles with the fastest engine built in,
+ * or the instrumented one while the core is profiled or traced. No
+ * budget runs nothing: the engines would each fetch at least one
+ * instruction first, but the block cache none.
+ */
+static int run (cpu8080_state *state, int budget)
+{
+	int done;
+
+	if (budget <= 0)
+		return 0;
+	if (state->profile || state->trace)
+		done = execute_instrumented(state, budget);
+	else
+#ifdef BLOCK_CACHE
+		done = execute_blocks(state, budget);
+#else
+		done = execute(state, budget);
+#endif
+
+	if (done > 0)
+		state->cycles += done;
+	return done;
+}
+
+int emulate8080 (cpu8080_state *state)
+{
+	/* every instruction takes at least 4 cycles, so this runs exactly one */
+	int done = state->profile || state->trace ?
+		execute_instrumented(state, 1) : execute(state, 1);
+
+	if (done > 0)
+		state->cycles += done;
+	return done;
+}
+
+int run_cycles (cpu8080_state *state, int cycles)
+{
+	int done;
+
+	/* nothing ran, so nothing ran over */
+	if (cycles <= 0)
+		return 0;
+	done = run(state, cycles);
+	if (done < 0)
+		return -1;
+	return done - cycles;
+}
+
+/*
+ * One frame, run in two halves with the interrupt of each at its end.
+ * With count set, it single steps instead and adds the instructions
+ * it ran to it.
+ */
+static int run_frame (cpu8080_state *state, long long *count)
+{
+	int budget[2] = { HALF_FRAME_CYCLES - state->frame_ahead,
+			  FRAME_CYCLES - HALF_FRAME_CYCLES };
+	int over = 0;
+	int done = 0;
+
+	for (int half = 0; half < 2; half++) {
+		int cycles = 0;
+
+		budget[half] -= over;
+		if (count) {
+			while (cycles < budget[half]) {
+				int step = emulate8080(state);
+				if (step < 0)
+					return -1;
+				cycles += step;
+				(*count)++;
+			}
+		} else {
+			cycles = run(state, budget[half]);
+			if (cycles < 0)
+				return -1;
 		}
-		break;
-		/* SPHL */
-	case 0xf9:
-		sp = l | (h << 8);
-		break;
-		/* JM addr */
-	case 0xfa:
-		if (flags.s)
-			pc = (opcode[2] << 8) | opcode[1];
-		else
-			pc += 2;
-		break;
-		/* EI */
-	case 0xfb:
-		int_enable = 1;
-		break;
-		/* CM addr */
-	case 0xfc:
-		if (flags.s) {
-			uint16_t return_addr = pc + 2;
-			write_mem(sp - 1, (return_addr >> 8) & 0xff);
-			write_mem(sp - 2, (return_addr & 0xff));
-			sp -= 2;
-			pc = (opcode[2] << 8) | opcode[1];
-		} else
-			pc += 2;
-		break;
-	case 0xfd:
-		unknown_instruction();
-		break;
-		/* CPI byte */
-	case 0xfe:
-	{
-		uint8_t x = a - opcode[1];
-		flags_zsp(x);
-		flags.cy = (a < opcode[1]);
-		pc++;
-		break;
+		over = cycles - budget[half];
+		done += cycles;
+
+		if (state->int_enable)
+			generate_interrupt(state, half + 1);
 	}
-		/* RST 7 */
-	case 0xff:
-	{
-		uint16_t return_addr = pc + 2;
-		write_mem(sp - 1, (return_addr >> 8) & 0xff);
-		write_mem(sp - 2, (return_addr & 0xff));
-		sp -= 2;
-		pc = 0x38;
-		break;
+
+	state->frame_ahead = over;
+	return done;
+}
+
+int run_until_frame (cpu8080_state *state)
+{
+	return run_frame(state, NULL);
+}
+
+int step_until_frame (cpu8080_state *state, long long *count)
+{
+	return run_frame(state, count);
+}
+
+void generate_interrupt (cpu8080_state *state, int interrupt_num)
+{
+	/* a HLT is over, the handler returns past it */
+	if (state->halted) {
+		state->pc++;
+		state->halted = 0;
+	}
+	push(state, (state->pc & 0xFF00) >> 8, (state->pc & 0xff));
+	state->pc = 8 * interrupt_num;
+	state->int_enable = 0;
+}
+
+static uint8_t open_in (void *io, uint8_t port)
+{
+	return 0xff;
+}
+
+static void open_out (void *io, uint8_t port, uint8_t val)
+{
+}
+
+#define REPEAT4(x) x, x, x, x
+#define REPEAT16(x) REPEAT4(x), REPEAT4(x), REPEAT4(x), REPEAT4(x)
+#define REPEAT64(x) REPEAT16(x), REPEAT16(x), REPEAT16(x), REPEAT16(x)
+#define REPEAT256(x) REPEAT64(x), REPEAT64(x), REPEAT64(x), REPEAT64(x)
+
+/* every core starts with plain RAM everywhere ... */
+static const memory_map flat_memory;
+
+/* ... and nothing on its ports */
+static const port_map open_bus = {
+	.in = { REPEAT256(open_in) },
+	.out = { REPEAT256(open_out) },
+};
+
+void port_map_init (port_map *ports)
+{
+	*ports = open_bus;
+}
+
+/* how this build runs the code, as the benchmark prints it */
+#if defined(__GNUC__) && !defined(DISPATCH_SWITCH)
+#define ENGINE_DISPATCH "dispatch: computed goto, "
+#else
+#define ENGINE_DISPATCH "dispatch: switch, "
+#endif
+#ifdef LAZY_FLAGS
+#define ENGINE_FLAGS "flags: lazy, "
+#else
+#define ENGINE_FLAGS "flags: eager, "
+#endif
+#ifdef BLOCK_CACHE
+#define ENGINE_BLOCKS "block cache: on, "
+#else
+#define ENGINE_BLOCKS "block cache: off, "
+#endif
+#define ENGINE ENGINE_DISPATCH ENGINE_FLAGS ENGINE_BLOCKS
+
+const char *cpu8080_engine (const cpu8080_state *state)
+{
+#ifdef JIT
+	if (state->blocks->jit)
+		return ENGINE "jit: on";
+	return ENGINE "jit: unavailable";
+#else
+	return ENGINE "jit: off";
+#endif
+}
+
+int cpu8080_init (cpu8080_state *state)
+{
+	/* mapped, so a ROM can be mapped over it, see rom.h */
+	state->memory = mmap(NULL, MEMORY_SIZE + FETCH_TAIL,
+			     PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+			     -1, 0);
+	if (MAP_FAILED == state->memory) {
+		fprintf(stderr, "Failed to alloc mem for the 8080\n");
+		state->memory = NULL;
+		return -1;
+	}
+	state->map = &flat_memory;
+	state->ports = &open_bus;
+	state->io = NULL;
+	state->profile = NULL;
+	state->trace = NULL;
+#ifdef BLOCK_CACHE
+	state->blocks = calloc(1, sizeof(struct block_cache));
+	if (NULL == state->blocks) {
+		fprintf(stderr, "Failed to alloc the block cache\n");
+		munmap(state->memory, MEMORY_SIZE + FETCH_TAIL);
+		return -1;
 	}
+#endif
+#ifdef JIT
+	/* without executable memory the blocks are just interpreted */
+	state->blocks->jit = jit_create(state->blocks->direct_pages);
+	if (NULL == state->blocks->jit)
+		fprintf(stderr, "JIT unavailable, interpreting\n");
+#endif
+
+	cpu8080_reset(state);
+	return 0;
+}
+
+void cpu8080_reset (cpu8080_state *state)
+{
+	state->a = state->b = state->c = 0;
+	state->d = state->e = 0;
+	state->h = state->l = 0;
+	state->sp = 0;
+	state->pc = 0;
+	*(unsigned char *) &state->flags = 0;
+	state->int_enable = 0;
+	state->halted = 0;
+	state->lazy_op = 0;
+	state->frame_ahead = 0;
+	state->video_dirty = 0xffffffff;
+	state->illegal_writes = 0;
+	state->cycles = 0;
+	state->plain_reads = 1;
+	for (int page = 0; page < 256; page++)
+		if (NO_MEMORY == state->map->pages[page].read)
+			state->plain_reads = 0;
+	memcpy(state->memory + MEMORY_SIZE, state->memory, FETCH_TAIL);
+#ifdef BLOCK_CACHE
+	{
+#ifdef JIT
+		struct jit *jit = state->blocks->jit;
+
+		if (jit)
+			jit_flush(jit);
+#endif
+		memset(state->blocks, 0, sizeof(struct block_cache));
+#ifdef JIT
+		state->blocks->jit = jit;
+		for (int page = 0; page < 256; page++)
+			state->blocks->direct_pages[page] = direct_access(state, page);
+#endif
 	}
-#if PRINTOPS
-	printf("\t");
-	printf("%c", state->cc.z ? 'z' : '.');
-	printf("%c", state->cc.s ? 's' : '.');
-	printf("%c", state->cc.p ? 'p' : '.');
-	printf("%c", state->cc.cy ? 'c' : '.');
-	printf("%c  ", state->cc.ac ? 'a' : '.');
-	printf("A $%02x B $%02x C $%02x D $%02x E $%02x H $%02x L $%02x SP %04x\n", state->a, state->b, state->c,
-           state->d, state->e, state->h, state->l, state->sp);
 #endif
-	return cycles8080[*opcode];	
 }
 
-void generate_interrupt (int interrupt_num)
+void cpu8080_write (cpu8080_state *state, uint16_t addr, uint8_t val)
 {
-	push((pc & 0xFF00) >> 8, (pc & 0xff));
-	pc = 8 * interrupt_num;
-	int_enable = 0;
+	write_mem(state, addr, val);
 }
 
-int main (void)
+void cpu8080_invalidate (cpu8080_state *state, uint16_t start, int len)
 {
-	printf("MMN 8080 Emulator\n");
-	return 0;
+	int end = start + len;
+
+	if (start < VIDEO_END && end > VIDEO_START)
+		state->video_dirty = 0xffffffff;
+	if (start < FETCH_TAIL)
+		memcpy(state->memory + MEMORY_SIZE, state->memory, FETCH_TAIL);
+#ifdef BLOCK_CACHE
+	for (int page = start >> 8; page <= (end - 1) >> 8 && page < 256; page++)
+		if (state->blocks->code_pages[page])
+			block_invalidate(state, page << 8);
+#endif
+}
+
+void cpu8080_destroy (cpu8080_state *state)
+{
+	if (state->memory)
+		munmap(state->memory, MEMORY_SIZE + FETCH_TAIL);
+	state->memory = NULL;
+#ifdef BLOCK_CACHE
+#ifdef JIT
+	if (state->blocks)
+		jit_destroy(state->blocks->jit);
+#endif
+	free(state->blocks);
+	state->blocks = NULL;
+#endif
 }
@@ -0,0 +1,251 @@
+#ifndef CPU8080_H
+#define CPU8080_H
+
+#include <stdint.h>
+
+struct block_cache;
+struct profile;
+struct trace;
+
+/*
+ * Flags of the machine
+ * it isvery important for the flags to be in the exact
+ * right bits
+ */
+typedef struct FLAGS {
+	uint8_t cy:1;
+	uint8_t pad1:1;
+	uint8_t p:1;
+	uint8_t pad2:1;
+	uint8_t ac:1;
+	uint8_t pad3:1;
+	uint8_t z:1;
+	uint8_t s:1;
+} FLAGS;
+
+/*
+ * Handlers of the IN and OUT instructions, one per port, called with
+ * the io pointer of the core.
+ */
+typedef uint8_t (*port_in_fn) (void *io, uint8_t port);
+typedef void (*port_out_fn) (void *io, uint8_t port, uint8_t val);
+
+/*
+ * What is wired to each of the 256 ports. IN and OUT index these
+ * directly, so every port needs a handler, even an unconnected one.
+ */
+typedef struct port_map {
+	port_in_fn in[256];
+	port_out_fn out[256];
+} port_map;
+
+/*
+ * Handlers of memory-mapped I/O, called with the io pointer of the
+ * core and the address accessed.
+ */
+typedef uint8_t (*mem_read_fn) (void *io, uint16_t addr);
+typedef void (*mem_write_fn) (void *io, uint16_t addr, uint8_t val);
+
+/* a page with nothing to read or write, see mem_page */
+#define NO_MEMORY INT32_MIN
+
+/*
+ * One 256 byte page of the address space. Byte addr of the page is
+ * memory[addr + read] for loads and memory[addr + write] for stores,
+ * so pages can be mirrors of each other. When there is NO_MEMORY to
+ * go to, the handler is called instead; a page with neither memory
+ * nor a write handler drops stores, counting them as illegal.
+ * A page without memory to read needs a read handler.
+ */
+typedef struct mem_page {
+	int32_t read;
+	int32_t write;
+	mem_read_fn read_fn;
+	mem_write_fn write_fn;
+} mem_page;
+
+/*
+ * The address space of a core, page by page. All zeroes is 64K of
+ * plain RAM.
+ */
+typedef struct memory_map {
+	mem_page pages[256];
+} memory_map;
+
+/*
+ * Everything a single 8080 core needs to run.
+ * Every helper takes one of these, so any number of cores can
+ * live side by side in the same process (one per thread, or many
+ * per thread), as long as no two threads touch the same state.
+ */
+typedef struct cpu8080_state {
+	uint8_t a;
+	uint8_t b;
+	uint8_t c;
+	uint8_t d;
+	uint8_t e;
+	uint8_t h;
+	uint8_t l;
+	uint16_t sp;
+	uint16_t pc;
+	uint8_t *memory;
+	/*
+	 * How loads and stores see memory, 64K of RAM after
+	 * cpu8080_init. Instructions are always fetched straight from
+	 * memory. Changing the map takes a cpu8080_reset.
+	 */
+	const memory_map *map;
+	/* set by cpu8080_reset: no page of map has a read handler */
+	uint8_t plain_reads;
+	/* stores the map dropped */
+	uint64_t illegal_writes;
+	/* the I/O bus, nothing connected after cpu8080_init */
+	const port_map *ports;
+	void *io;
+	FLAGS flags;
+	uint8_t int_enable;
+	/* stopped on a HLT, until an interrupt takes it past it */
+	uint8_t halted;
+
+	/*
+	 * LAZY_FLAGS builds only: the last ALU operation whose flags
+	 * have not been written to flags yet. It is settled before
+	 * execute() returns, so outside the core flags is always valid.
+	 */
+	uint8_t lazy_op;
+	uint8_t lazy_a;
+	uint8_t lazy_val;
+	uint16_t lazy_res;
+
+	/*
+	 * Bands of the screen written to since the framebuffer was last
+	 * converted: bit n stands for the video RAM bytes whose address
+	 * ends in n (address & 31), 8 rows of the rotated screen.
+	 */
+	uint32_t video_dirty;
+
+	/* what the core runs is recorded in these if set, see profile.h */
+	struct profile *profile;
+	/* and trace.h */
+	struct trace *trace;
+
+	/* BLOCK_CACHE builds only: decoded blocks of this core */
+	struct block_cache *blocks;
+
+	/*
+	 * Cycles run_until_frame already ran into the next frame, taken
+	 * off that frame so the interrupts stay on the 60 Hz grid.
+	 */
+	int frame_ahead;
+
+	/* cycles run since the last reset */
+	uint64_t cycles;
+} cpu8080_state;
+
+/* size of the address space allocated by cpu8080_init */
+#define MEMORY_SIZE 0x10000
+
+/* the 1 bit per pixel screen of Space Invaders, up to the end of RAM */
+#define VIDEO_START 0x2400
+#define VIDEO_END 0x4000
+
+/*
+ * Allocates the memory of a core and puts it in the reset state.
+ * The memory is a mapping of its own, see rom_map.
+ * Returns 0 on success, -1 if the memory couldn't be allocated.
+ */
+int cpu8080_init (cpu8080_state *state);
+
+/*
+ * Fills a port map with handlers of an unconnected bus: IN reads
+ * 0xff and OUT goes nowhere. Machines start from this and replace
+ * the ports they have.
+ */
+void port_map_init (port_map *ports);
+
+/*
+ * Clears the registers and flags and jumps back to 0x0000.
+ * Memory is left untouched, so a loaded ROM survives a reset.
+ * Anything written to memory behind the core's back (a ROM load)
+ * must be followed by a reset, which also empties the block cache.
+ */
+void cpu8080_reset (cpu8080_state *state);
+
+/*
+ * A load and a store the way instructions do them, through the map,
+ * for code that keeps the registers of the core elsewhere. The load
+ * is inline, it is mostly one lookup.
+ */
+static inline uint8_t cpu8080_read (cpu8080_state *state, uint16_t addr)
+{
+	const mem_page *page = &state->map->pages[addr >> 8];
+
+	if (NO_MEMORY == page->read)
+		return page->read_fn(state->io, addr);
+	return state->memory[(uint16_t) (addr + page->read)];
+}
+
+void cpu8080_write (cpu8080_state *state, uint16_t addr, uint8_t val);
+
+/*
+ * Lighter than a reset for a few bytes written to memory behind the
+ * core's back (a restored save state): forgets what was decoded or
+ * compiled from addresses start to start + len - 1 and marks what
+ * they cover of the screen as dirty. Registers are left alone.
+ */
+void cpu8080_invalidate (cpu8080_state *state, uint16_t start, int len);
+
+/*
+ * Frees everything cpu8080_init allocated.
+ */
+void cpu8080_destroy (cpu8080_state *state);
+
+/*
+ * Describes the dispatch, flag and compilation scheme the core was
+ * built with, as one line of text.
+ */
+const char *cpu8080_engine (const cpu8080_state *state);
+
+/*
+ * Executes one instruction and returns the number of cycles it took,
+ * or -1 if the opcode is not a valid 8080 instruction (pc is left
+ * pointing at it).
+ */
+int emulate8080 (cpu8080_state *state);
+
+/*
+ * Executes instructions until at least cycles cycles have run.
+ * Instructions are never split, so the last one can go past the
+ * budget: returns by how many cycles it did (0 if it ended exactly),
+ * or -1 on an invalid opcode, with pc left pointing at it and the
+ * cycles run before it added to the core's count. A budget of 0 or
+ * less runs nothing and returns 0, in every build.
+ * Idle loops, waiting for an interrupt that can't come before the
+ * budget runs out, and HLT are skipped over to the end of it, with
+ * the same cycles and registers as running them (see 8080.c).
+ */
+int run_cycles (cpu8080_state *state, int cycles);
+
+/* Space Invaders: a 2 MHz 8080, with the screen refreshed at 60 Hz */
+#define CPU_HZ 2000000
+#define FRAME_HZ 60
+#define FRAME_CYCLES (CPU_HZ / FRAME_HZ)
+#define HALF_FRAME_CYCLES (FRAME_CYCLES / 2)
+
+/*
+ * Runs one 60 Hz frame of the 2 MHz Space Invaders machine: RST 1
+ * when the beam reaches mid-screen and RST 2 at the end of the frame,
+ * each only if the game has interrupts enabled.
+ * Returns the cycles run, or -1 on an invalid opcode.
+ */
+int run_until_frame (cpu8080_state *state);
+
+/*
+ * run_until_frame one instruction at a time, adding the number of
+ * instructions run to count. Much slower, it is there for measuring.
+ */
+int step_until_frame (cpu8080_state *state, long long *count);
+
+void generate_interrupt (cpu8080_state *state, int interrupt_num);
+
+#endif
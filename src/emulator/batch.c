@@ -0,0 +1,294 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "batch.h"
+#include "movie.h"
+
+/*
+ * A thread and the jobs dealt to it, taken from the bottom by the
+ * thread itself and from the top by the others. A job runs a frame at
+ * a time and goes back to the bottom of the deque of the thread that
+ * ran it: that thread picks it up again next, while it is still in its
+ * caches, and the others only get to it once there is nothing left
+ * that hasn't started. A job being run is in no deque, so once every
+ * deque is empty the threads that still run one finish it on their
+ * own. Padded to whole cache lines, the threads write to their own.
+ */
+struct worker {
+	pthread_mutex_t lock;
+	int *deque;		/* job indices */
+	int top;
+	int bottom;
+
+	int cpu;		/* to pin to, -1 for anywhere */
+	uint64_t cycles;
+	long steals;
+	/* what the last job it finished ran on, for the next to start */
+	struct invaders *spare;
+	struct batch *batch;
+	pthread_t thread;
+} __attribute__((aligned(64)));
+
+/* a job between two frames */
+struct slot {
+	struct invaders *machine;	/* NULL until it starts */
+	long frame;
+};
+
+struct batch {
+	struct batch_job *jobs;
+	struct slot *slots;
+	struct worker *workers;
+	int threads;
+};
+
+static int pop (struct worker *w)
+{
+	int job = -1;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->bottom > w->top)
+		job = w->deque[--w->bottom];
+	pthread_mutex_unlock(&w->lock);
+	return job;
+}
+
+static void push (struct worker *w, int job)
+{
+	pthread_mutex_lock(&w->lock);
+	/* it took the job from here, so there is room for it again */
+	if (w->bottom == w->top)
+		w->top = w->bottom = 0;
+	w->deque[w->bottom++] = job;
+	pthread_mutex_unlock(&w->lock);
+}
+
+static int steal (struct worker *w)
+{
+	int job = -1;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->bottom > w->top)
+		job = w->deque[w->top++];
+	pthread_mutex_unlock(&w->lock);
+	return job;
+}
+
+/* the next job for w, its own or one from the others, -1 when done */
+static int next_job (struct worker *w)
+{
+	struct batch *batch = w->batch;
+	int self = w - batch->workers;
+	int job = pop(w);
+
+	for (int i = 1; job < 0 && i < batch->threads; i++) {
+		job = steal(&batch->workers[(self + i) % batch->threads]);
+		if (job >= 0)
+			w->steals++;
+	}
+	return job;
+}
+
+/*
+ * A machine for a job to start on: the one the thread's last finished
+ * job ran on, or a new one from the thread's own malloc arena.
+ */
+static struct invaders *take_machine (struct worker *w)
+{
+	struct invaders *machine = w->spare;
+
+	if (machine) {
+		w->spare = NULL;
+		return machine;
+	}
+	machine = malloc(sizeof(struct invaders));
+	if (NULL == machine || invaders_init(machine) < 0) {
+		fprintf(stderr, "Failed to alloc a batch machine\n");
+		free(machine);
+		return NULL;
+	}
+	return machine;
+}
+
+static void release_machine (struct worker *w, struct invaders *machine)
+{
+	if (NULL == w->spare) {
+		w->spare = machine;
+		return;
+	}
+	invaders_destroy(machine);
+	free(machine);
+}
+
+/*
+ * Runs the next frame of a job, starting it first if it hasn't.
+ * Returns 1 if it has frames left, 0 once it is over.
+ */
+static int run_slice (struct worker *w, int index)
+{
+	struct batch_job *job = &w->batch->jobs[index];
+	struct slot *slot = &w->batch->slots[index];
+	struct invaders *machine = slot->machine;
+	uint64_t before;
+
+	if (NULL == machine) {
+		machine = take_machine(w);
+		if (NULL == machine)
+			return 0;
+		if (invaders_load(machine, job->rom) < 0) {
+			release_machine(w, machine);
+			return 0;
+		}
+		slot->machine = machine;
+	}
+
+	if (slot->frame < job->frames) {
+		before = machine->cpu.cycles;
+		if (job->input)
+			job->input(machine, slot->frame, job->arg);
+		if (run_until_frame(&machine->cpu) < 0)
+			goto over;
+		w->cycles += machine->cpu.cycles - before;
+		if (++slot->frame < job->frames)
+			return 1;
+	}
+	job->cycles = machine->cpu.cycles;
+	job->hash = movie_hash(machine);
+	job->status = 0;
+over:
+	slot->machine = NULL;
+	release_machine(w, machine);
+	return 0;
+}
+
+static void *work (void *arg)
+{
+	struct worker *w = arg;
+	int job;
+
+	if (w->cpu >= 0) {
+		cpu_set_t set;
+
+		CPU_ZERO(&set);
+		CPU_SET(w->cpu, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	}
+
+	while ((job = next_job(w)) >= 0)
+		if (run_slice(w, job))
+			push(w, job);
+	if (w->spare) {
+		invaders_destroy(w->spare);
+		free(w->spare);
+	}
+	return NULL;
+}
+
+/* the CPUs the process may run on, in cpus, returns how many */
+static int usable_cpus (int *cpus, int max)
+{
+	cpu_set_t set;
+	int n = 0;
+
+	if (sched_getaffinity(0, sizeof(set), &set) < 0)
+		return 0;
+	for (int cpu = 0; cpu < CPU_SETSIZE && n < max; cpu++)
+		if (CPU_ISSET(cpu, &set))
+			cpus[n++] = cpu;
+	return n;
+}
+
+int batch_run (struct batch_job *jobs, int count, int threads,
+	       struct batch_stats *stats)
+{
+	struct batch batch = { jobs, NULL, NULL, 0 };
+	struct timespec start, end;
+	int cpus[CPU_SETSIZE];
+	int ncpus = usable_cpus(cpus, CPU_SETSIZE);
+	int started = 0;
+	int ret = 0;
+
+	if (threads <= 0)
+		threads = ncpus > 0 ? ncpus : 1;
+	batch.threads = threads;
+	if (posix_memalign((void **) &batch.workers, 64,
+			   threads * sizeof(struct worker)) != 0) {
+		fprintf(stderr, "Failed to alloc the batch threads\n");
+		return -1;
+	}
+	batch.slots = calloc(count > 0 ? count : 1, sizeof(struct slot));
+	if (NULL == batch.slots) {
+		fprintf(stderr, "Failed to alloc the batch threads\n");
+		free(batch.workers);
+		return -1;
+	}
+
+	for (int i = 0; i < threads; i++) {
+		struct worker *w = &batch.workers[i];
+
+		pthread_mutex_init(&w->lock, NULL);
+		w->deque = malloc((count / threads + 1) * sizeof(int));
+		w->top = w->bottom = 0;
+		/* pinned only when there is a CPU for every thread */
+		w->cpu = threads <= ncpus ? cpus[i] : -1;
+		w->cycles = 0;
+		w->steals = 0;
+		w->spare = NULL;
+		w->batch = &batch;
+		if (NULL == w->deque) {
+			fprintf(stderr, "Failed to alloc the batch threads\n");
+			ret = -1;
+		}
+	}
+	if (ret < 0)
+		goto out;
+	for (int job = 0; job < count; job++) {
+		jobs[job].status = -1;
+		jobs[job].cycles = 0;
+	}
+	/* dealt in turns, each thread starts from the front of its share */
+	for (int job = count - 1; job >= 0; job--) {
+		struct worker *w = &batch.workers[job % threads];
+		w->deque[w->bottom++] = job;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (; started < threads; started++)
+		if (pthread_create(&batch.workers[started].thread, NULL, work,
+				   &batch.workers[started]) != 0) {
+			fprintf(stderr, "Failed to start a batch thread\n");
+			ret = -1;
+			break;
+		}
+	/* whatever started still runs every job, stealing them */
+	for (int i = 0; i < started; i++)
+		pthread_join(batch.workers[i].thread, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	stats->threads = started;
+	stats->cycles = 0;
+	stats->steals = 0;
+	for (int i = 0; i < threads; i++) {
+		stats->cycles += batch.workers[i].cycles;
+		stats->steals += batch.workers[i].steals;
+	}
+	stats->secs = (end.tv_sec - start.tv_sec)
+		+ (end.tv_nsec - start.tv_nsec) / 1e9;
+	stats->mhz = stats->cycles / stats->secs / 1e6;
+	if (0 == started)
+		ret = -1;
+
+out:
+	for (int i = 0; i < threads; i++) {
+		pthread_mutex_destroy(&batch.workers[i].lock);
+		free(batch.workers[i].deque);
+	}
+	free(batch.workers);
+	free(batch.slots);
+	return ret;
+}
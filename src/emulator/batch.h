@@ -0,0 +1,57 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+
+#include "invaders.h"
+
+struct rom;
+
+/*
+ * Sets the buttons of a machine before each frame it runs, frame
+ * counting from 0 at power on.
+ */
+typedef void (*batch_input_fn) (struct invaders *machine, long frame,
+				void *arg);
+
+/*
+ * One machine to run: powered on with rom, then played for frames
+ * frames with input.
+ */
+struct batch_job {
+	const struct rom *rom;
+	batch_input_fn input;	/* NULL to press nothing */
+	void *arg;
+	long frames;
+
+	/* filled in by batch_run */
+	int status;		/* 0, or -1 if the machine failed */
+	uint64_t cycles;
+	uint64_t hash;		/* movie_hash at the end */
+};
+
+/* what a whole batch did */
+struct batch_stats {
+	int threads;
+	uint64_t cycles;
+	double secs;		/* wall clock */
+	double mhz;		/* emulated, all machines together */
+	long steals;		/* jobs taken from another thread's deque */
+};
+
+/*
+ * Runs the jobs to completion on threads threads (0 for one per CPU
+ * the process may use). The jobs are dealt out evenly up front and
+ * run a frame at a time: after each frame a job goes back to the
+ * thread that ran it, and a thread that runs out takes waiting jobs
+ * from the others, so long jobs get spread over the threads too.
+ * Machines are allocated by the threads that start the jobs, from
+ * their own malloc arenas, and a thread starts its next job on the
+ * machine of the last one it finished.
+ * Returns 0 once every job ran (see their status), -1 if the threads
+ * couldn't be started.
+ */
+int batch_run (struct batch_job *jobs, int count, int threads,
+	       struct batch_stats *stats);
+
+#endif
@@ -0,0 +1,545 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "8080.h"
+#include "cputest.h"
+#include "invaders.h"
+
+extern const unsigned char length8080[];
+
+struct regs {
+	uint8_t a, f, b, c, d, e, h, l;
+	uint16_t sp, pc;
+};
+
+/*
+ * One instruction, run from CODE on a core with nothing but zeroes in
+ * memory and the 16 bit word before at addr, and what it has to leave
+ * behind: the registers, the word at addr and, when it doesn't depend
+ * on a condition, the cycles it takes.
+ */
+struct vector {
+	const char *name;
+	uint8_t code[3];
+	struct regs in;
+	struct regs out;
+	uint16_t addr;
+	uint16_t before;
+	uint16_t after;
+	int cycles;
+};
+
+#define CODE 0x1000
+#define DATA 0x3000
+#define STACK 0x2000
+
+static const struct vector vectors[] = {
+	{ "NOP", { 0x00 }, { .sp = STACK }, { .sp = STACK, .pc = 0x1001 },
+	  .cycles = 4 },
+	{ "LXI B", { 0x01, 0x34, 0x12 }, { .sp = STACK },
+	  { .b = 0x12, .c = 0x34, .sp = STACK, .pc = 0x1003 }, .cycles = 10 },
+	{ "STAX B", { 0x02 }, { .a = 0x5a, .b = 0x30, .sp = STACK },
+	  { .a = 0x5a, .b = 0x30, .sp = STACK, .pc = 0x1001 },
+	  DATA, 0x0000, 0x005a, 7 },
+	{ "INX B", { 0x03 }, { .b = 0x12, .c = 0xff, .sp = STACK },
+	  { .b = 0x13, .c = 0x00, .sp = STACK, .pc = 0x1001 }, .cycles = 5 },
+	{ "INR B", { 0x04 }, { .f = 0x01, .b = 0x0f, .sp = STACK },
+	  { .f = 0x11, .b = 0x10, .sp = STACK, .pc = 0x1001 }, .cycles = 5 },
+	{ "DCR B", { 0x05 }, { .b = 0x01, .sp = STACK },
+	  { .f = 0x54, .sp = STACK, .pc = 0x1001 }, .cycles = 5 },
+	{ "MVI B", { 0x06, 0x42 }, { .sp = STACK },
+	  { .b = 0x42, .sp = STACK, .pc = 0x1002 }, .cycles = 7 },
+	{ "RLC", { 0x07 }, { .a = 0x81, .sp = STACK },
+	  { .a = 0x03, .f = 0x01, .sp = STACK, .pc = 0x1001 }, .cycles = 4 },
+	{ "DAD B", { 0x09 }, { .b = 0x11, .c = 0x11, .h = 0x12, .l = 0x34, .sp = STACK },
+	  { .b = 0x11, .c = 0x11, .h = 0x23, .l = 0x45, .sp = STACK, .pc = 0x1001 },
+	  .cycles = 10 },
+	{ "RRC", { 0x0f }, { .a = 0x01, .sp = STACK },
+	  { .a = 0x80, .f = 0x01, .sp = STACK, .pc = 0x1001 }, .cycles = 4 },
+	{ "RAL", { 0x17 }, { .a = 0x80, .sp = STACK },
+	  { .f = 0x01, .sp = STACK, .pc = 0x1001 }, .cycles = 4 },
+	{ "LDAX D", { 0x1a }, { .d = 0x30, .sp = STACK },
+	  { .a = 0x77, .d = 0x30, .sp = STACK, .pc = 0x1001 },
+	  DATA, 0x0077, 0x0077, 7 },
+	{ "RAR", { 0x1f }, { .a = 0x01, .f = 0x01, .sp = STACK },
+	  { .a = 0x80, .f = 0x01, .sp = STACK, .pc = 0x1001 }, .cycles = 4 },
+	{ "SHLD", { 0x22, 0x00, 0x30 }, { .h = 0x12, .l = 0x34, .sp = STACK },
+	  { .h = 0x12, .l = 0x34, .sp = STACK, .pc = 0x1003 },
+	  DATA, 0x0000, 0x1234, 16 },
+	{ "DAA", { 0x27 }, { .a = 0x9b, .sp = STACK },
+	  { .a = 0x01, .f = 0x11, .sp = STACK, .pc = 0x1001 }, .cycles = 4 },
+	{ "DAD H", { 0x29 }, { .h = 0x80, .l = 0x01, .sp = STACK },
+	  { .f = 0x01, .l = 0x02, .sp = STACK, .pc = 0x1001 }, .cycles = 10 },
+	{ "LHLD", { 0x2a, 0x00, 0x30 }, { .sp = STACK },
+	  { .h = 0x56, .l = 0x78, .sp = STACK, .pc = 0x1003 },
+	  DATA, 0x5678, 0x5678, 16 },
+	{ "CMA", { 0x2f }, { .a = 0x51, .sp = STACK },
+	  { .a = 0xae, .sp = STACK, .pc = 0x1001 }, .cycles = 4 },
+	{ "LXI SP", { 0x31, 0x34, 0x12 }, { .sp = STACK },
+	  { .sp = 0x1234, .pc = 0x1003 }, .cycles = 10 },
+	{ "STA", { 0x32, 0x00, 0x30 }, { .a = 0x99, .sp = STACK },
+	  { .a = 0x99, .sp = STACK, .pc = 0x1003 }, DATA, 0x0000, 0x0099, 13 },
+	{ "INX SP", { 0x33 }, { .sp = STACK },
+	  { .sp = STACK + 1, .pc = 0x1001 }, .cycles = 5 },
+	{ "INR M", { 0x34 }, { .h = 0x30, .sp = STACK },
+	  { .f = 0x54, .h = 0x30, .sp = STACK, .pc = 0x1001 },
+	  DATA, 0x00ff, 0x0000, 10 },
+	{ "DCR M", { 0x35 }, { .h = 0x30, .sp = STACK },
+	  { .f = 0x84, .h = 0x30, .sp = STACK, .pc = 0x1001 },
+	  DATA, 0x0000, 0x00ff, 10 },
+	{ "MVI M", { 0x36, 0xab }, { .h = 0x30, .l = 0x01, .sp = STACK },
+	  { .h = 0x30, .l = 0x01, .sp = STACK, .pc = 0x1002 },
+	  DATA, 0x0000, 0xab00, 10 },
+	{ "STC", { 0x37 }, { .sp = STACK },
+	  { .f = 0x01, .sp = STACK, .pc = 0x1001 }, .cycles = 4 },
+	{ "DAD SP", { 0x39 }, { .h = 0x12, .l = 0x34, .sp = STACK },
+	  { .h = 0x32, .l = 0x34, .sp = STACK, .pc = 0x1001 }, .cycles = 10 },
+	{ "DAD SP carry", { 0x39 }, { .h = 0xf0, .l = 0x80, .sp = STACK + 1 },
+	  { .f = 0x01, .h = 0x10, .l = 0x81, .sp = STACK + 1, .pc = 0x1001 },
+	  .cycles = 10 },
+	{ "LDA", { 0x3a, 0x00, 0x30 }, { .sp = STACK },
+	  { .a = 0x42, .sp = STACK, .pc = 0x1003 }, DATA, 0x0042, 0x0042, 13 },
+	{ "DCX SP", { 0x3b }, { .sp = STACK },
+	  { .sp = STACK - 1, .pc = 0x1001 }, .cycles = 5 },
+	{ "CMC", { 0x3f }, { .f = 0x01, .sp = STACK },
+	  { .sp = STACK, .pc = 0x1001 }, .cycles = 4 },
+	{ "MOV B,C", { 0x41 }, { .c = 0x77, .sp = STACK },
+	  { .b = 0x77, .c = 0x77, .sp = STACK, .pc = 0x1001 }, .cycles = 5 },
+	{ "HLT", { 0x76 }, { .sp = STACK },
+	  { .sp = STACK, .pc = CODE }, .cycles = 7 },
+	{ "MOV M,A", { 0x77 }, { .a = 0x3c, .h = 0x30, .sp = STACK },
+	  { .a = 0x3c, .h = 0x30, .sp = STACK, .pc = 0x1001 },
+	  DATA, 0x0000, 0x003c, 7 },
+	{ "MOV A,M", { 0x7e }, { .h = 0x30, .sp = STACK },
+	  { .a = 0xc3, .h = 0x30, .sp = STACK, .pc = 0x1001 },
+	  DATA, 0x00c3, 0x00c3, 7 },
+	{ "ADD B", { 0x80 }, { .a = 0x0f, .b = 0x01, .sp = STACK },
+	  { .a = 0x10, .f = 0x10, .b = 0x01, .sp = STACK, .pc = 0x1001 },
+	  .cycles = 4 },
+	{ "ADC C", { 0x89 }, { .a = 0xff, .f = 0x01, .sp = STACK },
+	  { .f = 0x55, .sp = STACK, .pc = 0x1001 }, .cycles = 4 },
+	{ "SUB B", { 0x90 }, { .b = 0x01, .sp = STACK },
+	  { .a = 0xff, .f = 0x85, .b = 0x01, .sp = STACK, .pc = 0x1001 },
+	  .cycles = 4 },
+	{ "SBB C", { 0x99 }, { .a = 0x10, .f = 0x01, .c = 0x05, .sp = STACK },
+	  { .a = 0x0a, .f = 0x04, .c = 0x05, .sp = STACK, .pc = 0x1001 },
+	  .cycles = 4 },
+	{ "ANA B", { 0xa0 }, { .a = 0xf3, .f = 0x01, .b = 0x31, .sp = STACK },
+	  { .a = 0x31, .b = 0x31, .sp = STACK, .pc = 0x1001 }, .cycles = 4 },
+	{ "XRA A", { 0xaf }, { .a = 0x5a, .f = 0x01, .sp = STACK },
+	  { .f = 0x44, .sp = STACK, .pc = 0x1001 }, .cycles = 4 },
+	{ "ORA C", { 0xb1 }, { .a = 0x80, .c = 0x01, .sp = STACK },
+	  { .a = 0x81, .f = 0x84, .c = 0x01, .sp = STACK, .pc = 0x1001 },
+	  .cycles = 4 },
+	{ "CMP B equal", { 0xb8 }, { .a = 0x05, .b = 0x05, .sp = STACK },
+	  { .a = 0x05, .f = 0x54, .b = 0x05, .sp = STACK, .pc = 0x1001 },
+	  .cycles = 4 },
+	{ "CMP B below", { 0xb8 }, { .a = 0x02, .b = 0x05, .sp = STACK },
+	  { .a = 0x02, .f = 0x81, .b = 0x05, .sp = STACK, .pc = 0x1001 },
+	  .cycles = 4 },
+	{ "RNZ not taken", { 0xc0 }, { .f = 0x40, .sp = STACK - 2 },
+	  { .f = 0x40, .sp = STACK - 2, .pc = 0x1001 },
+	  STACK - 2, 0x1234, 0x1234 },
+	{ "POP B", { 0xc1 }, { .sp = STACK - 2 },
+	  { .b = 0x56, .c = 0x78, .sp = STACK, .pc = 0x1001 },
+	  STACK - 2, 0x5678, 0x5678, 10 },
+	{ "JNZ taken", { 0xc2, 0x00, 0x20 }, { .sp = STACK },
+	  { .sp = STACK, .pc = 0x2000 } },
+	{ "JNZ not taken", { 0xc2, 0x00, 0x20 }, { .f = 0x40, .sp = STACK },
+	  { .f = 0x40, .sp = STACK, .pc = 0x1003 } },
+	{ "JMP", { 0xc3, 0x34, 0x12 }, { .sp = STACK },
+	  { .sp = STACK, .pc = 0x1234 }, .cycles = 10 },
+	{ "CNZ not taken", { 0xc4, 0x00, 0x20 }, { .f = 0x40, .sp = STACK },
+	  { .f = 0x40, .sp = STACK, .pc = 0x1003 } },
+	{ "PUSH B", { 0xc5 }, { .b = 0x12, .c = 0x34, .sp = STACK },
+	  { .b = 0x12, .c = 0x34, .sp = STACK - 2, .pc = 0x1001 },
+	  STACK - 2, 0x0000, 0x1234, 11 },
+	{ "ADI", { 0xc6, 0xff }, { .a = 0x01, .sp = STACK },
+	  { .f = 0x55, .sp = STACK, .pc = 0x1002 }, .cycles = 7 },
+	{ "RST 0", { 0xc7 }, { .sp = STACK },
+	  { .sp = STACK - 2, .pc = 0x0000 }, STACK - 2, 0x0000, 0x1001, 11 },
+	{ "RZ taken", { 0xc8 }, { .f = 0x40, .sp = STACK - 2 },
+	  { .f = 0x40, .sp = STACK, .pc = 0x1234 },
+	  STACK - 2, 0x1234, 0x1234 },
+	{ "RET", { 0xc9 }, { .sp = STACK - 2 },
+	  { .sp = STACK, .pc = 0x1234 }, STACK - 2, 0x1234, 0x1234, 10 },
+	{ "CALL", { 0xcd, 0x00, 0x20 }, { .sp = STACK },
+	  { .sp = STACK - 2, .pc = 0x2000 }, STACK - 2, 0x0000, 0x1003, 17 },
+	{ "RST 1", { 0xcf }, { .sp = STACK },
+	  { .sp = STACK - 2, .pc = 0x0008 }, STACK - 2, 0x0000, 0x1001, 11 },
+	{ "OUT", { 0xd3, 0x01 }, { .a = 0x12, .sp = STACK },
+	  { .a = 0x12, .sp = STACK, .pc = 0x1002 }, .cycles = 10 },
+	{ "SUI", { 0xd6, 0x01 }, { .sp = STACK },
+	  { .a = 0xff, .f = 0x85, .sp = STACK, .pc = 0x1002 }, .cycles = 7 },
+	{ "RST 2", { 0xd7 }, { .sp = STACK },
+	  { .sp = STACK - 2, .pc = 0x0010 }, STACK - 2, 0x0000, 0x1001, 11 },
+	{ "IN", { 0xdb, 0x01 }, { .sp = STACK },
+	  { .a = 0xff, .sp = STACK, .pc = 0x1002 }, .cycles = 10 },
+	{ "SBI", { 0xde, 0x00 }, { .f = 0x01, .sp = STACK },
+	  { .a = 0xff, .f = 0x85, .sp = STACK, .pc = 0x1002 }, .cycles = 7 },
+	{ "RST 3", { 0xdf }, { .sp = STACK },
+	  { .sp = STACK - 2, .pc = 0x0018 }, STACK - 2, 0x0000, 0x1001, 11 },
+	{ "XTHL", { 0xe3 }, { .h = 0x56, .l = 0x78, .sp = STACK - 2 },
+	  { .h = 0x12, .l = 0x34, .sp = STACK - 2, .pc = 0x1001 },
+	  STACK - 2, 0x1234, 0x5678, 18 },
+	{ "ANI", { 0xe6, 0x30 }, { .a = 0xf0, .f = 0x01, .sp = STACK },
+	  { .a = 0x30, .f = 0x04, .sp = STACK, .pc = 0x1002 }, .cycles = 7 },
+	{ "RST 4", { 0xe7 }, { .sp = STACK },
+	  { .sp = STACK - 2, .pc = 0x0020 }, STACK - 2, 0x0000, 0x1001, 11 },
+	{ "PCHL", { 0xe9 }, { .h = 0x12, .l = 0x34, .sp = STACK },
+	  { .h = 0x12, .l = 0x34, .sp = STACK, .pc = 0x1234 }, .cycles = 5 },
+	/* 4 cycles on an 8080, the timing of the core has 5 */
+	{ "XCHG", { 0xeb }, { .d = 0x12, .e = 0x34, .h = 0x56, .l = 0x78, .sp = STACK },
+	  { .d = 0x56, .e = 0x78, .h = 0x12, .l = 0x34, .sp = STACK, .pc = 0x1001 } },
+	{ "XRI", { 0xee, 0xff }, { .a = 0x0f, .sp = STACK },
+	  { .a = 0xf0, .f = 0x84, .sp = STACK, .pc = 0x1002 }, .cycles = 7 },
+	{ "RST 5", { 0xef }, { .sp = STACK },
+	  { .sp = STACK - 2, .pc = 0x0028 }, STACK - 2, 0x0000, 0x1001, 11 },
+	{ "POP PSW", { 0xf1 }, { .sp = STACK - 2 },
+	  { .a = 0x42, .f = 0xd5, .sp = STACK, .pc = 0x1001 },
+	  STACK - 2, 0x42d5, 0x42d5, 10 },
+	{ "PUSH PSW", { 0xf5 }, { .a = 0x42, .f = 0xd5, .sp = STACK },
+	  { .a = 0x42, .f = 0xd5, .sp = STACK - 2, .pc = 0x1001 },
+	  STACK - 2, 0x0000, 0x42d5, 11 },
+	{ "ORI", { 0xf6, 0x00 }, { .f = 0x01, .sp = STACK },
+	  { .f = 0x44, .sp = STACK, .pc = 0x1002 }, .cycles = 7 },
+	{ "RST 6", { 0xf7 }, { .sp = STACK },
+	  { .sp = STACK - 2, .pc = 0x0030 }, STACK - 2, 0x0000, 0x1001, 11 },
+	{ "SPHL", { 0xf9 }, { .h = 0x12, .l = 0x34, .sp = STACK },
+	  { .h = 0x12, .l = 0x34, .sp = 0x1234, .pc = 0x1001 }, .cycles = 5 },
+	{ "CPI", { 0xfe, 0x05 }, { .a = 0x05, .sp = STACK },
+	  { .a = 0x05, .f = 0x54, .sp = STACK, .pc = 0x1002 }, .cycles = 7 },
+	{ "RST 7", { 0xff }, { .sp = STACK },
+	  { .sp = STACK - 2, .pc = 0x0038 }, STACK - 2, 0x0000, 0x1001, 11 },
+};
+
+static void put_regs (cpu8080_state *state, const struct regs *regs)
+{
+	state->a = regs->a;
+	*(uint8_t *) &state->flags = regs->f;
+	state->b = regs->b;
+	state->c = regs->c;
+	state->d = regs->d;
+	state->e = regs->e;
+	state->h = regs->h;
+	state->l = regs->l;
+	state->sp = regs->sp;
+}
+
+static void get_regs (const cpu8080_state *state, struct regs *regs)
+{
+	regs->a = state->a;
+	regs->f = *(const uint8_t *) &state->flags;
+	regs->b = state->b;
+	regs->c = state->c;
+	regs->d = state->d;
+	regs->e = state->e;
+	regs->h = state->h;
+	regs->l = state->l;
+	regs->sp = state->sp;
+	regs->pc = state->pc;
+}
+
+static void print_regs (const char *what, const struct regs *regs)
+{
+	printf("  %s a %02x f %02x b %02x c %02x d %02x e %02x h %02x l %02x "
+	       "sp %04x pc %04x\n", what, regs->a, regs->f, regs->b, regs->c,
+	       regs->d, regs->e, regs->h, regs->l, regs->sp, regs->pc);
+}
+
+/*
+ * Runs one vector, printing what went wrong. Returns 0 if nothing
+ * did, 1 otherwise.
+ */
+static int run_vector (cpu8080_state *state, const struct vector *vec)
+{
+	struct regs got;
+	uint16_t word;
+
+	memset(state->memory, 0, MEMORY_SIZE);
+	memcpy(state->memory + CODE, vec->code, sizeof(vec->code));
+	state->memory[vec->addr] = vec->before & 0xff;
+	state->memory[(uint16_t) (vec->addr + 1)] = vec->before >> 8;
+	cpu8080_reset(state);
+	put_regs(state, &vec->in);
+	state->pc = CODE;
+
+	/* the budget of a single instruction, whatever the engine */
+	if (run_cycles(state, 1) < 0) {
+		printf("%s: invalid opcode\n", vec->name);
+		return 1;
+	}
+	get_regs(state, &got);
+	word = state->memory[vec->addr] |
+		state->memory[(uint16_t) (vec->addr + 1)] << 8;
+
+	if (0 == memcmp(&got, &vec->out, sizeof(got)) && word == vec->after &&
+	    (0 == vec->cycles || state->cycles == (uint64_t) vec->cycles))
+		return 0;
+	printf("%s:\n", vec->name);
+	print_regs("expected", &vec->out);
+	print_regs("got     ", &got);
+	printf("  expected %04x at %04x in %d cycles, got %04x in %llu\n",
+	       vec->after, vec->addr, vec->cycles, word,
+	       (unsigned long long) state->cycles);
+	return 1;
+}
+
+/*
+ * Budgets of 0 and less, which have to run nothing in every engine.
+ * Returns how many didn't.
+ */
+static int run_no_budget (cpu8080_state *state)
+{
+	static const int budgets[] = { 0, -1, -5 };
+	int failed = 0;
+
+	for (int i = 0; i < 3; i++) {
+		int ret;
+
+		memset(state->memory, 0, MEMORY_SIZE);
+		cpu8080_reset(state);
+		state->pc = CODE;
+		ret = run_cycles(state, budgets[i]);
+		if (0 == ret && CODE == state->pc && 0 == state->cycles)
+			continue;
+		printf("budget %d: returned %d, pc %04x after %llu cycles\n",
+		       budgets[i], ret, state->pc,
+		       (unsigned long long) state->cycles);
+		failed++;
+	}
+	return failed;
+}
+
+int cputest_instructions (void)
+{
+	cpu8080_state state;
+	int count = sizeof(vectors) / sizeof(vectors[0]);
+	int failed = 0;
+
+	if (cpu8080_init(&state) < 0)
+		return -1;
+	printf("%s\n", cpu8080_engine(&state));
+	for (int i = 0; i < count; i++)
+		failed += run_vector(&state, &vectors[i]);
+	printf("%d of %d instructions right\n", count - failed, count);
+	failed += run_no_budget(&state);
+	cpu8080_destroy(&state);
+	return failed;
+}
+
+/*
+ * Counts in B the times it woke from HLT and in C the interrupts,
+ * which return past the HLT: the two have to go up together
+ */
+static const struct {
+	uint16_t addr;
+	uint8_t code[9];
+	int size;
+} halt_program[] = {
+	{ 0x0000, { 0xc3, 0x40, 0x00 }, 3 },		/* JMP 0040 */
+	{ 0x0008, { 0x0c, 0xfb, 0xc9 }, 3 },		/* INR C, EI, RET */
+	{ 0x0010, { 0x0c, 0xfb, 0xc9 }, 3 },
+	{ 0x0040, { 0x31, 0x00, 0x24,			/* LXI SP,2400 */
+		    0xfb, 0x76, 0x04,			/* EI, HLT, INR B */
+		    0xc3, 0x43, 0x00 }, 9 },		/* JMP 0043 */
+};
+
+static int load_halt (cpu8080_state *state)
+{
+	int count = sizeof(halt_program) / sizeof(halt_program[0]);
+
+	if (cpu8080_init(state) < 0)
+		return -1;
+	for (int i = 0; i < count; i++)
+		memcpy(state->memory + halt_program[i].addr,
+		       halt_program[i].code, halt_program[i].size);
+	cpu8080_reset(state);
+	return 0;
+}
+
+int cputest_halt (void)
+{
+	cpu8080_state whole, step;
+	struct regs a, b;
+	long long count = 0;
+	int ret = 0;
+
+	if (load_halt(&whole) < 0)
+		return -1;
+	if (load_halt(&step) < 0) {
+		cpu8080_destroy(&whole);
+		return -1;
+	}
+	for (int frame = 0; frame < HALT_FRAMES && 0 == ret; frame++)
+		if (run_until_frame(&whole) < 0 ||
+		    step_until_frame(&step, &count) < 0)
+			ret = 1;
+
+	get_regs(&whole, &a);
+	get_regs(&step, &b);
+	if (ret || memcmp(&a, &b, sizeof(a)) || a.b != a.c ||
+	    whole.halted != step.halted || whole.cycles != step.cycles) {
+		printf("HLT:\n");
+		print_regs("stepped", &b);
+		print_regs("run    ", &a);
+		printf("  stepped %llu cycles, run %llu\n",
+		       (unsigned long long) step.cycles,
+		       (unsigned long long) whole.cycles);
+		ret = 1;
+	} else {
+		printf("HLT: %d frames the same\n", HALT_FRAMES);
+	}
+	cpu8080_destroy(&whole);
+	cpu8080_destroy(&step);
+	return ret;
+}
+
+/* the instructions a program loops over, and run_cycles calls to it */
+#define BODY_MAX 24
+#define SLICES 40
+#define SLICE_MAX 200
+
+static uint32_t next (uint32_t *seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 16;
+}
+
+/*
+ * Jumps and calls all go back to the top of the loop, returns, RST
+ * and PCHL go wherever the stack and HL say, which is mostly random
+ * bytes; those are kept rare so most programs loop long enough for
+ * the JIT to compile them.
+ */
+static int leaves (uint8_t op)
+{
+	return 0xc0 == (op & 0xc7) || 0xc9 == op || 0xc7 == (op & 0xc7) ||
+		0xe9 == op;
+}
+
+static int branches (uint8_t op)
+{
+	return 0xc2 == (op & 0xc7) || 0xc3 == op ||
+		0xc4 == (op & 0xc7) || 0xcd == op;
+}
+
+/*
+ * Fills the whole of memory with random bytes, then writes a loop of
+ * random instructions over it somewhere, ending in a jump back to its
+ * top, and starts the core there with random registers. A loop near
+ * the top of memory wraps around to 0x0000, as the core does.
+ */
+static void make_program (cpu8080_state *state, uint32_t *seed)
+{
+	uint8_t *mem = state->memory;
+	uint16_t top = 0x0100 + next(seed) % 0xef00;
+	uint16_t pc = top;
+	int body = 1 + next(seed) % BODY_MAX;
+
+	/* opcodes the core doesn't know would end most programs early */
+	for (int i = 0; i < MEMORY_SIZE; i++)
+		do
+			mem[i] = next(seed);
+		while (0 == length8080[mem[i]]);
+	for (int i = 0; i < body; i++) {
+		uint8_t op;
+
+		do
+			op = next(seed);
+		while (0 == length8080[op] || (leaves(op) && next(seed) & 7));
+		mem[pc] = op;
+		if (branches(op)) {
+			mem[(uint16_t) (pc + 1)] = top & 0xff;
+			mem[(uint16_t) (pc + 2)] = top >> 8;
+		} else
+			for (int k = 1; k < length8080[op]; k++)
+				mem[(uint16_t) (pc + k)] = next(seed);
+		pc += length8080[op];
+	}
+	mem[pc] = 0xc3;
+	mem[(uint16_t) (pc + 1)] = top & 0xff;
+	mem[(uint16_t) (pc + 2)] = top >> 8;
+
+	cpu8080_reset(state);
+	state->a = next(seed);
+	state->b = next(seed);
+	state->c = next(seed);
+	state->d = next(seed);
+	state->e = next(seed);
+	state->h = next(seed);
+	state->l = next(seed);
+	state->sp = next(seed);
+	*(uint8_t *) &state->flags = next(seed) & 0xd5;
+	state->int_enable = next(seed) & 1;
+	state->pc = top;
+}
+
+static uint64_t hash_bytes (uint64_t h, const uint8_t *bytes, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		h ^= bytes[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+/*
+ * The registers one by one, the padding of the state would make the
+ * hash depend on more than them.
+ */
+static uint64_t hash_state (const cpu8080_state *state, int slices, int ret)
+{
+	uint8_t regs[] = {
+		state->a, state->b, state->c, state->d, state->e,
+		state->h, state->l, *(const uint8_t *) &state->flags,
+		state->sp & 0xff, state->sp >> 8, state->pc & 0xff,
+		state->pc >> 8, state->int_enable, state->halted,
+		slices, ret < 0,
+	};
+	uint64_t h = 0xcbf29ce484222325ULL;
+
+	h = hash_bytes(h, regs, sizeof(regs));
+	h = hash_bytes(h, (const uint8_t *) &state->cycles,
+		       sizeof(state->cycles));
+	h = hash_bytes(h, (const uint8_t *) &state->illegal_writes,
+		       sizeof(state->illegal_writes));
+	return hash_bytes(h, state->memory, MEMORY_SIZE);
+}
+
+int cputest_programs (uint64_t *hashes)
+{
+	static struct invaders board;
+	cpu8080_state flat;
+
+	if (cpu8080_init(&flat) < 0)
+		return -1;
+	if (invaders_init(&board) < 0) {
+		cpu8080_destroy(&flat);
+		return -1;
+	}
+	printf("%s\n", cpu8080_engine(&flat));
+	for (int i = 0; i < CPUTEST_PROGRAMS; i++) {
+		/*
+		 * every other program on the Invaders board, whose map has
+		 * ROM, mirrors and holes for the loads and stores to hit
+		 */
+		cpu8080_state *state = i & 1 ? &board.cpu : &flat;
+		/* a seed of its own, so a program can be run on its own */
+		uint32_t seed = i * 2654435761u + 1;
+		int slices = 0;
+		int ret = 0;
+
+		board.shift = 0;
+		board.shift_offset = 0;
+		make_program(state, &seed);
+		while (slices < SLICES && ret >= 0) {
+			ret = run_cycles(state, 1 + next(&seed) % SLICE_MAX);
+			slices++;
+		}
+		hashes[i] = hash_state(state, slices, ret);
+	}
+	invaders_destroy(&board);
+	cpu8080_destroy(&flat);
+	return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef CPUTEST_H
+#define CPUTEST_H
+
+#include <stdint.h>
+
+/*
+ * Self tests of the core, for each engine it can be built with.
+ *
+ * No 8080 test ROM ships with the tree, so the instructions are
+ * checked two ways: one at a time against results worked out by hand,
+ * and differentially, with random programs whose end state one engine
+ * records and the others have to reproduce. The programs loop, so the
+ * block cache and the JIT get to run them too, not only decode them,
+ * and half of them run on the memory map of the Invaders board.
+ */
+
+/* frames cputest_halt runs */
+#define HALT_FRAMES 600
+
+/* random programs run by cputest_programs */
+#define CPUTEST_PROGRAMS 3000
+
+/*
+ * Runs each hand checked instruction on a fresh core and prints the
+ * engine and those that went wrong, then checks budgets of 0 and less
+ * run nothing. Returns how many went wrong, or -1 if a core couldn't
+ * be allocated.
+ */
+int cputest_instructions (void);
+
+/*
+ * Runs HALT_FRAMES frames of a program that waits for its interrupts
+ * on HLT twice, whole and one instruction at a time, and prints if
+ * they end differently. Returns 0 if they didn't, 1 if they did, -1
+ * if a core couldn't be allocated.
+ */
+int cputest_halt (void);
+
+/*
+ * Prints the engine and runs CPUTEST_PROGRAMS random programs, always
+ * the same ones, storing a hash of the core after each in hashes: the
+ * registers, flags, cycles, refused stores and all of memory. Engines
+ * that agree store the same hashes. Returns 0 on success, -1 if a core
+ * couldn't be allocated.
+ */
+int cputest_programs (uint64_t *hashes);
+
+#endif
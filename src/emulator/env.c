@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "env.h"
+#include "rom.h"
+
+/* where the game keeps the state of player one */
+#define RAM_GAME_MODE 0x20ef	/* 1 while a game is played */
+#define RAM_SCORE 0x20f8	/* 4 BCD digits, low byte first */
+#define RAM_SHIPS 0x21ff	/* in reserve, besides the one in play */
+
+/* long enough for the attract mode to take a coin and start a game */
+#define BOOT_FRAMES 600
+
+static int bcd (uint8_t val)
+{
+	return (val >> 4) * 10 + (val & 0xf);
+}
+
+static void read_ram (struct env *env)
+{
+	const uint8_t *ram = env->machine.cpu.memory;
+
+	env->score = bcd(ram[RAM_SCORE + 1]) * 100 + bcd(ram[RAM_SCORE]);
+	env->lives = ram[RAM_GAME_MODE] ? ram[RAM_SHIPS] + 1 : 0;
+}
+
+/*
+ * Halves the screen straight from video RAM, a pixel lit if any of the
+ * 2x2 it stands for is. Each column of the screen is 32 bytes, bottom
+ * up, so a pair of them ORed together gives a column of the
+ * observation, two bits a pixel.
+ */
+static void observe (const struct env *env, uint8_t *obs)
+{
+	const uint8_t *vram = env->machine.cpu.memory + VIDEO_START;
+
+	for (int x = 0; x < ENV_OBS_WIDTH; x++) {
+		const uint8_t *left = vram + 64 * x;
+		uint8_t *pixel = obs + (ENV_OBS_HEIGHT - 1) * ENV_OBS_WIDTH + x;
+
+		for (int n = 0; n < 32; n++) {
+			uint8_t bits = left[n] | left[n + 32];
+
+			for (int q = 0; q < 4; q++, bits >>= 2) {
+				*pixel = bits & 3 ? 255 : 0;
+				pixel -= ENV_OBS_WIDTH;
+			}
+		}
+	}
+}
+
+static void set_buttons (struct invaders *machine, uint8_t action)
+{
+	invaders_input(machine, INVADERS_P1_FIRE, action & ENV_FIRE);
+	invaders_input(machine, INVADERS_P1_LEFT, action & ENV_LEFT);
+	invaders_input(machine, INVADERS_P1_RIGHT, action & ENV_RIGHT);
+}
+
+/*
+ * Puts a coin in and starts a one player game, then runs until the
+ * game has handed out the ships, and saves that as the start state.
+ */
+static int boot (struct env_batch *batch)
+{
+	struct invaders *machine = &batch->envs[0].machine;
+	const uint8_t *ram = machine->cpu.memory;
+
+	for (int frame = 0; frame < BOOT_FRAMES; frame++) {
+		invaders_input(machine, INVADERS_COIN, 120 == frame);
+		invaders_input(machine, INVADERS_P1_START, 180 == frame);
+		if (run_until_frame(&machine->cpu) < 0)
+			return -1;
+		if (frame > 180 && 1 == ram[RAM_GAME_MODE] && ram[RAM_SHIPS]) {
+			savestate_save(machine, batch->start, SAVESTATE_SIZE);
+			return 0;
+		}
+	}
+	fprintf(stderr, "The game did not start in %d frames\n", BOOT_FRAMES);
+	return -1;
+}
+
+int env_init (struct env_batch *batch, const struct rom *rom, int count)
+{
+	int initialised = 0;
+
+	batch->count = count;
+	batch->episodes = 0;
+	batch->envs = calloc(count, sizeof(*batch->envs));
+	if (!batch->envs) {
+		fprintf(stderr, "Could not allocate %d environments\n", count);
+		return -1;
+	}
+	for (; initialised < count; initialised++) {
+		struct invaders *machine = &batch->envs[initialised].machine;
+
+		if (invaders_init(machine) < 0)
+			goto error;
+		if (invaders_load(machine, rom) < 0) {
+			invaders_destroy(machine);
+			goto error;
+		}
+	}
+	if (count && boot(batch) < 0)
+		goto error;
+	for (int i = 0; i < count; i++)
+		env_reset(batch, i, NULL);
+	return 0;
+
+error:
+	while (initialised--)
+		invaders_destroy(&batch->envs[initialised].machine);
+	free(batch->envs);
+	return -1;
+}
+
+void env_destroy (struct env_batch *batch)
+{
+	for (int i = 0; i < batch->count; i++)
+		invaders_destroy(&batch->envs[i].machine);
+	free(batch->envs);
+}
+
+void env_reset (struct env_batch *batch, int i, uint8_t *obs)
+{
+	struct env *env = &batch->envs[i];
+
+	savestate_restore(&env->machine, batch->start, SAVESTATE_SIZE);
+	env->frames = 0;
+	read_ram(env);
+	if (obs)
+		observe(env, obs);
+}
+
+int env_step_batch (struct env_batch *batch, const uint8_t *actions,
+		    uint8_t *obs, int32_t *reward, uint8_t *done)
+{
+	for (int i = 0; i < batch->count; i++) {
+		struct env *env = &batch->envs[i];
+		uint8_t *env_obs = obs ? obs + (size_t) i * ENV_OBS_SIZE : NULL;
+		uint16_t score = env->score;
+
+		set_buttons(&env->machine, actions[i]);
+		if (run_until_frame(&env->machine.cpu) < 0)
+			return -1;
+		env->frames++;
+		read_ram(env);
+		reward[i] = env->score - score;
+		done[i] = !env->lives;
+		if (done[i]) {
+			batch->episodes++;
+			env_reset(batch, i, env_obs);
+		} else if (env_obs) {
+			observe(env, env_obs);
+		}
+	}
+	return 0;
+}
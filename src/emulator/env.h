@@ -0,0 +1,77 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include <stdint.h>
+
+#include "framebuffer.h"
+#include "invaders.h"
+#include "savestate.h"
+
+struct rom;
+
+/*
+ * Space Invaders as a batch of environments for reinforcement
+ * learning, stepped all together one frame at a time. Every episode is
+ * a one player game from the frame it starts, and a new one starts by
+ * itself when the last ship is lost.
+ *
+ * A batch runs on the thread that steps it. To use more CPUs, give
+ * each thread a batch of its own and a slice of the same arrays.
+ */
+
+/* observations: the screen halved both ways, one byte per pixel */
+#define ENV_OBS_WIDTH (FRAMEBUFFER_WIDTH / 2)
+#define ENV_OBS_HEIGHT (FRAMEBUFFER_HEIGHT / 2)
+#define ENV_OBS_SIZE (ENV_OBS_WIDTH * ENV_OBS_HEIGHT)
+
+/* actions: the buttons held down for a frame, any of them together */
+enum env_action {
+	ENV_FIRE = 1,
+	ENV_LEFT = 2,
+	ENV_RIGHT = 4
+};
+
+struct env {
+	struct invaders machine;
+	uint16_t score;		/* of player one, from the game's RAM */
+	uint8_t lives;		/* ships left, the one in play included */
+	long frames;		/* into the episode */
+};
+
+struct env_batch {
+	struct env *envs;
+	int count;
+	long episodes;		/* ended so far, over all environments */
+	/* the first frame of every episode */
+	uint8_t start[SAVESTATE_SIZE];
+};
+
+/*
+ * Allocates count environments running the game ROM and plays one
+ * machine through the attract mode up to a started game, which every
+ * episode then begins from. Returns 0 on success, -1 on failure.
+ */
+int env_init (struct env_batch *batch, const struct rom *rom, int count);
+
+void env_destroy (struct env_batch *batch);
+
+/*
+ * Starts a new episode in environment i and writes its observation to
+ * obs (ENV_OBS_SIZE bytes) unless it is NULL.
+ */
+void env_reset (struct env_batch *batch, int i, uint8_t *obs);
+
+/*
+ * Runs every environment for one frame with the buttons in actions
+ * (one per environment) held down, and writes, environment after
+ * environment, its observation to obs (ENV_OBS_SIZE bytes each, all
+ * in one block; NULL to skip them), the points scored during the frame
+ * to reward and whether the game ended to done. An environment that
+ * is done has already started its next episode, its observation is
+ * the first of that one. Nothing is allocated.
+ * Returns 0 on success, -1 if a machine hit an invalid opcode.
+ */
+int env_step_batch (struct env_batch *batch, const uint8_t *actions,
+		    uint8_t *obs, int32_t *reward, uint8_t *done);
+
+#endif
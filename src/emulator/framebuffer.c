@@ -0,0 +1,287 @@
+#include <stdint.h>
+
+#include "framebuffer.h"
+
+/*
+ * The conversion is vectorised with SSE2 on x86, plus AVX2 when the
+ * host has it. FRAMEBUFFER_SCALAR and FRAMEBUFFER_NO_AVX2 turn them
+ * off, to benchmark against.
+ */
+#if defined(__GNUC__) && defined(__SSE2__) && !defined(FRAMEBUFFER_SCALAR)
+#define HAVE_SSE2
+#include <emmintrin.h>
+#ifndef FRAMEBUFFER_NO_AVX2
+#define HAVE_AVX2
+#include <immintrin.h>
+#endif
+#endif
+
+/*
+ * Each column of the screen is 32 bytes of video RAM, the lowest
+ * pixel in bit 0 of its first byte. Byte n of every column makes up
+ * a band of 8 rows, the unit video_dirty tracks.
+ */
+#define COLUMN_BYTES 32
+#define BAND_ROWS 8
+
+/*
+ * Turns one row into pixels: bytes has the band's byte of every
+ * column, bit picks the row out of it.
+ */
+typedef void (*rgba_kernel) (const uint8_t *bytes, uint8_t bit,
+			     uint32_t *row, uint32_t on, uint32_t off);
+typedef void (*gray_kernel) (const uint8_t *bytes, uint8_t bit,
+			     uint8_t *row, uint8_t on, uint8_t off);
+
+/* only built when there is nothing faster, see pick_rgba */
+#ifndef HAVE_SSE2
+static void rgba_scalar (const uint8_t *bytes, uint8_t bit,
+			 uint32_t *row, uint32_t on, uint32_t off)
+{
+	for (int x = 0; x < FRAMEBUFFER_WIDTH; x++)
+		row[x] = bytes[x] & bit ? on : off;
+}
+
+static void gray_scalar (const uint8_t *bytes, uint8_t bit,
+			 uint8_t *row, uint8_t on, uint8_t off)
+{
+	for (int x = 0; x < FRAMEBUFFER_WIDTH; x++)
+		row[x] = bytes[x] & bit ? on : off;
+}
+#endif
+
+#ifdef HAVE_SSE2
+/* on where mask is all ones, off where it is all zeroes */
+static inline __m128i select_sse2 (__m128i mask, __m128i on, __m128i off)
+{
+	return _mm_or_si128(_mm_and_si128(mask, on), _mm_andnot_si128(mask, off));
+}
+
+/*
+ * 16 pixels at a time: a compare gives a byte mask per pixel, which
+ * unpacking with itself widens to 32 bits
+ */
+static void rgba_sse2 (const uint8_t *bytes, uint8_t bit,
+		       uint32_t *row, uint32_t on, uint32_t off)
+{
+	__m128i bits = _mm_set1_epi8(bit);
+	__m128i lit = _mm_set1_epi32(on);
+	__m128i dark = _mm_set1_epi32(off);
+
+	for (int x = 0; x < FRAMEBUFFER_WIDTH; x += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (bytes + x));
+		__m128i mask = _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits);
+		__m128i lo = _mm_unpacklo_epi8(mask, mask);
+		__m128i hi = _mm_unpackhi_epi8(mask, mask);
+		__m128i *out = (__m128i *) (row + x);
+
+		_mm_storeu_si128(out, select_sse2(_mm_unpacklo_epi16(lo, lo), lit, dark));
+		_mm_storeu_si128(out + 1, select_sse2(_mm_unpackhi_epi16(lo, lo), lit, dark));
+		_mm_storeu_si128(out + 2, select_sse2(_mm_unpacklo_epi16(hi, hi), lit, dark));
+		_mm_storeu_si128(out + 3, select_sse2(_mm_unpackhi_epi16(hi, hi), lit, dark));
+	}
+}
+
+static void gray_sse2 (const uint8_t *bytes, uint8_t bit,
+		       uint8_t *row, uint8_t on, uint8_t off)
+{
+	__m128i bits = _mm_set1_epi8(bit);
+	__m128i lit = _mm_set1_epi8(on);
+	__m128i dark = _mm_set1_epi8(off);
+
+	for (int x = 0; x < FRAMEBUFFER_WIDTH; x += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (bytes + x));
+		__m128i mask = _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits);
+
+		_mm_storeu_si128((__m128i *) (row + x), select_sse2(mask, lit, dark));
+	}
+}
+#endif
+
+#ifdef HAVE_AVX2
+/* 16 pixels at a time, sign extending the byte masks to 32 bits */
+__attribute__((target("avx2")))
+static void rgba_avx2 (const uint8_t *bytes, uint8_t bit,
+		       uint32_t *row, uint32_t on, uint32_t off)
+{
+	__m128i bits = _mm_set1_epi8(bit);
+	__m256i lit = _mm256_set1_epi32(on);
+	__m256i dark = _mm256_set1_epi32(off);
+
+	for (int x = 0; x < FRAMEBUFFER_WIDTH; x += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *) (bytes + x));
+		__m128i mask = _mm_cmpeq_epi8(_mm_and_si128(v, bits), bits);
+		__m256i lo = _mm256_cvtepi8_epi32(mask);
+		__m256i hi = _mm256_cvtepi8_epi32(_mm_srli_si128(mask, 8));
+		__m256i *out = (__m256i *) (row + x);
+
+		_mm256_storeu_si256(out, _mm256_blendv_epi8(dark, lit, lo));
+		_mm256_storeu_si256(out + 1, _mm256_blendv_epi8(dark, lit, hi));
+	}
+}
+
+/* 32 pixels at a time, the row is exactly 7 of those */
+__attribute__((target("avx2")))
+static void gray_avx2 (const uint8_t *bytes, uint8_t bit,
+		       uint8_t *row, uint8_t on, uint8_t off)
+{
+	__m256i bits = _mm256_set1_epi8(bit);
+	__m256i lit = _mm256_set1_epi8(on);
+	__m256i dark = _mm256_set1_epi8(off);
+
+	for (int x = 0; x < FRAMEBUFFER_WIDTH; x += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *) (bytes + x));
+		__m256i mask = _mm256_cmpeq_epi8(_mm256_and_si256(v, bits), bits);
+
+		_mm256_storeu_si256((__m256i *) (row + x),
+				    _mm256_blendv_epi8(dark, lit, mask));
+	}
+}
+#endif
+
+const char *framebuffer_kernel (void)
+{
+#ifdef HAVE_AVX2
+	if (__builtin_cpu_supports("avx2"))
+		return "avx2";
+#endif
+#ifdef HAVE_SSE2
+	return "sse2";
+#else
+	return "scalar";
+#endif
+}
+
+static rgba_kernel pick_rgba (void)
+{
+#ifdef HAVE_AVX2
+	if (__builtin_cpu_supports("avx2"))
+		return rgba_avx2;
+#endif
+#ifdef HAVE_SSE2
+	return rgba_sse2;
+#else
+	return rgba_scalar;
+#endif
+}
+
+static gray_kernel pick_gray (void)
+{
+#ifdef HAVE_AVX2
+	if (__builtin_cpu_supports("avx2"))
+		return gray_avx2;
+#endif
+#ifdef HAVE_SSE2
+	return gray_sse2;
+#else
+	return gray_scalar;
+#endif
+}
+
+/*
+ * Collects byte n of every column into bands[n], so that the rows of
+ * a band are the bits of consecutive bytes. Only the dirty bands are
+ * needed.
+ */
+#ifndef HAVE_SSE2
+static void gather_scalar (const uint8_t *video, uint32_t dirty,
+			   uint8_t bands[][FRAMEBUFFER_WIDTH])
+{
+	for (int band = 0; band < COLUMN_BYTES; band++) {
+		if (!(dirty & (1u << band)))
+			continue;
+		for (int x = 0; x < FRAMEBUFFER_WIDTH; x++)
+			bands[band][x] = video[x * COLUMN_BYTES + band];
+	}
+}
+#else
+/*
+ * The same as a transpose of 16x16 byte blocks: four rounds of
+ * interleaving pairs of registers transpose a block whose rows go in
+ * bit reversed order, and leave its columns in bit reversed order.
+ */
+static void gather_sse2 (const uint8_t *video, uint32_t dirty,
+			 uint8_t bands[][FRAMEBUFFER_WIDTH])
+{
+	static const uint8_t reversed[16] = {
+		0, 8, 4, 12, 2, 10, 6, 14, 1, 9, 5, 13, 3, 11, 7, 15
+	};
+
+	for (int half = 0; half < COLUMN_BYTES; half += 16) {
+		if (!((dirty >> half) & 0xffff))
+			continue;
+		for (int x = 0; x < FRAMEBUFFER_WIDTH; x += 16) {
+			__m128i r[16], t[16];
+
+			for (int i = 0; i < 16; i++)
+				r[i] = _mm_loadu_si128((const __m128i *)
+					(video + (x + reversed[i]) * COLUMN_BYTES + half));
+			for (int round = 0; round < 4; round++) {
+				for (int i = 0; i < 8; i++) {
+					t[i] = _mm_unpacklo_epi8(r[2 * i], r[2 * i + 1]);
+					t[i + 8] = _mm_unpackhi_epi8(r[2 * i], r[2 * i + 1]);
+				}
+				for (int i = 0; i < 16; i++)
+					r[i] = t[i];
+			}
+			for (int i = 0; i < 16; i++)
+				_mm_storeu_si128((__m128i *) (bands[half + reversed[i]] + x), r[i]);
+		}
+	}
+}
+#endif
+
+static void gather (const uint8_t *video, uint32_t dirty,
+		    uint8_t bands[][FRAMEBUFFER_WIDTH])
+{
+#ifdef HAVE_SSE2
+	gather_sse2(video, dirty, bands);
+#else
+	gather_scalar(video, dirty, bands);
+#endif
+}
+
+/* screen row of bit of band, the lowest pixel being the last row */
+#define ROW(band, bit) (FRAMEBUFFER_HEIGHT - 1 - (band) * BAND_ROWS - (bit))
+
+int framebuffer_rgba (cpu8080_state *state, uint32_t *pixels,
+		      uint32_t on, uint32_t off)
+{
+	rgba_kernel kernel = pick_rgba();
+	uint32_t dirty = state->video_dirty;
+	uint8_t bands[COLUMN_BYTES][FRAMEBUFFER_WIDTH];
+	int rows = 0;
+
+	state->video_dirty = 0;
+	gather(state->memory + VIDEO_START, dirty, bands);
+	for (int band = 0; band < COLUMN_BYTES; band++) {
+		if (!(dirty & (1u << band)))
+			continue;
+		for (int bit = 0; bit < BAND_ROWS; bit++)
+			kernel(bands[band], 1 << bit,
+			       pixels + ROW(band, bit) * FRAMEBUFFER_WIDTH, on, off);
+		rows += BAND_ROWS;
+	}
+	return rows;
+}
+
+int framebuffer_gray (cpu8080_state *state, uint8_t *pixels,
+		      uint8_t on, uint8_t off)
+{
+	gray_kernel kernel = pick_gray();
+	uint32_t dirty = state->video_dirty;
+	uint8_t bands[COLUMN_BYTES][FRAMEBUFFER_WIDTH];
+	int rows = 0;
+
+	state->video_dirty = 0;
+	gather(state->memory + VIDEO_START, dirty, bands);
+	for (int band = 0; band < COLUMN_BYTES; band++) {
+		if (!(dirty & (1u << band)))
+			continue;
+		for (int bit = 0; bit < BAND_ROWS; bit++)
+			kernel(bands[band], 1 << bit,
+			       pixels + ROW(band, bit) * FRAMEBUFFER_WIDTH, on, off);
+		rows += BAND_ROWS;
+	}
+	return rows;
+}
@@ -0,0 +1,40 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include <stdint.h>
+
+#include "8080.h"
+
+/*
+ * The Space Invaders monitor is mounted on its side: the video RAM
+ * holds 224 columns of 256 pixels, bottom to top, which these turn
+ * into an upright 224x256 image, row by row from the top left.
+ */
+#define FRAMEBUFFER_WIDTH 224
+#define FRAMEBUFFER_HEIGHT 256
+
+/*
+ * Converts the bands of the screen written to since the last call
+ * (state->video_dirty) into pixels, 32 bits each: on for a lit pixel,
+ * off for a dark one, in the byte order the caller wants.
+ * The rest of pixels is left alone, so the same buffer has to be
+ * passed every time; after a reset or with a new buffer, set
+ * video_dirty to 0xffffffff to convert everything.
+ * Clears video_dirty and returns how many rows it converted.
+ */
+int framebuffer_rgba (cpu8080_state *state, uint32_t *pixels,
+		      uint32_t on, uint32_t off);
+
+/*
+ * Same as framebuffer_rgba, with a byte per pixel
+ */
+int framebuffer_gray (cpu8080_state *state, uint8_t *pixels,
+		      uint8_t on, uint8_t off);
+
+/*
+ * Names the instruction set the conversion runs with on this host:
+ * "avx2", "sse2" or "scalar".
+ */
+const char *framebuffer_kernel (void);
+
+#endif
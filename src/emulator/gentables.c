@@ -0,0 +1,76 @@
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Generates flags8080.h: lookup tables that give the flag byte
+ * (same bit layout as FLAGS) for an 8 bit result, so the core
+ * never has to count bits at run time.
+ */
+
+#define FLAG_CY 0x01
+#define FLAG_P  0x04
+#define FLAG_AC 0x10
+#define FLAG_Z  0x40
+#define FLAG_S  0x80
+
+/*
+ * The n.o. 1 bits is counted and if the total is odd the bit is set to 0
+ * otherwise, it is set to 1.
+ */
+static int parity (int x)
+{
+	int p = 0;
+	for (int i = 0; i < 8; i++) {
+		if (x & 0x1) p++;
+		x = x >> 1;
+	}
+	return (0 == (p & 0x1));
+}
+
+static uint8_t zsp (int val)
+{
+	return (val == 0 ? FLAG_Z : 0) |
+		(val & 0x80 ? FLAG_S : 0) |
+		(parity(val) ? FLAG_P : 0);
+}
+
+static void table (const char *name, const char *comment, uint8_t (*f) (int))
+{
+	printf("/* %s */\n", comment);
+	printf("static const uint8_t %s[256] = {\n", name);
+	for (int i = 0; i < 256; i++)
+		printf("%s0x%02x,%s", (i % 16) ? " " : "\t", f(i),
+		       (i % 16 == 15) ? "\n" : "");
+	printf("};\n\n");
+}
+
+static uint8_t zsp_entry (int val)
+{
+	return zsp(val);
+}
+
+/* INR carries out of the low nibble when the result ends in 0 */
+static uint8_t inr_entry (int val)
+{
+	return zsp(val) | ((val & 0xf) == 0 ? FLAG_AC : 0);
+}
+
+/* DCR is done as an add of 0xff, the low nibble carries unless it ends in f */
+static uint8_t dcr_entry (int val)
+{
+	return zsp(val) | ((val & 0xf) != 0xf ? FLAG_AC : 0);
+}
+
+int main (void)
+{
+	printf("/* generated by gentables.c, do not edit */\n\n");
+	printf("#define FLAG_CY 0x%02x\n", FLAG_CY);
+	printf("#define FLAG_P  0x%02x\n", FLAG_P);
+	printf("#define FLAG_AC 0x%02x\n", FLAG_AC);
+	printf("#define FLAG_Z  0x%02x\n", FLAG_Z);
+	printf("#define FLAG_S  0x%02x\n\n", FLAG_S);
+	table("zsp_table", "Z, S and P of a result", zsp_entry);
+	table("inr_table", "Z, S, P and AC after INR, indexed by the result", inr_entry);
+	table("dcr_table", "Z, S, P and AC after DCR, indexed by the result", dcr_entry);
+	return 0;
+}
@@ -0,0 +1,190 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "invaders.h"
+#include "rom.h"
+
+/*
+ * Input ports at power on: bits 1-3 of port 0 and bit 3 of port 1
+ * are wired high, the DIP switches of port 2 are all off (3 ships,
+ * extra ship at 1500 points, coin info shown).
+ */
+#define PORT0_IDLE 0x0e
+#define PORT1_IDLE 0x08
+#define PORT2_IDLE 0x00
+
+/*
+ * The board only decodes 15 address lines, so 0x8000 up repeats the
+ * first 32K: the ROM, the RAM, nothing, and the RAM again.
+ */
+#define ADDRESS_MASK 0x7fff
+#define RAM_START ROM_SIZE
+#define RAM_END 0x4000
+#define RAM_MIRROR 0x6000
+
+/* port and bit of each button, pressed is 1 */
+static const struct {
+	uint8_t port;
+	uint8_t bit;
+} input_wiring[INVADERS_INPUTS] = {
+	[INVADERS_COIN] = { 1, 0 },
+	[INVADERS_P2_START] = { 1, 1 },
+	[INVADERS_P1_START] = { 1, 2 },
+	[INVADERS_P1_FIRE] = { 1, 4 },
+	[INVADERS_P1_LEFT] = { 1, 5 },
+	[INVADERS_P1_RIGHT] = { 1, 6 },
+	[INVADERS_TILT] = { 2, 2 },
+	[INVADERS_P2_FIRE] = { 2, 4 },
+	[INVADERS_P2_LEFT] = { 2, 5 },
+	[INVADERS_P2_RIGHT] = { 2, 6 },
+};
+
+/* IN 0, 1, 2 */
+static uint8_t read_inputs (void *io, uint8_t port)
+{
+	struct invaders *machine = io;
+
+	return machine->inputs[port];
+}
+
+/* IN 3 */
+static uint8_t read_shift (void *io, uint8_t port)
+{
+	struct invaders *machine = io;
+
+	return machine->shift >> (8 - machine->shift_offset);
+}
+
+/* OUT 2 */
+static void write_shift_offset (void *io, uint8_t port, uint8_t val)
+{
+	struct invaders *machine = io;
+
+	machine->shift_offset = val & 7;
+}
+
+/* OUT 4 */
+static void write_shift (void *io, uint8_t port, uint8_t val)
+{
+	struct invaders *machine = io;
+
+	machine->shift = (val << 8) | (machine->shift >> 8);
+}
+
+/*
+ * OUT 3 and 5: every bit that goes from 0 to 1 starts a sound
+ */
+static void write_sound (struct invaders *machine, int bank, uint8_t val)
+{
+	uint8_t started = val & ~machine->sound[bank];
+
+	machine->sounds_started |= started << (8 * bank);
+	machine->sound[bank] = val;
+}
+
+static void write_sound1 (void *io, uint8_t port, uint8_t val)
+{
+	write_sound(io, 0, val);
+}
+
+static void write_sound2 (void *io, uint8_t port, uint8_t val)
+{
+	write_sound(io, 1, val);
+}
+
+/* what the unpopulated 0x4000-0x5fff reads */
+static uint8_t read_nothing (void *io, uint16_t addr)
+{
+	return 0xff;
+}
+
+static void map_memory (memory_map *map)
+{
+	for (int page = 0; page < 256; page++) {
+		mem_page *p = &map->pages[page];
+		int base = page << 8;
+		int addr = base & ADDRESS_MASK;
+
+		p->read_fn = NULL;
+		p->write_fn = NULL;
+		if (addr < RAM_START) {
+			/* stores to ROM are dropped */
+			p->read = addr - base;
+			p->write = NO_MEMORY;
+		} else if (addr < RAM_END) {
+			p->read = p->write = addr - base;
+		} else if (addr < RAM_MIRROR) {
+			p->read = p->write = NO_MEMORY;
+			p->read_fn = read_nothing;
+		} else {
+			p->read = p->write = addr - (RAM_MIRROR - RAM_START) - base;
+		}
+	}
+}
+
+int invaders_init (struct invaders *machine)
+{
+	memset(machine, 0, sizeof(struct invaders));
+	if (cpu8080_init(&machine->cpu) < 0)
+		return -1;
+
+	port_map_init(&machine->ports);
+	machine->ports.in[0] = read_inputs;
+	machine->ports.in[1] = read_inputs;
+	machine->ports.in[2] = read_inputs;
+	machine->ports.in[3] = read_shift;
+	machine->ports.out[2] = write_shift_offset;
+	machine->ports.out[3] = write_sound1;
+	machine->ports.out[4] = write_shift;
+	machine->ports.out[5] = write_sound2;
+	/* port 6 is the watchdog, which never bites here */
+
+	map_memory(&machine->map);
+	machine->cpu.map = &machine->map;
+	machine->cpu.ports = &machine->ports;
+	machine->cpu.io = machine;
+	machine->inputs[0] = PORT0_IDLE;
+	machine->inputs[1] = PORT1_IDLE;
+	machine->inputs[2] = PORT2_IDLE;
+	return 0;
+}
+
+int invaders_load (struct invaders *machine, const struct rom *rom)
+{
+	if (rom_map(rom, &machine->cpu) < 0)
+		return -1;
+	/* power on: the RAM is cleared, the rest of memory never written */
+	memset(machine->cpu.memory + ROM_SIZE, 0, VIDEO_END - ROM_SIZE);
+
+	cpu8080_reset(&machine->cpu);
+	machine->shift = 0;
+	machine->shift_offset = 0;
+	machine->sound[0] = machine->sound[1] = 0;
+	machine->sounds_started = 0;
+	return 0;
+}
+
+void invaders_destroy (struct invaders *machine)
+{
+	cpu8080_destroy(&machine->cpu);
+}
+
+void invaders_input (struct invaders *machine, enum invaders_input input,
+		     int down)
+{
+	uint8_t port = input_wiring[input].port;
+	uint8_t mask = 1 << input_wiring[input].bit;
+
+	if (down)
+		machine->inputs[port] |= mask;
+	else
+		machine->inputs[port] &= ~mask;
+}
+
+uint16_t invaders_sounds (struct invaders *machine)
+{
+	uint16_t started = machine->sounds_started;
+
+	machine->sounds_started = 0;
+	return started;
+}
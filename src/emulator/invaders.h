@@ -0,0 +1,102 @@
+#ifndef INVADERS_H
+#define INVADERS_H
+
+#include <stdint.h>
+
+#include "8080.h"
+
+struct rom;
+
+/*
+ * Buttons and switches of the cabinet, each one bit of input ports
+ * 0 to 2.
+ */
+enum invaders_input {
+	INVADERS_COIN,
+	INVADERS_P1_START,
+	INVADERS_P2_START,
+	INVADERS_P1_FIRE,
+	INVADERS_P1_LEFT,
+	INVADERS_P1_RIGHT,
+	INVADERS_P2_FIRE,
+	INVADERS_P2_LEFT,
+	INVADERS_P2_RIGHT,
+	INVADERS_TILT,
+	INVADERS_INPUTS
+};
+
+/*
+ * Sounds the game switches on through ports 3 and 5: bit n of
+ * port 3 is sound n, bit n of port 5 is sound 8 + n.
+ */
+enum invaders_sound {
+	INVADERS_SOUND_UFO = 0,		/* loops while the bit is set */
+	INVADERS_SOUND_SHOT = 1,
+	INVADERS_SOUND_PLAYER_DIE = 2,
+	INVADERS_SOUND_INVADER_DIE = 3,
+	INVADERS_SOUND_EXTRA_LIFE = 4,
+	INVADERS_SOUND_FLEET1 = 8,	/* the four steps of the march */
+	INVADERS_SOUND_FLEET2 = 9,
+	INVADERS_SOUND_FLEET3 = 10,
+	INVADERS_SOUND_FLEET4 = 11,
+	INVADERS_SOUND_UFO_HIT = 12
+};
+
+/*
+ * The Space Invaders board: the 8080, its I/O ports and the
+ * dedicated shift register the game draws its sprites with.
+ */
+struct invaders {
+	cpu8080_state cpu;
+	memory_map map;
+	port_map ports;
+
+	/* what IN 0, 1 and 2 read: buttons plus the DIP switches */
+	uint8_t inputs[3];
+
+	/*
+	 * The shift register: OUT 4 shifts a byte in from the top,
+	 * OUT 2 picks which 8 of the 16 bits IN 3 reads.
+	 */
+	uint16_t shift;
+	uint8_t shift_offset;
+
+	/* last values written to the sound ports 3 and 5 */
+	uint8_t sound[2];
+	/* sounds switched on since invaders_sounds was last called */
+	uint16_t sounds_started;
+};
+
+/*
+ * Sets up the CPU with the board's memory map and its ports wired to
+ * the machine.
+ * The machine must not move in memory afterwards, the CPU keeps a
+ * pointer to it. Returns 0 on success, -1 on failure.
+ */
+int invaders_init (struct invaders *machine);
+
+/*
+ * Maps the game ROM (see rom_load) into the machine and powers it on:
+ * RAM cleared and the board reset. Returns 0 on success, -1 on
+ * failure.
+ */
+int invaders_load (struct invaders *machine, const struct rom *rom);
+
+/*
+ * Frees what invaders_init allocated.
+ */
+void invaders_destroy (struct invaders *machine);
+
+/*
+ * Presses (down set) or releases a button.
+ */
+void invaders_input (struct invaders *machine, enum invaders_input input,
+		     int down);
+
+/*
+ * Returns the sounds started since the last call as a mask of
+ * 1 << invaders_sound, and forgets them.
+ */
+uint16_t invaders_sounds (struct invaders *machine);
+
+#endif
@@ -0,0 +1,1041 @@
+#define _DEFAULT_SOURCE
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "jit.h"
+
+#if !defined(__x86_64__)
+#error "the JIT only knows how to generate x86-64 code"
+#endif
+
+/* executable memory of one core */
+#define JIT_BUFFER_SIZE 0x40000
+/* longest run of ops compiled into one block */
+#define JIT_MAX_OPS 64
+/* more than the longest code a single op turns into (a CNZ) */
+#define JIT_MAX_OP 192
+/* most side exits of a single op, one per byte pushed */
+#define JIT_MAX_EXITS 2
+/* more than the prologue, an exit, or the alignment of a block */
+#define JIT_FRAME 192
+/* compiled blocks by start address, direct mapped */
+#define JIT_MAP_SIZE 2048
+
+/*
+ * A compiled block: fn enters it from C, body is where other compiled
+ * blocks jump to, with everything already in host registers.
+ * The generated lookup relies on entries being 32 bytes.
+ */
+struct jit_entry {
+	uint32_t pc;		/* NO_PC when empty */
+	uint16_t len;		/* bytes of guest code */
+	uint16_t unused;
+	uint8_t *body;
+	jit_fn fn;
+	uint64_t pad;
+};
+
+#define NO_PC 0xffffffff
+
+struct jit {
+	uint8_t *buffer;
+	size_t used;
+	const uint8_t *direct;	/* DIRECT_READ and DIRECT_WRITE of each page */
+	struct jit_entry map[JIT_MAP_SIZE];
+};
+
+/*
+ * Host registers of the guest ones, in every compiled block.
+ * A is bl and the flags are bh, so the flags can go to and from ah
+ * (lahf / sahf) without a REX prefix. B..L are r8b..r13b, SP is r14w,
+ * rdi keeps pointing at the state and rsi at its memory.
+ * r15d is what is left of the cycle budget and ebp the whole budget.
+ * eax, ecx and edx are scratch.
+ * The x86 flags sit in the same bits as the 8080 ones (S Z - AC - P - CY),
+ * so most flag updates are a lahf plus some fixing up.
+ */
+#define HOST_AL 0
+#define HOST_A 3
+#define HOST_FLAGS 7	/* bh, only ever used without a REX prefix */
+#define HOST_SP 14
+/* indexed by the register field of the opcodes: B C D E H L M A */
+static const int host_reg[8] = { 8, 9, 10, 11, 12, 13, -1, HOST_A };
+
+/* the flags an arithmetic op sets, lahf also sets bit 1 */
+#define FLAGS_MASK 0xd5
+/* logic ops only keep S, Z and P: CY and AC are cleared */
+#define LOGIC_MASK 0xc4
+/* x86 has the borrow in AF after a subtraction, the 8080 the carry */
+#define AC_BIT 0x10
+#define CY_BIT 0x01
+
+/*
+ * 8080 ALU group (ADD ADC SUB SBB ANA XRA ORA CMP) to the x86 opcode
+ * of the "op r/m8, r8" form
+ */
+static const uint8_t alu_op[8] = { 0x00, 0x10, 0x28, 0x18, 0x20, 0x30, 0x08, 0x38 };
+
+/*
+ * A store that cannot go straight to memory leaves the compiled code
+ * before its op, for the interpreter to do it through write_mem.
+ */
+struct side_exit {
+	size_t at;		/* end of the rel32 to patch, from the first op */
+	uint16_t pc;		/* address of the store */
+	int done;		/* cycles of the ops before it */
+};
+
+struct emitter {
+	uint8_t *code;
+	uint8_t *ops;		/* where the code of the first op starts */
+	const uint8_t *direct;
+	uint16_t pc;		/* address of the op being compiled */
+	int done;		/* cycles of the ops before it */
+	int ends;		/* the block jumped, the new pc is in eax */
+	struct side_exit exits[JIT_MAX_OPS * JIT_MAX_EXITS];
+	int n_exits;
+};
+
+static void emit (struct emitter *e, uint8_t byte)
+{
+	*e->code++ = byte;
+}
+
+static void emit16 (struct emitter *e, uint16_t word)
+{
+	emit(e, word & 0xff);
+	emit(e, word >> 8);
+}
+
+static void emit32 (struct emitter *e, uint32_t word)
+{
+	emit16(e, word & 0xffff);
+	emit16(e, word >> 16);
+}
+
+static void emit64 (struct emitter *e, uint64_t word)
+{
+	emit32(e, word & 0xffffffff);
+	emit32(e, word >> 32);
+}
+
+/*
+ * points the rel32 that ends at end to target
+ */
+static void patch (uint8_t *end, uint8_t *target)
+{
+	int32_t rel = target - end;
+
+	memcpy(end - 4, &rel, 4);
+}
+
+/*
+ * REX prefix, only when one of the registers is r8 or above
+ */
+static void rex (struct emitter *e, int reg, int rm)
+{
+	if (reg >= 8 || rm >= 8)
+		emit(e, 0x40 | ((reg >= 8) << 2) | (rm >= 8));
+}
+
+static void modrm_rr (struct emitter *e, int reg, int rm)
+{
+	emit(e, 0xc0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void alu_rr (struct emitter *e, uint8_t op, int dst, int src)
+{
+	rex(e, src, dst);
+	emit(e, op);
+	modrm_rr(e, src, dst);
+}
+
+static void alu_ri (struct emitter *e, int n, int dst, uint8_t imm)
+{
+	rex(e, 0, dst);
+	emit(e, 0x80);
+	modrm_rr(e, n, dst);
+	emit(e, imm);
+}
+
+/*
+ * the 0xfe / 0xf6 / 0xd0 groups, one register operand
+ */
+static void unary (struct emitter *e, uint8_t op, int n, int reg)
+{
+	rex(e, 0, reg);
+	emit(e, op);
+	modrm_rr(e, n, reg);
+}
+
+static void mov_ri (struct emitter *e, int reg, uint8_t imm)
+{
+	rex(e, 0, reg);
+	emit(e, 0xb0 | (reg & 7));
+	emit(e, imm);
+}
+
+/*
+ * 8 bit move between a register and [rdi + off]:
+ * op is 0x8a to load, 0x88 to store
+ */
+static void mov_state (struct emitter *e, uint8_t op, int reg, size_t off)
+{
+	rex(e, reg, 0);
+	emit(e, op);
+	emit(e, 0x47 | ((reg & 7) << 3));
+	emit(e, off);
+}
+
+/*
+ * eax = (hi << 8) | lo, the address a register pair points at
+ */
+static void pair_address (struct emitter *e, int hi, int lo)
+{
+	emit(e, 0x41); emit(e, 0x0f); emit(e, 0xb6);	/* movzx eax, hi */
+	modrm_rr(e, 0, hi);
+	emit(e, 0xc1); emit(e, 0xe0); emit(e, 0x08);	/* shl eax, 8 */
+	alu_rr(e, 0x88, HOST_AL, lo);			/* mov al, lo */
+}
+
+/*
+ * eax = (SP + delta) & 0xffff
+ */
+static void sp_address (struct emitter *e, int8_t delta)
+{
+	emit(e, 0x41); emit(e, 0x8d); emit(e, 0x46);	/* lea eax, [r14 + delta] */
+	emit(e, delta);
+	emit(e, 0x0f); emit(e, 0xb7); emit(e, 0xc0);	/* movzx eax, ax */
+}
+
+static void sp_add (struct emitter *e, int8_t delta)
+{
+	emit(e, 0x66); emit(e, 0x41); emit(e, 0x83);	/* add r14w, delta */
+	emit(e, 0xc6);
+	emit(e, delta);
+}
+
+/*
+ * reg = memory[addr]
+ */
+static void load_absolute (struct emitter *e, int reg, uint32_t addr)
+{
+	rex(e, reg, 0);
+	emit(e, 0x8a);
+	emit(e, 0x86 | ((reg & 7) << 3));	/* [rsi + addr] */
+	emit32(e, addr);
+}
+
+/*
+ * reg = memory[eax], once check_address has passed
+ */
+static void load_checked (struct emitter *e, int reg)
+{
+	rex(e, reg, 0);
+	emit(e, 0x8a);
+	emit(e, 0x04 | ((reg & 7) << 3));	/* [rsi + rax] */
+	emit(e, 0x06);
+}
+
+/*
+ * Leaves through a side exit unless the page of the address in eax
+ * can be loaded from (DIRECT_READ) or stored to (DIRECT_WRITE)
+ * straight; eax is kept.
+ */
+static void check_address (struct emitter *e, uint8_t need)
+{
+	struct side_exit *x = &e->exits[e->n_exits++];
+
+	emit(e, 0x0f); emit(e, 0xb6); emit(e, 0xd4);	/* movzx edx, ah */
+	emit(e, 0x48); emit(e, 0xb9);			/* mov rcx, direct */
+	emit64(e, (uintptr_t) e->direct);
+	emit(e, 0xf6); emit(e, 0x04); emit(e, 0x11);	/* test byte [rcx + rdx], need */
+	emit(e, need);
+	emit(e, 0x0f); emit(e, 0x84);			/* jz side exit */
+	emit32(e, 0);
+	x->at = e->code - e->ops;
+	x->pc = e->pc;
+	x->done = e->done;
+}
+
+/*
+ * What write_mem does for the framebuffer after a store to the
+ * address in eax or edx (addr is 0 or 2): marks its band dirty if
+ * it is video RAM.
+ */
+static void mark_video (struct emitter *e, int addr)
+{
+	emit(e, 0x8d); emit(e, 0x88 | addr);		/* lea ecx, [addr - VIDEO_START] */
+	emit32(e, -VIDEO_START);
+	emit(e, 0x81); emit(e, 0xf9);			/* cmp ecx, video size */
+	emit32(e, VIDEO_END - VIDEO_START);
+	emit(e, 0x73); emit(e, 13);			/* jae over */
+	emit(e, 0xba); emit32(e, 1);			/* mov edx, 1 */
+	emit(e, 0xd3); emit(e, 0xe2);			/* shl edx, cl */
+	emit(e, 0x09); emit(e, 0x97);			/* or [rdi + video_dirty], edx */
+	emit32(e, offsetof(cpu8080_state, video_dirty));
+}
+
+/*
+ * memory[eax] = reg, once check_address has passed
+ */
+static void store_checked (struct emitter *e, int reg)
+{
+	rex(e, reg, 0);
+	emit(e, 0x88);
+	emit(e, 0x04 | ((reg & 7) << 3));	/* [rsi + rax] */
+	emit(e, 0x06);
+	mark_video(e, 0);
+}
+
+/*
+ * memory[eax] = imm, once check_address has passed
+ */
+static void store_checked_imm (struct emitter *e, uint8_t imm)
+{
+	emit(e, 0xc6); emit(e, 0x04); emit(e, 0x06);	/* mov byte [rsi + rax] */
+	emit(e, imm);
+	mark_video(e, 0);
+}
+
+/*
+ * Side exits unless both bytes below SP can be written straight to,
+ * before anything is pushed.
+ */
+static void check_push (struct emitter *e)
+{
+	sp_address(e, -1);
+	check_address(e, DIRECT_WRITE);
+	sp_address(e, -2);
+	check_address(e, DIRECT_WRITE);
+}
+
+/*
+ * The same for the two bytes at SP, before anything is popped
+ */
+static void check_pop (struct emitter *e)
+{
+	sp_address(e, 0);
+	check_address(e, DIRECT_READ);
+	sp_address(e, 1);
+	check_address(e, DIRECT_READ);
+}
+
+/*
+ * push of two host registers, or of imm when hi is -1
+ */
+static void push (struct emitter *e, int hi, int lo, uint16_t imm)
+{
+	check_push(e);
+	sp_address(e, -1);
+	if (hi < 0)
+		store_checked_imm(e, imm >> 8);
+	else
+		store_checked(e, hi);
+	sp_address(e, -2);
+	if (hi < 0)
+		store_checked_imm(e, imm & 0xff);
+	else
+		store_checked(e, lo);
+	sp_add(e, -2);
+}
+
+static void pop (struct emitter *e, int hi, int lo)
+{
+	check_pop(e);
+	sp_address(e, 0);
+	load_checked(e, lo);
+	sp_address(e, 1);
+	load_checked(e, hi);
+	sp_add(e, 2);
+}
+
+/*
+ * reg = memory[eax], through a side exit when needed
+ */
+static void load_memory (struct emitter *e, int reg)
+{
+	check_address(e, DIRECT_READ);
+	load_checked(e, reg);
+}
+
+/*
+ * memory[eax] = reg, through a side exit when needed
+ */
+static void store_memory (struct emitter *e, int reg)
+{
+	check_address(e, DIRECT_WRITE);
+	store_checked(e, reg);
+}
+
+/*
+ * Loads from a known address are only compiled when the page is
+ * memory at its own address; that never changes for a map.
+ */
+static int readable (struct emitter *e, uint16_t addr)
+{
+	return e->direct[addr >> 8] & DIRECT_READ;
+}
+
+/*
+ * guest flags to the host ones, for ops that read CY or have to keep it
+ */
+static void flags_in (struct emitter *e)
+{
+	emit(e, 0x88); emit(e, 0xfc);		/* mov ah, bh */
+	emit(e, 0x9e);				/* sahf */
+}
+
+/*
+ * host flags to the guest ones: flip is xored in first (the AC of
+ * subtractions), then everything outside mask is dropped
+ */
+static void flags_out (struct emitter *e, uint8_t flip, uint8_t mask)
+{
+	emit(e, 0x9f);				/* lahf */
+	if (flip) {
+		emit(e, 0x80); emit(e, 0xf4);	/* xor ah, flip */
+		emit(e, flip);
+	}
+	emit(e, 0x80); emit(e, 0xe4);		/* and ah, mask */
+	emit(e, mask);
+	emit(e, 0x88); emit(e, 0xe7);		/* mov bh, ah */
+}
+
+/*
+ * the host CF to the guest CY, the other guest flags are kept
+ */
+static void carry_out (struct emitter *e)
+{
+	emit(e, 0x0f); emit(e, 0x92); emit(e, 0xc0);	/* setc al */
+	emit(e, 0x80); emit(e, 0xe7); emit(e, ~CY_BIT & 0xff);	/* and bh */
+	emit(e, 0x08); emit(e, 0xc7);			/* or bh, al */
+}
+
+/*
+ * ALU op on A and src (a host register, al for memory), flags included
+ */
+static void alu (struct emitter *e, int group, int src)
+{
+	if (group == 1 || group == 3)
+		flags_in(e);
+	alu_rr(e, alu_op[group], HOST_A, src);
+	switch (group) {
+	case 0: case 1:
+		flags_out(e, 0, FLAGS_MASK);
+		break;
+	case 2: case 3: case 7:
+		flags_out(e, AC_BIT, FLAGS_MASK);
+		break;
+	default:
+		flags_out(e, 0, LOGIC_MASK);
+		break;
+	}
+}
+
+/*
+ * Sets the host ZF to "condition not met" for a conditional jump,
+ * call or return: bits 4-5 of the opcode pick the flag, bit 3 says
+ * whether it has to be set (JZ) or clear (JNZ).
+ * Returns the x86 condition code (jcc = 0x70 | cc) of not met.
+ */
+static int condition (struct emitter *e, uint8_t opcode)
+{
+	static const uint8_t flag[4] = { 0x40, 0x01, 0x04, 0x80 };
+
+	emit(e, 0xf6); emit(e, 0xc7);		/* test bh, flag */
+	emit(e, flag[(opcode >> 4) & 3]);
+	return opcode & 8 ? 0x4 : 0x5;		/* z or nz */
+}
+
+/*
+ * JMP and the conditional jumps, the last op of their block:
+ * eax = taken ? target : the op after it
+ */
+static void jump (struct emitter *e, uint8_t opcode, uint16_t target)
+{
+	int cc;
+
+	e->ends = 1;
+	emit(e, 0xb8);				/* mov eax, target */
+	emit32(e, target);
+	if (opcode == 0xc3)
+		return;
+	emit(e, 0xb9);				/* mov ecx, next */
+	emit32(e, (uint16_t) (e->pc + 3));
+	cc = condition(e, opcode);
+	emit(e, 0x0f); emit(e, 0x40 | cc);	/* cmov eax, ecx */
+	emit(e, 0xc1);
+}
+
+/*
+ * The conditional form of a call or return: code emitted between
+ * this and unless_end only runs when the condition is met, else eax
+ * is the op after it.
+ */
+static uint8_t *unless (struct emitter *e, uint8_t opcode)
+{
+	int cc = condition(e, opcode);
+
+	emit(e, 0x0f); emit(e, 0x80 | cc);	/* jcc not met */
+	emit32(e, 0);
+	return e->code;
+}
+
+static void unless_end (struct emitter *e, uint8_t *skip, uint16_t next)
+{
+	uint8_t *join;
+
+	emit(e, 0xe9);				/* jmp join */
+	emit32(e, 0);
+	join = e->code;
+	patch(skip, e->code);
+	emit(e, 0xb8);				/* mov eax, next */
+	emit32(e, next);
+	patch(join, e->code);
+}
+
+/*
+ * CALL: pushes the address of the next op, eax = target
+ */
+static void call (struct emitter *e, uint16_t target)
+{
+	push(e, -1, -1, e->pc + 3);
+	emit(e, 0xb8);				/* mov eax, target */
+	emit32(e, target);
+}
+
+/*
+ * RET: eax = the address popped
+ */
+static void ret (struct emitter *e)
+{
+	check_pop(e);
+	sp_address(e, 0);
+	emit(e, 0x0f); emit(e, 0xb6); emit(e, 0x0c);	/* movzx ecx, byte [rsi + rax] */
+	emit(e, 0x06);
+	sp_address(e, 1);
+	emit(e, 0x0f); emit(e, 0xb6); emit(e, 0x04);	/* movzx eax, byte [rsi + rax] */
+	emit(e, 0x06);
+	emit(e, 0xc1); emit(e, 0xe0); emit(e, 0x08);	/* shl eax, 8 */
+	emit(e, 0x09); emit(e, 0xc8);			/* or eax, ecx */
+	sp_add(e, 2);
+}
+
+static size_t reg_offset (int r)
+{
+	static const size_t offsets[8] = {
+		offsetof(cpu8080_state, b), offsetof(cpu8080_state, c),
+		offsetof(cpu8080_state, d), offsetof(cpu8080_state, e),
+		offsetof(cpu8080_state, h), offsetof(cpu8080_state, l),
+		0, offsetof(cpu8080_state, a),
+	};
+	return offsets[r];
+}
+
+/*
+ * Emits one op. Returns its length in guest bytes, or 0 if it is not
+ * one the generator handles; what was emitted is then thrown away.
+ */
+static int compile_op (struct emitter *e, const unsigned char *op)
+{
+	uint8_t opcode = op[0];
+	int dst = (opcode >> 3) & 7;
+	int src = opcode & 7;
+	int pair = (opcode >> 4) & 3;
+	int hi = host_reg[pair * 2];
+	int lo = host_reg[pair * 2 + 1];
+
+	/* MOV r, r, MOV r, M and MOV M, r (not HLT) */
+	if (opcode >= 0x40 && opcode < 0x80) {
+		if (opcode == 0x76)
+			return 0;
+		if (dst == 6) {
+			pair_address(e, host_reg[4], host_reg[5]);
+			store_memory(e, host_reg[src]);
+		} else if (src == 6) {
+			pair_address(e, host_reg[4], host_reg[5]);
+			load_memory(e, host_reg[dst]);
+		} else if (dst != src) {
+			alu_rr(e, 0x88, host_reg[dst], host_reg[src]);
+		}
+		return 1;
+	}
+
+	/* ADD ADC SUB SBB ANA XRA ORA CMP r or M */
+	if (opcode >= 0x80 && opcode < 0xc0) {
+		if (src == 6) {
+			pair_address(e, host_reg[4], host_reg[5]);
+			load_memory(e, HOST_AL);
+			alu(e, dst, HOST_AL);
+		} else {
+			alu(e, dst, host_reg[src]);
+		}
+		return 1;
+	}
+
+	/* ADI ACI SUI SBI ANI XRI ORI CPI byte */
+	if (opcode >= 0xc0 && src == 6) {
+		mov_ri(e, HOST_AL, op[1]);
+		alu(e, dst, HOST_AL);
+		return 2;
+	}
+
+	switch (opcode) {
+	case 0x00:
+		return 1;
+	/* MVI r, byte */
+	case 0x06: case 0x0e: case 0x16: case 0x1e:
+	case 0x26: case 0x2e: case 0x3e:
+		mov_ri(e, host_reg[dst], op[1]);
+		return 2;
+	/* MVI M, byte */
+	case 0x36:
+		pair_address(e, host_reg[4], host_reg[5]);
+		check_address(e, DIRECT_WRITE);
+		store_checked_imm(e, op[1]);
+		return 2;
+	/* INR r: CY goes through untouched, as inc leaves CF alone */
+	case 0x04: case 0x0c: case 0x14: case 0x1c:
+	case 0x24: case 0x2c: case 0x3c:
+		flags_in(e);
+		unary(e, 0xfe, 0, host_reg[dst]);
+		flags_out(e, 0, FLAGS_MASK);
+		return 1;
+	/* DCR r */
+	case 0x05: case 0x0d: case 0x15: case 0x1d:
+	case 0x25: case 0x2d: case 0x3d:
+		flags_in(e);
+		unary(e, 0xfe, 1, host_reg[dst]);
+		flags_out(e, AC_BIT, FLAGS_MASK);
+		return 1;
+	/* INR M, DCR M */
+	case 0x34: case 0x35:
+		pair_address(e, host_reg[4], host_reg[5]);
+		check_address(e, DIRECT_WRITE);
+		emit(e, 0x89); emit(e, 0xc2);	/* mov edx, eax: ah goes next */
+		flags_in(e);
+		emit(e, 0xfe);			/* inc/dec byte [rsi + rdx] */
+		emit(e, opcode == 0x34 ? 0x04 : 0x0c);
+		emit(e, 0x16);
+		flags_out(e, opcode == 0x34 ? 0 : AC_BIT, FLAGS_MASK);
+		mark_video(e, 2);
+		return 1;
+	/* LXI B, D, H */
+	case 0x01: case 0x11: case 0x21:
+		mov_ri(e, lo, op[1]);
+		mov_ri(e, hi, op[2]);
+		return 3;
+	/* INX B, D, H: the host flags are scratch here */
+	case 0x03: case 0x13: case 0x23:
+		alu_ri(e, 0, lo, 1);	/* add lo, 1 */
+		alu_ri(e, 2, hi, 0);	/* adc hi, 0 */
+		return 1;
+	/* DCX B, D, H */
+	case 0x0b: case 0x1b: case 0x2b:
+		alu_ri(e, 5, lo, 1);	/* sub lo, 1 */
+		alu_ri(e, 3, hi, 0);	/* sbb hi, 0 */
+		return 1;
+	/* LDAX B, D */
+	case 0x0a: case 0x1a:
+		pair_address(e, hi, lo);
+		load_memory(e, HOST_A);
+		return 1;
+	/* STAX B, D */
+	case 0x02: case 0x12:
+		pair_address(e, hi, lo);
+		store_memory(e, HOST_A);
+		return 1;
+	/* LDA addr */
+	case 0x3a:
+		if (!readable(e, op[1] | (op[2] << 8)))
+			return 0;
+		load_absolute(e, HOST_A, op[1] | (op[2] << 8));
+		return 3;
+	/* STA addr */
+	case 0x32:
+		emit(e, 0xb8);			/* mov eax, addr */
+		emit32(e, op[1] | (op[2] << 8));
+		store_memory(e, HOST_A);
+		return 3;
+	/* RLC RRC RAL RAR are rol ror rcl rcr, only CY changes */
+	case 0x07: case 0x0f: case 0x17: case 0x1f:
+		if (opcode >= 0x17)
+			flags_in(e);
+		unary(e, 0xd0, opcode >> 3, HOST_A);
+		carry_out(e);
+		return 1;
+	/* CMA */
+	case 0x2f:
+		unary(e, 0xf6, 2, HOST_A);	/* not bl */
+		return 1;
+	/* STC */
+	case 0x37:
+		emit(e, 0x80); emit(e, 0xcf); emit(e, CY_BIT);	/* or bh */
+		return 1;
+	/* CMC */
+	case 0x3f:
+		emit(e, 0x80); emit(e, 0xf7); emit(e, CY_BIT);	/* xor bh */
+		return 1;
+	/* XCHG */
+	case 0xeb:
+		alu_rr(e, 0x86, host_reg[2], host_reg[4]);
+		alu_rr(e, 0x86, host_reg[3], host_reg[5]);
+		return 1;
+	/* LXI SP */
+	case 0x31:
+		emit(e, 0x66); emit(e, 0x41); emit(e, 0xb8 | (HOST_SP & 7));
+		emit16(e, op[1] | (op[2] << 8));
+		return 3;
+	/* INX SP, DCX SP */
+	case 0x33: case 0x3b:
+		emit(e, 0x66);
+		unary(e, 0xff, opcode == 0x33 ? 0 : 1, HOST_SP);
+		return 1;
+	/* LHLD addr */
+	case 0x2a:
+	{
+		uint16_t addr = op[1] | (op[2] << 8);
+
+		if (!readable(e, addr) || !readable(e, addr + 1))
+			return 0;
+		load_absolute(e, host_reg[5], addr);
+		load_absolute(e, host_reg[4], (uint16_t) (addr + 1));
+		return 3;
+	}
+	/* DAD B, D, H: only CY changes */
+	case 0x09: case 0x19: case 0x29:
+		pair_address(e, host_reg[4], host_reg[5]);
+		emit(e, 0x41); emit(e, 0x0f); emit(e, 0xb6);	/* movzx ecx, hi */
+		modrm_rr(e, 1, hi);
+		emit(e, 0xc1); emit(e, 0xe1); emit(e, 0x08);	/* shl ecx, 8 */
+		alu_rr(e, 0x88, 1, lo);				/* mov cl, lo */
+		emit(e, 0x66); emit(e, 0x01); emit(e, 0xc8);	/* add ax, cx */
+		emit(e, 0x0f); emit(e, 0x92); emit(e, 0xc2);	/* setc dl */
+		alu_rr(e, 0x88, host_reg[5], HOST_AL);		/* mov l, al */
+		emit(e, 0xc1); emit(e, 0xe8); emit(e, 0x08);	/* shr eax, 8 */
+		alu_rr(e, 0x88, host_reg[4], HOST_AL);		/* mov h, al */
+		emit(e, 0x80); emit(e, 0xe7); emit(e, ~CY_BIT & 0xff);	/* and bh */
+		emit(e, 0x08); emit(e, 0xd7);			/* or bh, dl */
+		return 1;
+	/* SPHL */
+	case 0xf9:
+		pair_address(e, host_reg[4], host_reg[5]);
+		emit(e, 0x66); emit(e, 0x41); emit(e, 0x89);	/* mov r14w, ax */
+		emit(e, 0xc6);
+		return 1;
+	/* PUSH B, D, H */
+	case 0xc5: case 0xd5: case 0xe5:
+		push(e, hi, lo, 0);
+		return 1;
+	/* PUSH PSW */
+	case 0xf5:
+		push(e, HOST_A, HOST_FLAGS, 0);
+		return 1;
+	/* POP B, D, H */
+	case 0xc1: case 0xd1: case 0xe1:
+		pop(e, hi, lo);
+		return 1;
+	/* POP PSW */
+	case 0xf1:
+		pop(e, HOST_A, HOST_FLAGS);
+		return 1;
+	/* EI, DI: interrupts are only ever taken between two runs */
+	case 0xfb: case 0xf3:
+		emit(e, 0xc6); emit(e, 0x47);	/* mov byte [rdi + int_enable] */
+		emit(e, offsetof(cpu8080_state, int_enable));
+		emit(e, opcode == 0xfb);
+		return 1;
+	/* JMP and Jcc addr */
+	case 0xc3:
+	case 0xc2: case 0xca: case 0xd2: case 0xda:
+	case 0xe2: case 0xea: case 0xf2: case 0xfa:
+		jump(e, opcode, op[1] | (op[2] << 8));
+		return 3;
+	/* CALL addr */
+	case 0xcd:
+		e->ends = 1;
+		call(e, op[1] | (op[2] << 8));
+		return 3;
+	/* Ccc addr */
+	case 0xc4: case 0xcc: case 0xd4: case 0xdc:
+	case 0xe4: case 0xec: case 0xf4: case 0xfc:
+	{
+		uint8_t *skip = unless(e, opcode);
+
+		e->ends = 1;
+		call(e, op[1] | (op[2] << 8));
+		unless_end(e, skip, e->pc + 3);
+		return 3;
+	}
+	/* RET */
+	case 0xc9:
+		e->ends = 1;
+		ret(e);
+		return 1;
+	/* Rcc */
+	case 0xc0: case 0xc8: case 0xd0: case 0xd8:
+	case 0xe0: case 0xe8: case 0xf0: case 0xf8:
+	{
+		uint8_t *skip = unless(e, opcode);
+
+		e->ends = 1;
+		ret(e);
+		unless_end(e, skip, e->pc + 1);
+		return 1;
+	}
+	/* PCHL */
+	case 0xe9:
+		e->ends = 1;
+		pair_address(e, host_reg[4], host_reg[5]);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * from C: saves the callee saved registers, loads the guest ones
+ * and the budget (esi)
+ */
+static void prologue (struct emitter *e)
+{
+	emit(e, 0x53);				/* push rbx */
+	emit(e, 0x55);				/* push rbp */
+	for (int r = 12; r <= 15; r++) {
+		emit(e, 0x41);			/* push r12..r15 */
+		emit(e, 0x50 | (r & 7));
+	}
+	emit(e, 0x89); emit(e, 0xf5);		/* mov ebp, esi */
+	emit(e, 0x41); emit(e, 0x89); emit(e, 0xf7);	/* mov r15d, esi */
+	for (int r = 0; r < 8; r++)
+		if (host_reg[r] >= 0)
+			mov_state(e, 0x8a, host_reg[r], reg_offset(r));
+	emit(e, 0x8a); emit(e, 0x7f);		/* mov bh, [rdi + flags] */
+	emit(e, offsetof(cpu8080_state, flags));
+	emit(e, 0x66); emit(e, 0x44); emit(e, 0x8b); emit(e, 0x77);
+	emit(e, offsetof(cpu8080_state, sp));	/* mov r14w, [rdi + sp] */
+	emit(e, 0x48); emit(e, 0x8b); emit(e, 0x77);
+	emit(e, offsetof(cpu8080_state, memory)); /* mov rsi, [rdi + memory] */
+}
+
+/*
+ * back to C: stores the guest registers (pc is set already)
+ * and returns the cycles run
+ */
+static void leave (struct emitter *e)
+{
+	for (int r = 0; r < 8; r++)
+		if (host_reg[r] >= 0)
+			mov_state(e, 0x88, host_reg[r], reg_offset(r));
+	emit(e, 0x88); emit(e, 0x7f);		/* mov [rdi + flags], bh */
+	emit(e, offsetof(cpu8080_state, flags));
+	emit(e, 0x66); emit(e, 0x44); emit(e, 0x89); emit(e, 0x77);
+	emit(e, offsetof(cpu8080_state, sp));	/* mov [rdi + sp], r14w */
+	emit(e, 0x89); emit(e, 0xe8);		/* mov eax, ebp */
+	emit(e, 0x44); emit(e, 0x29); emit(e, 0xf8);	/* sub eax, r15d */
+	for (int r = 15; r >= 12; r--) {
+		emit(e, 0x41);			/* pop r15..r12 */
+		emit(e, 0x58 | (r & 7));
+	}
+	emit(e, 0x5d);				/* pop rbp */
+	emit(e, 0x5b);				/* pop rbx */
+	emit(e, 0xc3);				/* ret */
+}
+
+static void set_pc (struct emitter *e, uint16_t pc)
+{
+	emit(e, 0x66); emit(e, 0xc7); emit(e, 0x47);	/* mov word [rdi + pc] */
+	emit(e, offsetof(cpu8080_state, pc));
+	emit16(e, pc);
+}
+
+/*
+ * The end of a block, with the next pc in eax: on to the compiled
+ * block there if there is one, else back to C.
+ */
+static void chain (struct emitter *e, struct jit *jit)
+{
+	uint8_t *miss;
+
+	emit(e, 0x89); emit(e, 0xc1);		/* mov ecx, eax */
+	emit(e, 0x81); emit(e, 0xe1);		/* and ecx, JIT_MAP_SIZE - 1 */
+	emit32(e, JIT_MAP_SIZE - 1);
+	emit(e, 0xc1); emit(e, 0xe1); emit(e, 0x05);	/* shl ecx, 5 */
+	emit(e, 0x48); emit(e, 0xba);		/* mov rdx, map */
+	emit64(e, (uintptr_t) jit->map);
+	emit(e, 0x3b); emit(e, 0x04); emit(e, 0x0a);	/* cmp eax, [rdx + rcx] */
+	emit(e, 0x0f); emit(e, 0x85);		/* jne miss */
+	emit32(e, 0);
+	miss = e->code;
+	emit(e, 0xff); emit(e, 0x64); emit(e, 0x0a);	/* jmp [rdx + rcx + body] */
+	emit(e, offsetof(struct jit_entry, body));
+	patch(miss, e->code);
+	emit(e, 0x66); emit(e, 0x89); emit(e, 0x47);	/* mov [rdi + pc], ax */
+	emit(e, offsetof(cpu8080_state, pc));
+	leave(e);
+}
+
+/*
+ * The buffer is never writable and executable at once: it is mapped
+ * read and execute, and jit_compile only makes it writable while it
+ * appends a block. Blocks are compiled once each, after
+ * JIT_THRESHOLD runs, so the two mprotect calls are rare.
+ */
+struct jit *jit_create (const uint8_t *direct)
+{
+	struct jit *jit = malloc(sizeof(struct jit));
+
+	if (NULL == jit)
+		return NULL;
+	jit->buffer = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_EXEC,
+			   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (MAP_FAILED == jit->buffer) {
+		free(jit);
+		return NULL;
+	}
+	jit->direct = direct;
+	jit_flush(jit);
+	return jit;
+}
+
+void jit_destroy (struct jit *jit)
+{
+	if (NULL == jit)
+		return;
+	munmap(jit->buffer, JIT_BUFFER_SIZE);
+	free(jit);
+}
+
+void jit_flush (struct jit *jit)
+{
+	jit->used = 0;
+	for (int i = 0; i < JIT_MAP_SIZE; i++)
+		jit->map[i].pc = NO_PC;
+}
+
+void jit_invalidate (struct jit *jit, uint8_t page)
+{
+	for (int i = 0; i < JIT_MAP_SIZE; i++) {
+		struct jit_entry *entry = &jit->map[i];
+		uint16_t end = entry->pc + entry->len - 1;
+
+		if (entry->pc != NO_PC && (entry->pc >> 8) <= page &&
+		    page <= (end >> 8))
+			entry->pc = NO_PC;
+	}
+}
+
+jit_fn jit_lookup (struct jit *jit, uint16_t pc)
+{
+	struct jit_entry *entry = &jit->map[pc & (JIT_MAP_SIZE - 1)];
+
+	return entry->pc == pc ? entry->fn : NULL;
+}
+
+jit_fn jit_compile (struct jit *jit, uint16_t pc, unsigned char ops[][4],
+		    int n, int *count)
+{
+	uint8_t code[JIT_MAX_OPS * JIT_MAX_OP];
+	struct jit_entry *entry;
+	struct emitter e;
+	uint8_t *start, *body, *over;
+	size_t size;
+	uint16_t len = 0;
+	int i;
+
+	if (n > JIT_MAX_OPS)
+		n = JIT_MAX_OPS;
+	/* every op may need a side exit, which is about a frame */
+	if (jit->used + JIT_FRAME + n * (JIT_MAX_OP + JIT_MAX_EXITS * JIT_FRAME) >
+	    JIT_BUFFER_SIZE) {
+		*count = -1;
+		return NULL;
+	}
+
+	/* the ops go aside first: the block starts with their cycles */
+	e.code = e.ops = code;
+	e.direct = jit->direct;
+	e.done = 0;
+	e.ends = 0;
+	e.n_exits = 0;
+	for (i = 0; i < n && !e.ends; i++) {
+		uint8_t *last = e.code;
+		int n_exits = e.n_exits;
+		int bytes;
+
+		e.pc = pc + len;
+		bytes = compile_op(&e, ops[i]);
+		if (0 == bytes) {
+			e.code = last;
+			e.n_exits = n_exits;
+			break;
+		}
+		len += bytes;
+		e.done += cycles8080[ops[i][0]];
+	}
+	*count = i;
+	if (0 == i)
+		return NULL;
+	size = e.code - code;
+
+	/* the buffer is only writable while a block goes in */
+	if (mprotect(jit->buffer, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE) < 0) {
+		*count = 0;
+		return NULL;
+	}
+	start = jit->buffer + jit->used;
+	e.code = start;
+	prologue(&e);
+
+	/* the block proper, which other blocks jump to */
+	body = e.code;
+	emit(&e, 0x41); emit(&e, 0x81); emit(&e, 0xff);	/* cmp r15d, cycles */
+	emit32(&e, e.done);
+	emit(&e, 0x0f); emit(&e, 0x8c);			/* jl over budget */
+	emit32(&e, 0);
+	over = e.code;
+	emit(&e, 0x41); emit(&e, 0x81); emit(&e, 0xef);	/* sub r15d, cycles */
+	emit32(&e, e.done);
+	e.ops = e.code;
+	memcpy(e.ops, code, size);
+	e.code += size;
+	if (!e.ends) {
+		emit(&e, 0xb8);				/* mov eax, next */
+		emit32(&e, (uint16_t) (pc + len));
+	}
+	chain(&e, jit);
+
+	/* the block does not fit, the interpreter goes on from its start */
+	patch(over, e.code);
+	set_pc(&e, pc);
+	leave(&e);
+
+	/* the cycles of the store and what follows are given back */
+	for (int k = 0; k < e.n_exits; k++) {
+		struct side_exit *x = &e.exits[k];
+
+		patch(e.ops + x->at, e.code);
+		emit(&e, 0x41); emit(&e, 0x81); emit(&e, 0xc7);	/* add r15d, cycles */
+		emit32(&e, e.done - x->done);
+		set_pc(&e, x->pc);
+		leave(&e);
+	}
+
+	entry = &jit->map[pc & (JIT_MAP_SIZE - 1)];
+	entry->pc = pc;
+	entry->len = len;
+	entry->body = body;
+	entry->fn = (jit_fn) start;
+
+	/* next block on a 16 byte boundary */
+	jit->used = ((e.code - jit->buffer) + 15) & ~(size_t) 15;
+	if (mprotect(jit->buffer, JIT_BUFFER_SIZE, PROT_READ | PROT_EXEC) < 0) {
+		entry->pc = NO_PC;
+		*count = 0;
+		return NULL;
+	}
+	return entry->fn;
+}
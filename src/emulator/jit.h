@@ -0,0 +1,72 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "8080.h"
+
+/* from 8080.c */
+extern unsigned char cycles8080[];
+
+/*
+ * x86-64 code generator for the block cache.
+ * A compiled block is entered as a plain function, with the cycles it
+ * may run. The guest registers live in host registers from there on,
+ * and compiled blocks jump straight to each other as long as the
+ * budget allows. It returns the cycles it ran, with pc left at the
+ * first instruction it did not run: one it cannot compile, one that
+ * does not fit the budget (0 if that is the first one) or a load or
+ * store that has to go through the memory map.
+ */
+typedef int (*jit_fn) (cpu8080_state *state, int budget);
+
+struct jit;
+
+/*
+ * What compiled code may do to a page of memory[] by itself, anything
+ * else is left to the interpreter and its memory map. DIRECT_WRITE
+ * is only ever given with DIRECT_READ.
+ */
+#define DIRECT_READ 1
+#define DIRECT_WRITE 2
+
+/*
+ * Maps an executable buffer for one core, only ever writable while
+ * jit_compile writes to it.
+ * direct has the DIRECT_ bits of each 256 byte page. DIRECT_WRITE is
+ * read as the code runs, DIRECT_READ must not change until jit_flush.
+ * Returns NULL if that is not possible (the core then just interprets).
+ */
+struct jit *jit_create (const uint8_t *direct);
+
+void jit_destroy (struct jit *jit);
+
+/*
+ * Forgets every compiled block and reuses the buffer.
+ */
+void jit_flush (struct jit *jit);
+
+/*
+ * Forgets the blocks compiled from a page, as it was written to.
+ */
+void jit_invalidate (struct jit *jit, uint8_t page);
+
+/*
+ * The block compiled at pc, if it is still known.
+ */
+jit_fn jit_lookup (struct jit *jit, uint16_t pc);
+
+/*
+ * Compiles the longest prefix of ops (as laid out by the block cache:
+ * opcode, then operand bytes, the first one at pc) the generator knows
+ * how to translate. Register, ALU, load, store, stack and most
+ * control flow instructions are translated: I/O, HLT, RST, DAA and a
+ * few others are left to the interpreter, as are the loads and stores
+ * the map has to handle, which also keeps code that rewrites itself
+ * working.
+ * Returns the function with *count set to the number of ops it covers.
+ * Returns NULL with *count set to 0 if not even the first op could be
+ * compiled, or to -1 if the buffer is full (jit_flush it and retry).
+ */
+jit_fn jit_compile (struct jit *jit, uint16_t pc, unsigned char ops[][4],
+		    int n, int *count);
+
+#endif
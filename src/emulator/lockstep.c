@@ -0,0 +1,722 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "flags8080.h"
+#include "lockstep.h"
+#include "rom.h"
+
+/* from 8080.c */
+extern unsigned char cycles8080[];
+extern const unsigned char length8080[];
+
+/*
+ * The kernels are written with GCC vectors and built twice on x86-64,
+ * for AVX2 and for the SSE2 every such host has, the loader picking
+ * one. LOCKSTEP_NO_AVX2 keeps to the second, to benchmark against.
+ */
+#if defined(__x86_64__) && !defined(LOCKSTEP_NO_AVX2)
+#define KERNELS __attribute__((target_clones("avx2", "default")))
+#else
+#define KERNELS
+#endif
+
+/*
+ * The helpers are inlined into each kernel, so that the vectors stay
+ * in the registers of its instruction set. They take vectors by
+ * pointer: by value they have no ABI GCC keeps quiet about.
+ */
+#define VECTOR_FN static inline __attribute__((always_inline))
+#pragma GCC diagnostic ignored "-Wpsabi"
+
+/*
+ * A kernel runs 16 lanes at once: 16 bytes, or 16 words in one AVX2
+ * register. GCC does not split wider vectors well, it falls back to
+ * scalar code for their compares. 16 bit compares are no better on
+ * SSE2, so the kernels do without them.
+ */
+#define VECTOR_LANES 16
+#define VECTORS (LOCKSTEP_LANES / VECTOR_LANES)
+
+typedef uint8_t v8 __attribute__((vector_size(VECTOR_LANES), may_alias));
+typedef int8_t m8 __attribute__((vector_size(VECTOR_LANES)));
+typedef uint16_t v16 __attribute__((vector_size(2 * VECTOR_LANES),
+				    may_alias));
+typedef int16_t m16 __attribute__((vector_size(2 * VECTOR_LANES),
+				   may_alias));
+typedef uint32_t v32 __attribute__((vector_size(VECTOR_LANES)));
+typedef uint64_t v64 __attribute__((vector_size(VECTOR_LANES)));
+
+/* the slots of struct lockstep r: flags where the opcodes have M */
+#define REG_H 4
+#define REG_L 5
+#define REG_M 6
+#define REG_F 6
+#define REG_A 7
+
+/* the vector of 16 lanes from lane base of an array of the group */
+#define AT(array, base) ((void *) &(array)[base])
+
+/* new where the lane is in m, old elsewhere */
+#define BLEND8(m, new, old) (((v8) (m) & (new)) | (~(v8) (m) & (old)))
+#define BLEND16(m, new, old) (((v16) (m) & (new)) | (~(v16) (m) & (old)))
+
+/* one of the lanes of mask, lowest first */
+#define FOR_LANES(i, mask)						\
+	for (uint32_t left_ = (mask), i;				\
+	     left_ && (i = __builtin_ctz(left_), 1); left_ &= left_ - 1)
+
+/* every lane of mask set to -1, the others 0 */
+VECTOR_FN m8 lane_mask (uint32_t mask)
+{
+	static const v8 bit = {
+		1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128,
+	};
+	static const v8 byte = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+	};
+	v8 bytes = (v8) ((v32) { 0 } + mask);
+
+	return (m8) ((__builtin_shuffle(bytes, byte) & bit) != 0);
+}
+
+/*
+ * The lanes of a mask vector as bits: each byte weighs its bit of the
+ * byte it goes to, and the multiply adds up the 8 weights of a half
+ */
+VECTOR_FN uint32_t bits (const m8 *m)
+{
+	static const v8 weight = {
+		1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128,
+	};
+	v64 sum = ((v64) (*m & weight) * 0x0101010101010101) >> 56;
+
+	return sum[0] | sum[1] << 8;
+}
+
+/* -1 in the words where a is below b, without a compare */
+VECTOR_FN m16 below (const v16 *a, const v16 *b)
+{
+	v16 borrow = (~*a & *b) | (~(*a ^ *b) & (*a - *b));
+
+	return (m16) borrow >> 15;
+}
+
+/* register pairs and their halves */
+#define PAIR(hi, lo) (__builtin_convertvector(hi, v16) << 8	\
+		      | __builtin_convertvector(lo, v16))
+#define HIGH(val) __builtin_convertvector((val) >> 8, v8)
+#define LOW(val) __builtin_convertvector((val) & 0xff, v8)
+
+/* the Z, S and P flags of results */
+VECTOR_FN v8 zsp (const v8 *val)
+{
+	v8 p = *val ^ (*val >> 4);
+
+	p ^= p >> 2;
+	p ^= p >> 1;
+	return ((v8) (*val == 0) & FLAG_Z) | (*val & FLAG_S)
+		| ((~p & 1) << 2);
+}
+
+/*
+ * The ALU operation of bits 3-5 of op on A and val in the lanes of m,
+ * with the flags as arith_add, arith_sub and logic_flags in 8080.c
+ * set them
+ */
+VECTOR_FN void alu (v8 *a, v8 *f, uint8_t op, const m8 *m, const v8 *val)
+{
+	v8 carry = *f & FLAG_CY;
+	v8 res, flags;
+
+	switch ((op >> 3) & 7) {
+	case 0:		/* ADD */
+	case 1:		/* ADC */
+	{
+		v8 sum = *a + *val;
+		if (!(op & 8))
+			carry = (v8) { 0 };
+		res = sum + carry;
+		flags = zsp(&res) | ((*a ^ *val ^ res) & FLAG_AC)
+			| (((v8) (sum < *a) | (v8) (res < sum)) & FLAG_CY);
+		break;
+	}
+	case 2:		/* SUB */
+	case 3:		/* SBB */
+	case 7:		/* CMP */
+	{
+		v8 diff = *a - *val;
+		if (3 != ((op >> 3) & 7))
+			carry = (v8) { 0 };
+		res = diff - carry;
+		flags = zsp(&res) | (~(*a ^ *val ^ res) & FLAG_AC)
+			| (((v8) (*a < *val) | (v8) (diff < carry)) & FLAG_CY);
+		if (7 == ((op >> 3) & 7))
+			res = *a;
+		break;
+	}
+	case 4:		/* ANA */
+		res = *a & *val;
+		flags = zsp(&res);
+		break;
+	case 5:		/* XRA */
+		res = *a ^ *val;
+		flags = zsp(&res);
+		break;
+	default:	/* ORA */
+		res = *a | *val;
+		flags = zsp(&res);
+		break;
+	}
+	*a = BLEND8(*m, res, *a);
+	*f = BLEND8(*m, flags, *f);
+}
+
+/* the lanes where the condition of bits 3-5 of op holds */
+VECTOR_FN m8 condition (uint8_t op, const v8 *flags)
+{
+	static const uint8_t flag[4] = { FLAG_Z, FLAG_CY, FLAG_P, FLAG_S };
+	m8 set = (m8) ((*flags & flag[(op >> 4) & 3]) != 0);
+
+	return (op & 8) ? set : ~set;
+}
+
+/* loads and stores of the lanes from base, each in its own machine */
+VECTOR_FN v8 load (struct invaders **machines, uint32_t mask,
+		   const v16 *addr)
+{
+	v8 val = { 0 };
+
+	FOR_LANES(i, mask)
+		val[i] = cpu8080_read(&machines[i]->cpu, (*addr)[i]);
+	return val;
+}
+
+VECTOR_FN void store (struct invaders **machines, uint32_t mask,
+		      const v16 *addr, const v8 *val)
+{
+	FOR_LANES(i, mask)
+		cpu8080_write(&machines[i]->cpu, (*addr)[i], (*val)[i]);
+}
+
+/* high at sp - 1 and low at sp - 2, like push() */
+VECTOR_FN void push (struct invaders **machines, uint32_t mask, v16 *sp,
+		     const v16 *val)
+{
+	FOR_LANES(i, mask) {
+		cpu8080_state *cpu = &machines[i]->cpu;
+		cpu8080_write(cpu, (*sp)[i] - 1, (*val)[i] >> 8);
+		cpu8080_write(cpu, (*sp)[i] - 2, (*val)[i] & 0xff);
+	}
+	*sp -= __builtin_convertvector(lane_mask(mask), v16) & 2;
+}
+
+VECTOR_FN v16 pop (struct invaders **machines, uint32_t mask, v16 *sp)
+{
+	v16 val = { 0 };
+
+	FOR_LANES(i, mask) {
+		cpu8080_state *cpu = &machines[i]->cpu;
+		val[i] = cpu8080_read(cpu, (*sp)[i])
+			| cpu8080_read(cpu, (uint16_t) ((*sp)[i] + 1)) << 8;
+	}
+	*sp += __builtin_convertvector(lane_mask(mask), v16) & 2;
+	return val;
+}
+
+/*
+ * The lowest of the pcs where lanes are on, -1 in the others: each
+ * step halves the vector
+ */
+VECTOR_FN uint16_t lowest (const v16 *pcs)
+{
+	v16 low = *pcs;
+
+#define HALVE(...) do {							\
+		v16 other = __builtin_shuffle(low, (m16) { __VA_ARGS__ });	\
+		low = BLEND16(below(&other, &low), other, low);		\
+	} while (0)
+	HALVE(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+	HALVE(4, 5, 6, 7, 0, 1, 2, 3, 12, 13, 14, 15, 8, 9, 10, 11);
+	HALVE(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+	HALVE(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+#undef HALVE
+	return low[0];
+}
+
+/* the lanes from base still short of their budget, as a mask vector */
+#define ACTIVE(g, base) ((*(m16 *) AT((g)->cycles, base)		\
+			  - *(m16 *) AT((g)->budget, base)) >> 15)
+
+/* the lanes from base short of their budget with pc at */
+VECTOR_FN uint32_t lanes_at (struct lockstep *g, int base, uint16_t at)
+{
+	v16 other = *(v16 *) AT(g->pc, base) ^ at;
+	/* 0 in the words with no bit set */
+	m8 same = __builtin_convertvector(ACTIVE(g, base)
+					  & ~((m16) (other | -other) >> 15), m8);
+
+	return bits(&same);
+}
+
+/*
+ * The lanes still short of their budget that are at the lowest pc of
+ * them, with that pc, and in limit the next lowest of them
+ */
+KERNELS
+static uint32_t next_lanes (struct lockstep *g, uint16_t *pc, uint16_t *limit)
+{
+	uint32_t mask = 0;
+	uint16_t low[VECTORS];
+
+	*pc = 0xffff;
+	for (int base = 0; base < g->lanes; base += VECTOR_LANES) {
+		v16 pcs = BLEND16(ACTIVE(g, base), *(v16 *) AT(g->pc, base),
+				  (v16) { 0 } + 0xffff);
+
+		low[base / VECTOR_LANES] = lowest(&pcs);
+		if (low[base / VECTOR_LANES] < *pc)
+			*pc = low[base / VECTOR_LANES];
+	}
+	*limit = 0xffff;
+	for (int base = 0; base < g->lanes; base += VECTOR_LANES) {
+		uint32_t lanes = lanes_at(g, base, *pc);
+		v16 pcs = BLEND16(ACTIVE(g, base), *(v16 *) AT(g->pc, base),
+				  (v16) { 0 } + 0xffff);
+		uint16_t next;
+
+		mask |= lanes << base;
+		/* the others */
+		pcs |= __builtin_convertvector(lane_mask(lanes), v16);
+		next = lowest(&pcs);
+		if (next < *limit)
+			*limit = next;
+	}
+	return mask;
+}
+
+/*
+ * Runs the instruction at code, at pc, in the lanes of mask from base.
+ * Returns 0 without touching anything if it has no kernel.
+ */
+VECTOR_FN int vector_step (struct lockstep *g, int base, uint32_t mask,
+			   uint16_t pc, const uint8_t *code)
+{
+	struct invaders **machines = &g->machines[base];
+	v8 *a = AT(g->r[REG_A], base);
+	v8 *f = AT(g->r[REG_F], base);
+	v16 *sp = AT(g->sp, base);
+	v16 *pcs = AT(g->pc, base);
+	uint8_t op = code[0];
+	uint16_t word = code[1] | code[2] << 8;
+	m8 m = lane_mask(mask);
+	m16 m2 = __builtin_convertvector(m, m16);
+	v16 next = (v16) { 0 } + (uint16_t) (pc + length8080[op]);
+	/* the pair of BC, DE, HL in bits 4-5, and the registers of bits 3-5, 0-2 */
+	v8 *hi = AT(g->r[(op >> 3) & 6], base);
+	v8 *lo = AT(g->r[((op >> 3) & 6) + 1], base);
+	v8 *dst = AT(g->r[(op >> 3) & 7], base);
+	v8 *src = AT(g->r[op & 7], base);
+	v8 *h = AT(g->r[REG_H], base);
+	v8 *l = AT(g->r[REG_L], base);
+	v8 *d = AT(g->r[2], base);
+	v8 *e = AT(g->r[3], base);
+	v16 hl = PAIR(*h, *l);
+	v16 addr = (v16) { 0 } + word;
+	v8 imm = (v8) { 0 } + code[1];
+	v8 val;
+
+	switch (op) {
+	case 0x00:		/* NOP */
+		break;
+	case 0x01: case 0x11: case 0x21:	/* LXI */
+		*hi = BLEND8(m, (v8) { 0 } + code[2], *hi);
+		*lo = BLEND8(m, imm, *lo);
+		break;
+	case 0x31:		/* LXI SP */
+		*sp = BLEND16(m2, addr, *sp);
+		break;
+	case 0x02: case 0x12:	/* STAX */
+		addr = PAIR(*hi, *lo);
+		store(machines, mask, &addr, a);
+		break;
+	case 0x0a: case 0x1a:	/* LDAX */
+		addr = PAIR(*hi, *lo);
+		*a = BLEND8(m, load(machines, mask, &addr), *a);
+		break;
+	case 0x03: case 0x13: case 0x23:	/* INX */
+	case 0x0b: case 0x1b: case 0x2b:	/* DCX */
+		addr = PAIR(*hi, *lo) + (uint16_t) ((op & 8) ? 0xffff : 1);
+		*hi = BLEND8(m, HIGH(addr), *hi);
+		*lo = BLEND8(m, LOW(addr), *lo);
+		break;
+	case 0x33:		/* INX SP */
+		*sp = BLEND16(m2, *sp + 1, *sp);
+		break;
+	case 0x3b:		/* DCX SP */
+		*sp = BLEND16(m2, *sp - 1, *sp);
+		break;
+	case 0x04: case 0x0c: case 0x14: case 0x1c:	/* INR */
+	case 0x24: case 0x2c: case 0x3c:
+		val = *dst + 1;
+		*dst = BLEND8(m, val, *dst);
+		*f = BLEND8(m, (*f & FLAG_CY) | zsp(&val)
+			    | ((v8) ((val & 0xf) == 0) & FLAG_AC), *f);
+		break;
+	case 0x05: case 0x0d: case 0x15: case 0x1d:	/* DCR */
+	case 0x25: case 0x2d: case 0x3d:
+		val = *dst - 1;
+		*dst = BLEND8(m, val, *dst);
+		*f = BLEND8(m, (*f & FLAG_CY) | zsp(&val)
+			    | ((v8) ((val & 0xf) != 0xf) & FLAG_AC), *f);
+		break;
+	case 0x06: case 0x0e: case 0x16: case 0x1e:	/* MVI */
+	case 0x26: case 0x2e: case 0x3e:
+		*dst = BLEND8(m, imm, *dst);
+		break;
+	case 0x36:		/* MVI M */
+		store(machines, mask, &hl, &imm);
+		break;
+	case 0x07:		/* RLC */
+		val = *a >> 7;
+		*a = BLEND8(m, (*a << 1) | val, *a);
+		*f = BLEND8(m, (*f & ~FLAG_CY) | val, *f);
+		break;
+	case 0x0f:		/* RRC */
+		val = *a & 1;
+		*a = BLEND8(m, (*a >> 1) | (val << 7), *a);
+		*f = BLEND8(m, (*f & ~FLAG_CY) | val, *f);
+		break;
+	case 0x17:		/* RAL */
+		val = *a >> 7;
+		*a = BLEND8(m, (*a << 1) | (*f & FLAG_CY), *a);
+		*f = BLEND8(m, (*f & ~FLAG_CY) | val, *f);
+		break;
+	case 0x1f:		/* RAR */
+		val = *a & 1;
+		*a = BLEND8(m, (*a >> 1) | ((*f & FLAG_CY) << 7), *a);
+		*f = BLEND8(m, (*f & ~FLAG_CY) | val, *f);
+		break;
+	case 0x09: case 0x19: case 0x29:	/* DAD */
+	{
+		v16 pair = PAIR(*hi, *lo);
+		/* the carry out of bit 15 */
+		addr = hl + pair;
+		val = HIGH((hl & pair) | ((hl | pair) & ~addr)) >> 7;
+		*h = BLEND8(m, HIGH(addr), *h);
+		*l = BLEND8(m, LOW(addr), *l);
+		*f = BLEND8(m, (*f & ~FLAG_CY) | val, *f);
+		break;
+	}
+	case 0x2f:		/* CMA */
+		*a = BLEND8(m, ~*a, *a);
+		break;
+	case 0x37:		/* STC */
+		*f = BLEND8(m, *f | FLAG_CY, *f);
+		break;
+	case 0x3f:		/* CMC */
+		*f = BLEND8(m, *f ^ FLAG_CY, *f);
+		break;
+	case 0x32:		/* STA */
+		store(machines, mask, &addr, a);
+		break;
+	case 0x3a:		/* LDA */
+		*a = BLEND8(m, load(machines, mask, &addr), *a);
+		break;
+	case 0xc3:		/* JMP */
+		next = addr;
+		break;
+	case 0xc2: case 0xca: case 0xd2: case 0xda:	/* Jcc */
+	case 0xe2: case 0xea: case 0xf2: case 0xfa:
+		next = BLEND16(__builtin_convertvector(condition(op, f), m16),
+			       addr, next);
+		break;
+	case 0xcd:		/* CALL */
+		push(machines, mask, sp, &next);
+		next = addr;
+		break;
+	case 0xc4: case 0xcc: case 0xd4: case 0xdc:	/* Ccc */
+	case 0xe4: case 0xec: case 0xf4: case 0xfc:
+	{
+		m8 taken = condition(op, f) & m;
+		push(machines, bits(&taken), sp, &next);
+		next = BLEND16(__builtin_convertvector(taken, m16), addr, next);
+		break;
+	}
+	case 0xc9:		/* RET */
+		next = pop(machines, mask, sp);
+		break;
+	case 0xc0: case 0xc8: case 0xd0: case 0xd8:	/* Rcc */
+	case 0xe0: case 0xe8: case 0xf0: case 0xf8:
+	{
+		m8 taken = condition(op, f) & m;
+		next = BLEND16(__builtin_convertvector(taken, m16),
+			       pop(machines, bits(&taken), sp), next);
+		break;
+	}
+	case 0xc5: case 0xd5: case 0xe5:	/* PUSH */
+		addr = PAIR(*hi, *lo);
+		push(machines, mask, sp, &addr);
+		break;
+	case 0xf5:		/* PUSH PSW */
+		addr = PAIR(*a, *f);
+		push(machines, mask, sp, &addr);
+		break;
+	case 0xc1: case 0xd1: case 0xe1: case 0xf1:	/* POP */
+		if (0xf1 == op) {
+			hi = a;
+			lo = f;
+		}
+		addr = pop(machines, mask, sp);
+		*hi = BLEND8(m, HIGH(addr), *hi);
+		*lo = BLEND8(m, LOW(addr), *lo);
+		break;
+	case 0xc6: case 0xce: case 0xd6: case 0xde:	/* ALU immediate */
+	case 0xe6: case 0xee: case 0xf6: case 0xfe:
+		alu(a, f, op, &m, &imm);
+		break;
+	case 0xe9:		/* PCHL */
+		next = hl;
+		break;
+	case 0xf9:		/* SPHL */
+		*sp = BLEND16(m2, hl, *sp);
+		break;
+	case 0xeb:		/* XCHG */
+		*h = BLEND8(m, *d, *h);
+		*l = BLEND8(m, *e, *l);
+		*d = BLEND8(m, HIGH(hl), *d);
+		*e = BLEND8(m, LOW(hl), *e);
+		break;
+	case 0xf3:		/* DI */
+	case 0xfb:		/* EI */
+	{
+		v8 *ie = AT(g->int_enable, base);
+		*ie = BLEND8(m, (v8) { 0 } + ((op >> 3) & 1), *ie);
+		break;
+	}
+	default:
+		if (op >= 0x40 && op < 0x80 && op != 0x76) {	/* MOV */
+			val = REG_M == (op & 7) ? load(machines, mask, &hl) : *src;
+			if (REG_M == ((op >> 3) & 7))
+				store(machines, mask, &hl, &val);
+			else
+				*dst = BLEND8(m, val, *dst);
+			break;
+		}
+		if (op >= 0x80 && op < 0xc0) {	/* ALU */
+			val = REG_M == (op & 7) ? load(machines, mask, &hl) : *src;
+			alu(a, f, op, &m, &val);
+			break;
+		}
+		return 0;
+	}
+
+	*pcs = BLEND16(m2, next, *pcs);
+	*(m16 *) AT(g->cycles, base) += m2 & cycles8080[op];
+	return 1;
+}
+
+/*
+ * Runs the lanes of mask, all at pc, through the code there for as
+ * long as they stay together, short of their budget and short of
+ * limit, where other lanes wait to join them. Further code is taken
+ * from the ROM, which every lane has.
+ * Returns the instructions it ran, 0 if the first has no kernel.
+ */
+KERNELS
+static int vector_run (struct lockstep *g, uint32_t mask, uint16_t pc,
+		       const uint8_t *code, uint16_t limit)
+{
+	const uint8_t *rom = g->machines[__builtin_ctz(mask)]->cpu.memory;
+	int lanes;
+	int steps = 0;
+
+	lanes = __builtin_popcount(mask);
+
+	for (;;) {
+		uint32_t together = 0;
+
+		for (int base = 0; base < g->lanes; base += VECTOR_LANES) {
+			uint32_t some = (mask >> base) & ((1u << VECTOR_LANES) - 1);
+
+			if (some && !vector_step(g, base, some, pc, code))
+				return steps;
+		}
+		steps++;
+		g->vector_steps++;
+		g->vector_lanes += lanes;
+
+		pc = g->pc[__builtin_ctz(mask)];
+		if (pc >= limit || pc + 3 > ROM_SIZE)
+			return steps;
+		for (int base = 0; base < g->lanes; base += VECTOR_LANES)
+			together |= lanes_at(g, base, pc) << base;
+		if (together != mask)
+			return steps;
+		code = &rom[pc];
+	}
+}
+
+/* the registers of a lane to its machine, and back */
+static void lane_out (struct lockstep *g, int i)
+{
+	cpu8080_state *cpu = &g->machines[i]->cpu;
+
+	cpu->b = g->r[0][i];
+	cpu->c = g->r[1][i];
+	cpu->d = g->r[2][i];
+	cpu->e = g->r[3][i];
+	cpu->h = g->r[REG_H][i];
+	cpu->l = g->r[REG_L][i];
+	cpu->a = g->r[REG_A][i];
+	*(uint8_t *) &cpu->flags = g->r[REG_F][i];
+	cpu->lazy_op = 0;
+	cpu->sp = g->sp[i];
+	cpu->pc = g->pc[i];
+	cpu->int_enable = g->int_enable[i];
+}
+
+static void lane_in (struct lockstep *g, int i)
+{
+	const cpu8080_state *cpu = &g->machines[i]->cpu;
+
+	g->r[0][i] = cpu->b;
+	g->r[1][i] = cpu->c;
+	g->r[2][i] = cpu->d;
+	g->r[3][i] = cpu->e;
+	g->r[REG_H][i] = cpu->h;
+	g->r[REG_L][i] = cpu->l;
+	g->r[REG_A][i] = cpu->a;
+	g->r[REG_F][i] = *(const uint8_t *) &cpu->flags;
+	g->sp[i] = cpu->sp;
+	g->pc[i] = cpu->pc;
+	g->int_enable[i] = cpu->int_enable;
+}
+
+/*
+ * Runs every lane until it is through its budget.
+ * Returns 0, or -1 on an invalid opcode.
+ */
+static int run_half (struct lockstep *g)
+{
+	for (;;) {
+		uint16_t pc, limit;
+		uint32_t mask = next_lanes(g, &pc, &limit);
+		uint8_t code[3];
+		int first;
+
+		if (0 == mask)
+			return 0;
+
+		/* below the RAM it is the ROM every lane has */
+		first = __builtin_ctz(mask);
+		for (int k = 0; k < 3; k++)
+			code[k] = g->machines[first]->cpu.memory[(uint16_t) (pc + k)];
+		if (pc + 3 > ROM_SIZE)
+			FOR_LANES(i, mask)
+				for (int k = 0; k < length8080[code[0]]; k++)
+					if (g->machines[i]->cpu.memory[(uint16_t) (pc + k)]
+					    != code[k])
+						mask &= ~(1u << i);
+
+		if (mask & (mask - 1) && vector_run(g, mask, pc, code, limit))
+			continue;
+		FOR_LANES(i, mask) {
+			int cycles;
+
+			lane_out(g, i);
+			cycles = emulate8080(&g->machines[i]->cpu);
+			if (cycles < 0)
+				return -1;
+			lane_in(g, i);
+			g->cycles[i] += cycles;
+			g->scalar_lanes++;
+		}
+	}
+}
+
+int lockstep_init (struct lockstep *group, struct invaders **machines,
+		   int lanes)
+{
+	if (lanes < 1 || lanes > LOCKSTEP_LANES) {
+		fprintf(stderr, "Lockstep takes 1 to %d lanes\n", LOCKSTEP_LANES);
+		return -1;
+	}
+	group->lanes = lanes;
+	for (int i = 0; i < LOCKSTEP_LANES; i++) {
+		group->machines[i] = i < lanes ? machines[i] : NULL;
+		if (i < lanes)
+			lane_in(group, i);
+		/* lanes past the end never run */
+		group->cycles[i] = 0;
+		group->budget[i] = 0;
+	}
+	group->vector_steps = 0;
+	group->vector_lanes = 0;
+	group->scalar_lanes = 0;
+	return 0;
+}
+
+int lockstep_run_frame (struct lockstep *g)
+{
+	uint64_t start[LOCKSTEP_LANES];
+	int done[LOCKSTEP_LANES] = { 0 };
+	int over[LOCKSTEP_LANES];
+
+	/* the same budgets and interrupts as run_frame in 8080.c */
+	for (int i = 0; i < g->lanes; i++) {
+		start[i] = g->machines[i]->cpu.cycles;
+		g->budget[i] = HALF_FRAME_CYCLES - g->machines[i]->cpu.frame_ahead;
+		g->cycles[i] = 0;
+	}
+	for (int half = 0; half < 2; half++) {
+		if (run_half(g) < 0)
+			return -1;
+		for (int i = 0; i < g->lanes; i++) {
+			over[i] = g->cycles[i] - g->budget[i];
+			done[i] += g->cycles[i];
+			if (g->int_enable[i]) {
+				lane_out(g, i);
+				generate_interrupt(&g->machines[i]->cpu, half + 1);
+				lane_in(g, i);
+			}
+			g->budget[i] = FRAME_CYCLES - HALF_FRAME_CYCLES - over[i];
+			g->cycles[i] = 0;
+		}
+	}
+	for (int i = 0; i < g->lanes; i++) {
+		g->machines[i]->cpu.frame_ahead = over[i];
+		g->machines[i]->cpu.cycles = start[i] + done[i];
+		g->budget[i] = 0;
+	}
+	return 0;
+}
+
+void lockstep_sync (struct lockstep *group)
+{
+	for (int i = 0; i < group->lanes; i++)
+		lane_out(group, i);
+}
+
+double lockstep_utilization (const struct lockstep *group)
+{
+	if (0 == group->vector_steps)
+		return 0;
+	return (double) group->vector_lanes
+		/ (group->vector_steps * group->lanes);
+}
+
+double lockstep_vectorized (const struct lockstep *group)
+{
+	uint64_t all = group->vector_lanes + group->scalar_lanes;
+
+	return all ? (double) group->vector_lanes / all : 0;
+}
+
+const char *lockstep_kernel (void)
+{
+#if defined(__x86_64__) && !defined(LOCKSTEP_NO_AVX2)
+	if (__builtin_cpu_supports("avx2"))
+		return "avx2";
+#endif
+	return "generic";
+}
@@ -0,0 +1,84 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <stdint.h>
+
+#include "invaders.h"
+
+/*
+ * Lockstep: up to LOCKSTEP_LANES machines running the same ROM, one
+ * lane each, with their registers kept side by side in arrays so one
+ * vector instruction works on every lane (AVX2 when the host has it).
+ * Lanes at the same pc run the instruction there together; one on
+ * its own, or on an instruction without a vector kernel (I/O, RST,
+ * DAA, HLT and a few rare ones), runs it through emulate8080.
+ * Lanes that went apart come back together at the lowest pc first,
+ * which is where the others are headed in loops.
+ * Lanes only differ in what their machines see: memory, ports and
+ * inputs, which stay in the machines.
+ */
+#define LOCKSTEP_LANES 32
+
+struct lockstep {
+	int lanes;
+	struct invaders *machines[LOCKSTEP_LANES];
+
+	/*
+	 * The registers by their number in the opcodes, B, C, D, E,
+	 * H, L, then the flags where the opcodes have M, and A
+	 */
+	uint8_t r[8][LOCKSTEP_LANES] __attribute__((aligned(64)));
+	uint8_t int_enable[LOCKSTEP_LANES] __attribute__((aligned(64)));
+	uint16_t sp[LOCKSTEP_LANES] __attribute__((aligned(64)));
+	uint16_t pc[LOCKSTEP_LANES] __attribute__((aligned(64)));
+	/* cycles run of the half frame, and until the interrupt */
+	int16_t cycles[LOCKSTEP_LANES] __attribute__((aligned(64)));
+	int16_t budget[LOCKSTEP_LANES] __attribute__((aligned(64)));
+
+	/* instructions run, by lanes at once and by lanes on their own */
+	uint64_t vector_steps;
+	uint64_t vector_lanes;
+	uint64_t scalar_lanes;
+};
+
+/*
+ * Takes the registers of lanes machines (at most LOCKSTEP_LANES, 8,
+ * 16 or 32 make the most of the vectors), loaded with the same ROM.
+ * From there on the registers of the machines are the group's, until
+ * lockstep_sync. Returns 0 on success, -1 on too many lanes.
+ */
+int lockstep_init (struct lockstep *group, struct invaders **machines,
+		   int lanes);
+
+/*
+ * run_until_frame for every lane: each one runs its own frame, with
+ * the same interrupts at the same cycles as on its own.
+ * Returns 0, or -1 on an invalid opcode in some lane.
+ */
+int lockstep_run_frame (struct lockstep *group);
+
+/*
+ * Writes the registers back to the machines, to look at them or run
+ * them on their own. The group can go on afterwards, as long as the
+ * machines were not run in between.
+ */
+void lockstep_sync (struct lockstep *group);
+
+/*
+ * Lane utilisation: the share of lanes doing the work of the vector
+ * steps, 1 when every vector step had every lane.
+ */
+double lockstep_utilization (const struct lockstep *group);
+
+/*
+ * The share of all instructions run by the lanes that ran in vector
+ * steps rather than on their own.
+ */
+double lockstep_vectorized (const struct lockstep *group);
+
+/*
+ * The vector kernels in use: "avx2" or "generic".
+ */
+const char *lockstep_kernel (void);
+
+#endif
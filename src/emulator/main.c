@@ -0,0 +1,886 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "8080.h"
+#include "batch.h"
+#include "cputest.h"
+#include "env.h"
+#include "framebuffer.h"
+#include "invaders.h"
+#include "lockstep.h"
+#include "movie.h"
+#include "profile.h"
+#include "rewind.h"
+#include "rom.h"
+#include "savestate.h"
+#include "trace.h"
+
+/* 500 seconds of a 2 MHz 8080 */
+#define BENCH_CYCLES 1000000000LL
+
+/*
+ * Runs the game headless for BENCH_CYCLES, a frame at a time. With
+ * count set, it single steps instead and stores how many instructions
+ * that took.
+ */
+static long long bench_run (struct invaders *machine, long long *count)
+{
+	long long done = 0;
+
+	if (count)
+		*count = 0;
+	while (done < BENCH_CYCLES) {
+		int cycles = count ? step_until_frame(&machine->cpu, count)
+				   : run_until_frame(&machine->cpu);
+		if (cycles < 0)
+			return -1;
+		done += cycles;
+	}
+	return done;
+}
+
+/*
+ * Prints how fast the dispatch loop runs the ROM. The run is
+ * deterministic, so the instructions are counted by a separate single
+ * stepped run that is not timed, which has to end up in the very same
+ * state: single steps never skip idle loops.
+ */
+static int benchmark (char *paths[], int count)
+{
+	struct rom rom;
+	struct invaders machine;
+	long long instructions;
+	uint64_t stepped;
+
+	if (rom_load(&rom, paths, count) < 0)
+		return -1;
+	if (invaders_init(&machine) < 0) {
+		rom_destroy(&rom);
+		return -1;
+	}
+	if (invaders_load(&machine, &rom) < 0)
+		goto error;
+	if (bench_run(&machine, &instructions) < 0)
+		goto error;
+	stepped = movie_hash(&machine);
+
+	if (invaders_load(&machine, &rom) < 0)
+		goto error;
+	clock_t start = clock();
+	long long done = bench_run(&machine, NULL);
+	if (done < 0)
+		goto error;
+	double secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+	if (movie_hash(&machine) != stepped) {
+		fprintf(stderr, "The run ended apart from the single stepped one\n");
+		goto error;
+	}
+
+	printf("%s\n", cpu8080_engine(&machine.cpu));
+	printf("%lld cycles in %.3f s, %.1f emulated MHz, %.1f MIPS\n",
+	       done, secs, done / secs / 1e6, instructions / secs / 1e6);
+	invaders_destroy(&machine);
+	rom_destroy(&rom);
+	return 0;
+
+error:
+	invaders_destroy(&machine);
+	rom_destroy(&rom);
+	return -1;
+}
+
+/* frames played before the conversion is timed, to have a busy screen */
+#define FB_WARMUP 1000
+#define FB_CONVERSIONS 20000
+/* frames played with a conversion after each one */
+#define FB_FRAMES 20000
+
+/*
+ * Prints how fast the framebuffer is converted: whole screens, then
+ * a frame after frame conversion of only what changed, as a headless
+ * player would do it.
+ */
+static int framebuffer_benchmark (char *paths[], int count)
+{
+	static uint32_t rgba[FRAMEBUFFER_WIDTH * FRAMEBUFFER_HEIGHT];
+	static uint8_t gray[FRAMEBUFFER_WIDTH * FRAMEBUFFER_HEIGHT];
+	struct rom rom;
+	struct invaders machine;
+	long long rows = 0;
+
+	if (rom_load(&rom, paths, count) < 0)
+		return -1;
+	if (invaders_init(&machine) < 0) {
+		rom_destroy(&rom);
+		return -1;
+	}
+	if (invaders_load(&machine, &rom) < 0)
+		goto error;
+	for (int i = 0; i < FB_WARMUP; i++)
+		if (run_until_frame(&machine.cpu) < 0)
+			goto error;
+
+	clock_t start = clock();
+	for (int i = 0; i < FB_CONVERSIONS; i++) {
+		machine.cpu.video_dirty = 0xffffffff;
+		framebuffer_rgba(&machine.cpu, rgba, 0xffffffff, 0xff000000);
+	}
+	double rgba_secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+	start = clock();
+	for (int i = 0; i < FB_CONVERSIONS; i++) {
+		machine.cpu.video_dirty = 0xffffffff;
+		framebuffer_gray(&machine.cpu, gray, 0xff, 0x00);
+	}
+	double gray_secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+	for (int i = 0; i < FB_FRAMES; i++) {
+		if (run_until_frame(&machine.cpu) < 0)
+			goto error;
+		rows += framebuffer_rgba(&machine.cpu, rgba, 0xffffffff, 0xff000000);
+	}
+
+	printf("framebuffer: %s\n", framebuffer_kernel());
+	printf("full screen: %.0f rgba/s, %.0f gray/s\n",
+	       FB_CONVERSIONS / rgba_secs, FB_CONVERSIONS / gray_secs);
+	printf("while playing: %.1f of %d rows converted per frame\n",
+	       (double) rows / FB_FRAMES, FRAMEBUFFER_HEIGHT);
+	invaders_destroy(&machine);
+	rom_destroy(&rom);
+	return 0;
+
+error:
+	invaders_destroy(&machine);
+	rom_destroy(&rom);
+	return -1;
+}
+
+/* a minute into the game, where the checkpoint is taken */
+#define STATE_WARMUP 3600
+#define STATE_RESTORES 100000
+/* frames played from the checkpoint, twice, to check they replay */
+#define STATE_FRAMES 600
+
+/*
+ * Prints how fast a checkpoint is saved and restored, against getting
+ * back to it by running from reset, and checks the machine restored
+ * and another one forked by restoring into it play the same frames.
+ */
+static int state_benchmark (char *paths[], int count)
+{
+	static uint8_t checkpoint[SAVESTATE_SIZE];
+	static uint8_t played[2][SAVESTATE_SIZE];
+	struct rom rom;
+	struct invaders machine;
+	struct invaders child;
+
+	if (rom_load(&rom, paths, count) < 0)
+		return -1;
+	if (invaders_init(&machine) < 0) {
+		rom_destroy(&rom);
+		return -1;
+	}
+	if (invaders_init(&child) < 0) {
+		invaders_destroy(&machine);
+		rom_destroy(&rom);
+		return -1;
+	}
+	if (invaders_load(&machine, &rom) < 0 || invaders_load(&child, &rom) < 0)
+		goto error;
+
+	clock_t start = clock();
+	for (int i = 0; i < STATE_WARMUP; i++)
+		if (run_until_frame(&machine.cpu) < 0)
+			goto error;
+	double warmup_secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+	start = clock();
+	for (int i = 0; i < STATE_RESTORES; i++)
+		if (savestate_save(&machine, checkpoint, sizeof(checkpoint)) < 0)
+			goto error;
+	double save_secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+	start = clock();
+	for (int i = 0; i < STATE_RESTORES; i++)
+		if (savestate_restore(&machine, checkpoint, sizeof(checkpoint)) < 0)
+			goto error;
+	double restore_secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+
+	/* the machine replays from the checkpoint, and a fork of it */
+	if (savestate_restore(&machine, checkpoint, sizeof(checkpoint)) < 0
+	    || savestate_restore(&child, checkpoint, sizeof(checkpoint)) < 0)
+		goto error;
+	for (int i = 0; i < STATE_FRAMES; i++)
+		if (run_until_frame(&machine.cpu) < 0
+		    || run_until_frame(&child.cpu) < 0)
+			goto error;
+	savestate_save(&machine, played[0], sizeof(played[0]));
+	savestate_save(&child, played[1], sizeof(played[1]));
+
+	printf("save state: %d bytes, version %d\n", SAVESTATE_SIZE,
+	       SAVESTATE_VERSION);
+	printf("%d frames from reset: %.3f ms, save: %.2f us, restore: %.2f us\n",
+	       STATE_WARMUP, warmup_secs * 1e3,
+	       save_secs / STATE_RESTORES * 1e6,
+	       restore_secs / STATE_RESTORES * 1e6);
+	printf("replays from the checkpoint: %s\n",
+	       memcmp(played[0], played[1], SAVESTATE_SIZE) ? "differ" : "match");
+	invaders_destroy(&child);
+	invaders_destroy(&machine);
+	rom_destroy(&rom);
+	return 0;
+
+error:
+	invaders_destroy(&child);
+	invaders_destroy(&machine);
+	rom_destroy(&rom);
+	return -1;
+}
+
+/* ten minutes of 60 Hz frames in at most 64 MB, played twice over */
+#define REWIND_FRAMES (600 * 60)
+#define REWIND_BYTES (64 << 20)
+#define REWIND_STEPS 600
+
+static double elapsed (clock_t start)
+{
+	return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+/*
+ * Prints what the rewind buffer holds after twice its length of
+ * frames, and how fast it records a frame and gets one back.
+ */
+static int rewind_benchmark (char *paths[], int count)
+{
+	struct rom rom;
+	struct invaders machine;
+	struct rewind_buffer rw;
+	double push_secs = 0;
+	double step_secs = 0;
+	double worst = 0;
+
+	if (rom_load(&rom, paths, count) < 0)
+		return -1;
+	if (rewind_init(&rw, REWIND_FRAMES, REWIND_BYTES) < 0) {
+		rom_destroy(&rom);
+		return -1;
+	}
+	if (invaders_init(&machine) < 0) {
+		rewind_destroy(&rw);
+		rom_destroy(&rom);
+		return -1;
+	}
+	if (invaders_load(&machine, &rom) < 0)
+		goto error;
+
+	for (int i = 0; i < 2 * REWIND_FRAMES; i++) {
+		if (run_until_frame(&machine.cpu) < 0)
+			goto error;
+		clock_t start = clock();
+		if (rewind_push(&rw, &machine) < 0)
+			goto error;
+		push_secs += elapsed(start);
+	}
+	int frames = rewind_frames(&rw);
+	size_t used = rewind_used(&rw);
+
+	for (int i = 0; i < REWIND_STEPS; i++) {
+		clock_t start = clock();
+		if (rewind_back(&rw, &machine, 1) < 0)
+			goto error;
+		double secs = elapsed(start);
+		step_secs += secs;
+		if (secs > worst)
+			worst = secs;
+	}
+	clock_t start = clock();
+	if (rewind_back(&rw, &machine, rewind_frames(&rw)) < 0)
+		goto error;
+	double oldest_secs = elapsed(start);
+
+	printf("rewind: %d frames back in %.1f MB, %.0f bytes per frame\n",
+	       frames, used / 1048576.0, (double) used / (frames + 1));
+	printf("push: %.2f us, step back: %.2f us (worst %.2f us), "
+	       "to the oldest: %.2f us\n", push_secs / (2 * REWIND_FRAMES) * 1e6,
+	       step_secs / REWIND_STEPS * 1e6, worst * 1e6, oldest_secs * 1e6);
+	invaders_destroy(&machine);
+	rewind_destroy(&rw);
+	rom_destroy(&rom);
+	return 0;
+
+error:
+	invaders_destroy(&machine);
+	rewind_destroy(&rw);
+	rom_destroy(&rom);
+	return -1;
+}
+
+/* ten minutes of play for the recorded movie */
+#define MOVIE_FRAMES (600 * 60)
+
+/*
+ * The player of the recorded movie: puts in a coin and starts every
+ * 30 s, which is enough for a new game whenever the last one is over,
+ * and moves and fires at random, the same way every time
+ */
+static void play (struct invaders *machine, int frame, uint32_t *seed)
+{
+	if (120 == frame % 1800) {
+		invaders_input(machine, INVADERS_COIN, 1);
+		return;
+	}
+	invaders_input(machine, INVADERS_COIN, 0);
+	invaders_input(machine, INVADERS_P1_START, 180 == frame % 1800);
+	if (frame % 8)
+		return;
+	*seed = *seed * 1103515245 + 12345;
+	invaders_input(machine, INVADERS_P1_LEFT, (*seed >> 16) % 3 == 0);
+	invaders_input(machine, INVADERS_P1_RIGHT, (*seed >> 16) % 3 == 1);
+	invaders_input(machine, INVADERS_P1_FIRE, (*seed >> 20) & 1);
+}
+
+/*
+ * Records MOVIE_FRAMES frames of scripted play to a movie, with
+ * movie as the first path.
+ */
+static int record_movie (char *paths[], int count)
+{
+	struct rom rom;
+	struct invaders machine;
+	struct movie movie;
+	uint32_t seed = 1;
+
+	if (rom_load(&rom, paths + 1, count - 1) < 0)
+		return -1;
+	if (invaders_init(&machine) < 0) {
+		rom_destroy(&rom);
+		return -1;
+	}
+	movie_init(&movie);
+	if (invaders_load(&machine, &rom) < 0)
+		goto error;
+
+	for (int i = 0; i < MOVIE_FRAMES; i++) {
+		play(&machine, i, &seed);
+		if (run_until_frame(&machine.cpu) < 0)
+			goto error;
+		if (movie_record(&movie, &machine) < 0)
+			goto error;
+	}
+	if (movie_save(&movie, paths[0]) < 0)
+		goto error;
+	printf("%ld frames recorded to %s\n", movie.frames, paths[0]);
+	movie_destroy(&movie);
+	invaders_destroy(&machine);
+	rom_destroy(&rom);
+	return 0;
+
+error:
+	movie_destroy(&movie);
+	invaders_destroy(&machine);
+	rom_destroy(&rom);
+	return -1;
+}
+
+/*
+ * Replays the movie given as the first path and checks it against its
+ * hashes, the regression test of the core. Returns 1 if it diverged.
+ */
+static int replay_movie (char *paths[], int count)
+{
+	struct rom rom;
+	struct invaders machine;
+	struct movie movie;
+	int ret = -1;
+
+	movie_init(&movie);
+	if (movie_load(&movie, paths[0]) < 0)
+		return -1;
+	if (rom_load(&rom, paths + 1, count - 1) < 0) {
+		movie_destroy(&movie);
+		return -1;
+	}
+	if (invaders_init(&machine) < 0)
+		goto out;
+	if (invaders_load(&machine, &rom) < 0)
+		goto destroy;
+
+	clock_t start = clock();
+	long frames = movie_replay(&movie, &machine);
+	double secs = elapsed(start);
+	if (frames < 0)
+		goto destroy;
+
+	printf("%s\n", cpu8080_engine(&machine.cpu));
+	printf("%ld of %ld frames match, %.0f frames/s, %.0fx real time\n",
+	       frames, movie.frames, frames / secs, frames / secs / 60);
+	ret = frames == movie.frames ? 0 : 1;
+
+destroy:
+	invaders_destroy(&machine);
+out:
+	rom_destroy(&rom);
+	movie_destroy(&movie);
+	return ret;
+}
+
+/* a minute of scripted play, profiled */
+#define PROFILE_FRAMES (60 * 60)
+
+/*
+ * Plays PROFILE_FRAMES frames twice, the second time profiled, and
+ * writes the profile to the first path as text and, with .folded
+ * added, as collapsed stacks. Prints what profiling cost.
+ */
+static int profile_game (char *paths[], int count)
+{
+	char folded[4096];
+	struct rom rom;
+	struct invaders machine;
+	struct profile prof;
+	double secs[2];
+	FILE *out;
+
+	snprintf(folded, sizeof(folded), "%s.folded", paths[0]);
+	if (rom_load(&rom, paths + 1, count - 1) < 0)
+		return -1;
+	if (profile_init(&prof) < 0) {
+		rom_destroy(&rom);
+		return -1;
+	}
+	if (invaders_init(&machine) < 0) {
+		profile_destroy(&prof);
+		rom_destroy(&rom);
+		return -1;
+	}
+
+	for (int pass = 0; pass < 2; pass++) {
+		uint32_t seed = 1;
+
+		if (invaders_load(&machine, &rom) < 0)
+			goto error;
+		profile_attach(&machine.cpu, pass ? &prof : NULL);
+		clock_t start = clock();
+		for (int frame = 0; frame < PROFILE_FRAMES; frame++) {
+			play(&machine, frame, &seed);
+			if (run_until_frame(&machine.cpu) < 0)
+				goto error;
+		}
+		secs[pass] = elapsed(start);
+	}
+	profile_attach(&machine.cpu, NULL);
+
+	out = fopen(paths[0], "w");
+	if (!out || profile_write_flat(&prof, out) < 0) {
+		fprintf(stderr, "Could not write %s\n", paths[0]);
+		if (out)
+			fclose(out);
+		goto error;
+	}
+	fclose(out);
+	out = fopen(folded, "w");
+	if (!out || profile_write_collapsed(&prof, out) < 0) {
+		fprintf(stderr, "Could not write %s\n", folded);
+		if (out)
+			fclose(out);
+		goto error;
+	}
+	fclose(out);
+
+	printf("%d frames: %.3f s, profiled %.3f s (%.1fx), %d call paths\n",
+	       PROFILE_FRAMES, secs[0], secs[1], secs[1] / secs[0], prof.count);
+	printf("wrote %s and %s\n", paths[0], folded);
+	invaders_destroy(&machine);
+	profile_destroy(&prof);
+	rom_destroy(&rom);
+	return 0;
+
+error:
+	invaders_destroy(&machine);
+	profile_destroy(&prof);
+	rom_destroy(&rom);
+	return -1;
+}
+
+/* a minute of scripted play, traced */
+#define TRACE_FRAMES (60 * 60)
+
+/* seconds of wall clock, the trace writer runs beside the core */
+static double wall (void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+ * Plays TRACE_FRAMES frames twice, the second time traced to the
+ * first path, and prints how fast both ran and how large the trace is.
+ */
+static int trace_game (char *paths[], int count)
+{
+	struct rom rom;
+	struct invaders machine;
+	struct trace trace;
+	double secs[2];
+
+	if (rom_load(&rom, paths + 1, count - 1) < 0)
+		return -1;
+	if (invaders_init(&machine) < 0) {
+		rom_destroy(&rom);
+		return -1;
+	}
+
+	for (int pass = 0; pass < 2; pass++) {
+		uint32_t seed = 1;
+
+		if (invaders_load(&machine, &rom) < 0)
+			goto error;
+		if (pass && trace_start(&trace, paths[0], &machine.cpu) < 0)
+			goto error;
+		double start = wall();
+		for (int frame = 0; frame < TRACE_FRAMES; frame++) {
+			play(&machine, frame, &seed);
+			if (run_until_frame(&machine.cpu) < 0) {
+				if (pass)
+					trace_stop(&trace, &machine.cpu);
+				goto error;
+			}
+		}
+		if (pass && trace_stop(&trace, &machine.cpu) < 0)
+			goto error;
+		secs[pass] = wall() - start;
+	}
+
+	printf("%d frames: %.0fx real time, traced %.0fx real time\n",
+	       TRACE_FRAMES, TRACE_FRAMES / (double) FRAME_HZ / secs[0],
+	       TRACE_FRAMES / (double) FRAME_HZ / secs[1]);
+	printf("%llu instructions in %.1f MB, %.1f bytes each, "
+	       "ring full %ld times\n", (unsigned long long) trace.records,
+	       trace.bytes / 1048576.0, (double) trace.bytes / trace.records,
+	       trace.waits);
+	invaders_destroy(&machine);
+	rom_destroy(&rom);
+	return 0;
+
+error:
+	invaders_destroy(&machine);
+	rom_destroy(&rom);
+	return -1;
+}
+
+/* 10 s of scripted play each */
+#define BATCH_JOBS 256
+#define BATCH_FRAMES 600
+
+static void batch_play (struct invaders *machine, long frame, void *arg)
+{
+	play(machine, frame, arg);
+}
+
+/*
+ * Runs a batch of machines on one thread, then on every CPU, and
+ * prints how the emulated MHz of all of them together scale. Both
+ * runs must end every machine in the same state.
+ */
+static int batch_benchmark (char *paths[], int count)
+{
+	static struct batch_job jobs[BATCH_JOBS];
+	static uint32_t seeds[BATCH_JOBS];
+	uint64_t hashes[BATCH_JOBS];
+	struct batch_stats stats[2];
+	struct rom rom;
+	int same = 1;
+
+	if (rom_load(&rom, paths, count) < 0)
+		return -1;
+
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < BATCH_JOBS; i++) {
+			seeds[i] = i + 1;
+			jobs[i].rom = &rom;
+			jobs[i].input = batch_play;
+			jobs[i].arg = &seeds[i];
+			jobs[i].frames = BATCH_FRAMES;
+		}
+		if (batch_run(jobs, BATCH_JOBS, pass ? 0 : 1, &stats[pass]) < 0) {
+			rom_destroy(&rom);
+			return -1;
+		}
+		for (int i = 0; i < BATCH_JOBS; i++) {
+			if (jobs[i].status < 0) {
+				fprintf(stderr, "Batch job %d failed\n", i);
+				rom_destroy(&rom);
+				return -1;
+			}
+			if (pass)
+				same &= hashes[i] == jobs[i].hash;
+			hashes[i] = jobs[i].hash;
+		}
+	}
+
+	for (int pass = 0; pass < 2; pass++)
+		printf("%d threads: %d machines in %.3f s, %.1f emulated MHz, "
+		       "%ld stolen\n", stats[pass].threads, BATCH_JOBS,
+		       stats[pass].secs, stats[pass].mhz, stats[pass].steals);
+	printf("speedup: %.2fx, machines end the same: %s\n",
+	       stats[1].mhz / stats[0].mhz, same ? "yes" : "no");
+	rom_destroy(&rom);
+	return same ? 0 : 1;
+}
+
+/* 10 s of scripted play */
+#define LOCKSTEP_FRAMES 600
+
+/*
+ * Runs lanes of the machines in lockstep, each with its own scripted play,
+ * and then the same machines one after the other with run_until_frame.
+ * Prints the emulated MHz of both and how much the vectors were used.
+ * Returns 1 if a machine did not end the same both ways.
+ */
+static int lockstep_lanes (struct rom *rom, struct invaders *machines,
+			   int lanes)
+{
+	struct invaders *group_machines[LOCKSTEP_LANES];
+	uint64_t hashes[LOCKSTEP_LANES];
+	uint32_t seeds[LOCKSTEP_LANES];
+	struct lockstep group;
+	uint64_t cycles = 0;
+	double secs[2];
+	int same = 1;
+
+	for (int pass = 0; pass < 2; pass++) {
+		for (int i = 0; i < lanes; i++) {
+			if (invaders_load(&machines[i], rom) < 0)
+				return -1;
+			group_machines[i] = &machines[i];
+			seeds[i] = i + 1;
+		}
+
+		clock_t start = clock();
+		if (0 == pass) {
+			if (lockstep_init(&group, group_machines, lanes) < 0)
+				return -1;
+			for (int frame = 0; frame < LOCKSTEP_FRAMES; frame++) {
+				for (int i = 0; i < lanes; i++)
+					play(&machines[i], frame, &seeds[i]);
+				if (lockstep_run_frame(&group) < 0)
+					return -1;
+			}
+			lockstep_sync(&group);
+		} else {
+			for (int i = 0; i < lanes; i++)
+				for (int frame = 0; frame < LOCKSTEP_FRAMES; frame++) {
+					play(&machines[i], frame, &seeds[i]);
+					if (run_until_frame(&machines[i].cpu) < 0)
+						return -1;
+				}
+		}
+		secs[pass] = elapsed(start);
+
+		for (int i = 0; i < lanes; i++) {
+			uint64_t hash = movie_hash(&machines[i]);
+			if (pass)
+				same &= hashes[i] == hash;
+			hashes[i] = hash;
+			cycles += pass ? machines[i].cpu.cycles : 0;
+		}
+	}
+
+	printf("%2d lanes: lockstep %.1f emulated MHz, one by one %.1f, "
+	       "utilisation %.1f%%, %.1f%% vectorised, same: %s\n", lanes,
+	       cycles / secs[0] / 1e6, cycles / secs[1] / 1e6,
+	       100 * lockstep_utilization(&group),
+	       100 * lockstep_vectorized(&group), same ? "yes" : "no");
+	return same ? 0 : 1;
+}
+
+/*
+ * The lockstep runner with 8, 16 and 32 lanes
+ */
+static int lockstep_benchmark (char *paths[], int count)
+{
+	static struct invaders machines[LOCKSTEP_LANES];
+	struct rom rom;
+	int initialised = 0;
+	int ret = -1;
+
+	if (rom_load(&rom, paths, count) < 0)
+		return -1;
+	for (; initialised < LOCKSTEP_LANES; initialised++)
+		if (invaders_init(&machines[initialised]) < 0)
+			goto out;
+
+	printf("vector kernels: %s\n", lockstep_kernel());
+	ret = 0;
+	for (int lanes = 8; lanes <= LOCKSTEP_LANES && ret >= 0; lanes *= 2) {
+		int diverged = lockstep_lanes(&rom, machines, lanes);
+		ret = diverged < 0 ? -1 : ret | diverged;
+	}
+
+out:
+	while (initialised--)
+		invaders_destroy(&machines[initialised]);
+	rom_destroy(&rom);
+	return ret;
+}
+
+/* a minute of play in each environment, long enough for games to end */
+#define ENV_COUNT 64
+#define ENV_STEPS (60 * 60)
+
+/*
+ * Steps a batch of environments with random buttons and prints how
+ * many frames a second that makes, observations included, and how
+ * the episodes went.
+ */
+static int env_benchmark (char *paths[], int count)
+{
+	static uint8_t obs[ENV_COUNT * ENV_OBS_SIZE];
+	uint8_t actions[ENV_COUNT];
+	int32_t reward[ENV_COUNT];
+	uint8_t done[ENV_COUNT];
+	struct env_batch batch;
+	struct rom rom;
+	uint32_t seed = 1;
+	long points = 0;
+	long lit = 0;
+
+	if (rom_load(&rom, paths, count) < 0)
+		return -1;
+	if (env_init(&batch, &rom, ENV_COUNT) < 0) {
+		rom_destroy(&rom);
+		return -1;
+	}
+
+	clock_t start = clock();
+	for (int step = 0; step < ENV_STEPS; step++) {
+		for (int i = 0; i < ENV_COUNT; i++) {
+			seed = seed * 1103515245 + 12345;
+			actions[i] = (seed >> 16) & (ENV_FIRE | ENV_LEFT | ENV_RIGHT);
+		}
+		if (env_step_batch(&batch, actions, obs, reward, done) < 0) {
+			env_destroy(&batch);
+			rom_destroy(&rom);
+			return -1;
+		}
+		for (int i = 0; i < ENV_COUNT; i++)
+			points += reward[i];
+	}
+	double secs = elapsed(start);
+	for (int i = 0; i < ENV_OBS_SIZE; i++)
+		lit += !!obs[i];
+
+	printf("%d environments: %.0f steps/s, %.1f us a step, "
+	       "%ld episodes ended, %ld points\n", ENV_COUNT,
+	       ENV_COUNT * ENV_STEPS / secs, secs / ENV_STEPS * 1e6,
+	       batch.episodes, points);
+	printf("observation %dx%d, %ld pixels lit in the first\n",
+	       ENV_OBS_WIDTH, ENV_OBS_HEIGHT, lit);
+	env_destroy(&batch);
+	rom_destroy(&rom);
+	return 0;
+}
+
+/*
+ * Runs the random programs of cputest.h and writes their hashes to
+ * path, one per line, for the other engines to check against.
+ */
+static int record_programs (const char *path)
+{
+	static uint64_t hashes[CPUTEST_PROGRAMS];
+	FILE *f;
+
+	if (cputest_programs(hashes) < 0)
+		return -1;
+	f = fopen(path, "w");
+	if (NULL == f) {
+		fprintf(stderr, "Failed to create %s\n", path);
+		return -1;
+	}
+	for (int i = 0; i < CPUTEST_PROGRAMS; i++)
+		fprintf(f, "%016llx\n", (unsigned long long) hashes[i]);
+	if (fclose(f) != 0) {
+		fprintf(stderr, "Failed to write %s\n", path);
+		return -1;
+	}
+	printf("%d programs recorded to %s\n", CPUTEST_PROGRAMS, path);
+	return 0;
+}
+
+/*
+ * Runs the random programs and checks them against the hashes
+ * record_programs wrote to path. Returns 1 if any came out different.
+ */
+static int check_programs (const char *path)
+{
+	static uint64_t hashes[CPUTEST_PROGRAMS];
+	unsigned long long hash;
+	int first = -1;
+	int match = 0;
+	FILE *f;
+
+	if (cputest_programs(hashes) < 0)
+		return -1;
+	f = fopen(path, "r");
+	if (NULL == f) {
+		fprintf(stderr, "Failed to open %s\n", path);
+		return -1;
+	}
+	for (int i = 0; i < CPUTEST_PROGRAMS; i++) {
+		if (fscanf(f, "%llx", &hash) != 1) {
+			fprintf(stderr, "%s: only %d programs\n", path, i);
+			fclose(f);
+			return -1;
+		}
+		if (hash == hashes[i])
+			match++;
+		else if (first < 0)
+			first = i;
+	}
+	fclose(f);
+
+	printf("%d of %d programs match", match, CPUTEST_PROGRAMS);
+	if (first >= 0)
+		printf(", program %d is the first that doesn't", first);
+	printf("\n");
+	return match == CPUTEST_PROGRAMS ? 0 : 1;
+}
+
+int main (int argc, char *argv[])
+{
+	printf("MMN 8080 Emulator\n");
+	if (argc > 2 && 0 == strcmp(argv[1], "-b"))
+		return benchmark(argv + 2, argc - 2);
+	if (argc > 2 && 0 == strcmp(argv[1], "-f"))
+		return framebuffer_benchmark(argv + 2, argc - 2);
+	if (argc > 2 && 0 == strcmp(argv[1], "-s"))
+		return state_benchmark(argv + 2, argc - 2);
+	if (argc > 2 && 0 == strcmp(argv[1], "-r"))
+		return rewind_benchmark(argv + 2, argc - 2);
+	if (argc > 2 && 0 == strcmp(argv[1], "-t"))
+		return batch_benchmark(argv + 2, argc - 2);
+	if (argc > 2 && 0 == strcmp(argv[1], "-l"))
+		return lockstep_benchmark(argv + 2, argc - 2);
+	if (argc > 2 && 0 == strcmp(argv[1], "-e"))
+		return env_benchmark(argv + 2, argc - 2);
+	if (argc > 1 && 0 == strcmp(argv[1], "-i"))
+		return (cputest_instructions() != 0) | (cputest_halt() != 0);
+	if (argc > 2 && 0 == strcmp(argv[1], "-c"))
+		return record_programs(argv[2]);
+	if (argc > 2 && 0 == strcmp(argv[1], "-C"))
+		return check_programs(argv[2]);
+	if (argc > 3 && 0 == strcmp(argv[1], "-m"))
+		return record_movie(argv + 2, argc - 2);
+	if (argc > 3 && 0 == strcmp(argv[1], "-p"))
+		return replay_movie(argv + 2, argc - 2);
+	if (argc > 3 && 0 == strcmp(argv[1], "-g"))
+		return profile_game(argv + 2, argc - 2);
+	if (argc > 3 && 0 == strcmp(argv[1], "-T"))
+		return trace_game(argv + 2, argc - 2);
+	return 0;
+}
@@ -0,0 +1,199 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "movie.h"
+#include "rom.h"
+
+/* the RAM, right above the ROM up to the end of the video RAM */
+#define RAM_START ROM_SIZE
+#define RAM_SIZE (VIDEO_END - RAM_START)
+
+#define HEADER 16
+
+static const uint8_t magic[4] = { 'S', 'I', '8', 'M' };
+
+static void put32 (uint8_t *p, uint32_t val)
+{
+	p[0] = val;
+	p[1] = val >> 8;
+	p[2] = val >> 16;
+	p[3] = val >> 24;
+}
+
+static uint32_t get32 (const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static uint64_t get64 (const uint8_t *p)
+{
+	return get32(p) | (uint64_t) get32(p + 4) << 32;
+}
+
+/*
+ * Four independent multiply and rotate lanes over the RAM, 8 bytes
+ * at a time read little endian, as the hashes in the file are on
+ * every host, folded together with the registers at the end
+ */
+#define PRIME1 0x9e3779b185ebca87ULL
+#define PRIME2 0xc2b2ae3d27d4eb4fULL
+
+static uint64_t mix (uint64_t h, uint64_t val)
+{
+	h ^= val * PRIME2;
+	h = (h << 31) | (h >> 33);
+	return h * PRIME1;
+}
+
+uint64_t movie_hash (const struct invaders *machine)
+{
+	const cpu8080_state *cpu = &machine->cpu;
+	const uint8_t *ram = cpu->memory + RAM_START;
+	uint64_t lane[4] = { 1, 2, 3, 4 };
+	uint64_t regs;
+	uint64_t h;
+
+	for (int i = 0; i < RAM_SIZE; i += 32)
+		for (int k = 0; k < 4; k++)
+			lane[k] = mix(lane[k], get64(ram + i + 8 * k));
+
+	regs = (uint64_t) cpu->a | (uint64_t) cpu->b << 8
+		| (uint64_t) cpu->c << 16 | (uint64_t) cpu->d << 24
+		| (uint64_t) cpu->e << 32 | (uint64_t) cpu->h << 40
+		| (uint64_t) cpu->l << 48
+		| (uint64_t) *(const uint8_t *) &cpu->flags << 56;
+	h = mix(lane[0], lane[1]);
+	h = mix(h, lane[2]);
+	h = mix(h, lane[3]);
+	h = mix(h, regs);
+	h = mix(h, cpu->sp | (uint64_t) cpu->pc << 16
+	    | (uint64_t) cpu->int_enable << 32
+	    | (uint64_t) cpu->halted << 40);
+	h = mix(h, cpu->cycles);
+	return h ^ (h >> 29);
+}
+
+void movie_init (struct movie *movie)
+{
+	movie->records = NULL;
+	movie->frames = 0;
+	movie->capacity = 0;
+}
+
+void movie_destroy (struct movie *movie)
+{
+	free(movie->records);
+	movie_init(movie);
+}
+
+int movie_record (struct movie *movie, const struct invaders *machine)
+{
+	uint8_t *rec;
+	uint64_t hash;
+
+	if (movie->frames == movie->capacity) {
+		long capacity = movie->capacity ? 2 * movie->capacity : 4096;
+		uint8_t *records = realloc(movie->records,
+					   capacity * MOVIE_RECORD);
+		if (NULL == records) {
+			fprintf(stderr, "Failed to alloc the movie\n");
+			return -1;
+		}
+		movie->records = records;
+		movie->capacity = capacity;
+	}
+
+	rec = movie->records + movie->frames * MOVIE_RECORD;
+	memcpy(rec, machine->inputs, 3);
+	rec[3] = 0;
+	hash = movie_hash(machine);
+	put32(rec + 4, hash);
+	put32(rec + 8, hash >> 32);
+	movie->frames++;
+	return 0;
+}
+
+int movie_save (const struct movie *movie, const char *path)
+{
+	uint8_t header[HEADER] = { 0 };
+	FILE *f = fopen(path, "wb");
+
+	if (NULL == f) {
+		fprintf(stderr, "Couldn't open file: %s\n", path);
+		return -1;
+	}
+	memcpy(header, magic, sizeof(magic));
+	header[4] = MOVIE_VERSION;
+	header[6] = MOVIE_RECORD;
+	put32(header + 8, movie->frames);
+	if (fwrite(header, HEADER, 1, f) != 1
+	    || fwrite(movie->records, MOVIE_RECORD, movie->frames, f)
+	       != (size_t) movie->frames) {
+		fprintf(stderr, "Failed to write the movie: %s\n", path);
+		fclose(f);
+		return -1;
+	}
+	if (fclose(f) != 0) {
+		fprintf(stderr, "Failed to write the movie: %s\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+int movie_load (struct movie *movie, const char *path)
+{
+	uint8_t header[HEADER];
+	FILE *f = fopen(path, "rb");
+	long frames;
+
+	if (NULL == f) {
+		fprintf(stderr, "Couldn't open file: %s\n", path);
+		return -1;
+	}
+	if (fread(header, HEADER, 1, f) != 1
+	    || memcmp(header, magic, sizeof(magic))
+	    || header[4] != MOVIE_VERSION || header[5] != 0
+	    || header[6] != MOVIE_RECORD || header[7] != 0) {
+		fprintf(stderr, "Not a movie of version %d: %s\n",
+			MOVIE_VERSION, path);
+		goto error;
+	}
+
+	/* all of it up front, replaying then never touches the file */
+	frames = get32(header + 8);
+	movie->records = malloc(frames * MOVIE_RECORD + 1);	/* + 1: empty */
+	if (NULL == movie->records) {
+		fprintf(stderr, "Failed to alloc the movie\n");
+		goto error;
+	}
+	if (fread(movie->records, MOVIE_RECORD, frames, f) != (size_t) frames) {
+		fprintf(stderr, "Movie cut short: %s\n", path);
+		movie_destroy(movie);
+		goto error;
+	}
+	movie->frames = movie->capacity = frames;
+	fclose(f);
+	return 0;
+
+error:
+	fclose(f);
+	return -1;
+}
+
+long movie_replay (const struct movie *movie, struct invaders *machine)
+{
+	for (long i = 0; i < movie->frames; i++) {
+		const uint8_t *rec = movie->records + i * MOVIE_RECORD;
+
+		memcpy(machine->inputs, rec, 3);
+		if (run_until_frame(&machine->cpu) < 0)
+			return -1;
+		if (movie_hash(machine) != get64(rec + 4)) {
+			fprintf(stderr, "Replay diverged at frame %ld\n", i);
+			return i;
+		}
+	}
+	return movie->frames;
+}
@@ -0,0 +1,65 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "invaders.h"
+
+/*
+ * Input movies: what the input ports 0 to 2 read during each frame,
+ * with a hash of the registers and RAM at the end of it. The game only
+ * sees its buttons through IN 0 to 2, and they only change between
+ * frames, so a movie played back from power on replays the session
+ * exactly, and the hashes tell where it stops doing so.
+ *
+ * The file is a 16 byte header (the magic, version, record size and
+ * number of frames) followed by a MOVIE_RECORD byte record per frame:
+ * the three ports, a zero byte and the 64 bit hash, little endian.
+ */
+#define MOVIE_VERSION 2
+#define MOVIE_RECORD 12
+
+struct movie {
+	uint8_t *records;
+	long frames;
+	long capacity;		/* frames records has room for */
+};
+
+/*
+ * Starts an empty movie.
+ */
+void movie_init (struct movie *movie);
+
+void movie_destroy (struct movie *movie);
+
+/*
+ * Records the frame the machine just ran: call it after every
+ * run_until_frame of a machine powered on by invaders_load.
+ * Returns 0 on success, -1 on failure.
+ */
+int movie_record (struct movie *movie, const struct invaders *machine);
+
+int movie_save (const struct movie *movie, const char *path);
+
+/*
+ * Reads a movie saved by movie_save into an empty one.
+ * Returns 0 on success, -1 on failure.
+ */
+int movie_load (struct movie *movie, const char *path);
+
+/*
+ * Plays the movie on a machine just powered on by invaders_load, as
+ * fast as the core goes, checking the hash of every frame.
+ * Returns the number of frames played, all of them when they all
+ * matched, or -1 on an invalid opcode.
+ */
+long movie_replay (const struct movie *movie, struct invaders *machine);
+
+/*
+ * The hash a frame is checked with: the registers, flags, cycle
+ * counter and RAM.
+ */
+uint64_t movie_hash (const struct invaders *machine);
+
+#endif
@@ -0,0 +1,1092 @@
+/*
+ * Instruction handlers, included by execute() in 8080.c
+ * OP(n) starts the handler of opcode n and NEXT ends it, both are
+ * defined by whichever dispatch loop includes this file, as is LOOP(),
+ * run after every jump taken and HLT, with pc at where they go.
+ * An opcode the core doesn't run goes to the unknown label of the
+ * loop, which reports it with the cycles run before it.
+ * opcode points at the instruction, pc already points past it.
+ */
+		/* nop */
+	OP(0x00):
+		NEXT;
+		/* LXI B, D16 */
+	OP(0x01):
+		state->c = opcode[1];
+		state->b = opcode[2];
+		state->pc += 2;
+		NEXT;
+		/* STAX B */
+	OP(0x02):
+	{
+		uint16_t mem_addr = (state->b << 8) | state->c;
+		write_mem(state, mem_addr, state->a);
+		NEXT;
+	}
+		/* INX B */
+	OP(0x03):
+		state->c++;
+		if (state->c == 0)
+			state->b++;
+		NEXT;
+		/* INR B */
+	OP(0x04):
+		state->b++;
+		flags_inr(state, state->b);
+		NEXT;
+		/* DCR B */
+	OP(0x05):
+		state->b--;
+		flags_dcr(state, state->b);
+		NEXT;
+		/* MVI B, byte */
+	OP(0x06):
+		state->b = opcode[1];
+		state->pc++;
+		NEXT;
+		/* RLC */
+	OP(0x07):
+	{
+		uint8_t aux = state->a;
+		state->a = ((aux & 0x80) >> 7) | (aux << 1);
+		SET_CY(state, (0x80 == (aux & 0x80)));
+		NEXT;
+	}
+	OP(0x08):
+		goto unknown;
+		/* DAD B */
+	OP(0x09):
+	{
+		uint32_t hl = (state->h << 8) | state->l;
+		uint32_t bc = (state->b << 8) | state->c;
+		uint32_t result = hl + bc;
+		state->h = (result & 0xff00) >> 8;
+		state->l = result & 0xff;
+		SET_CY(state, ((result & 0xffff0000) != 0));
+		NEXT;
+	}
+		/* LDAX B */
+	OP(0x0a):
+	{
+		uint16_t mem_addr = (state->b << 8) | state->c;
+		state->a = read_mem(state, mem_addr);
+		NEXT;
+	}
+		/* DCX B */
+	OP(0x0b):
+		state->c--;
+		if (state->c == 0xff)
+			state->b--;
+		NEXT;
+		/* INR C */
+	OP(0x0c):
+		state->c++;
+		flags_inr(state, state->c);
+		NEXT;
+		/* DCR C */
+	OP(0x0d):
+		state->c--;
+		flags_dcr(state, state->c);
+		NEXT;
+		/* MVI C, byte */
+	OP(0x0e):
+		state->c = opcode[1];
+		state->pc++;
+		NEXT;
+		/* RRC */
+	OP(0x0f):
+	{
+		uint8_t aux = state->a;
+		state->a = ((aux & 1) << 7) | (aux >> 1);
+		SET_CY(state, (1 == (aux & 1)));
+		NEXT;
+	}
+	OP(0x10):
+		goto unknown;
+		/* LXI D, word */
+	OP(0x11):
+		state->e = opcode[1];
+		state->d = opcode[2];
+		state->pc += 2;
+		NEXT;
+		/* STAX D */
+	OP(0x12):
+	{
+		uint16_t mem_addr = (state->d << 8) | state->e;
+		write_mem(state, mem_addr, state->a);
+		NEXT;
+	}
+		/* INX D */
+	OP(0x13):
+		state->e++;
+		if (state->e == 0)
+			state->d++;
+		NEXT;
+		/* INR D */
+	OP(0x14):
+		state->d++;
+		flags_inr(state, state->d);
+		NEXT;
+		/* DCR D */
+	OP(0x15):
+		state->d--;
+		flags_dcr(state, state->d);
+		NEXT;
+		/* MVI D, byte */
+	OP(0x16):
+		state->d = opcode[1];
+		state->pc++;
+		NEXT;
+		/* RAL */
+	OP(0x17):
+	{
+		uint8_t aux = state->a;
+		state->a = GET_CY(state) | (aux << 1);
+		SET_CY(state, (0x80 == (aux & 0x80)));
+		NEXT;
+	}
+	OP(0x18):
+		goto unknown;
+		/* DAD D */
+	OP(0x19):
+	{
+		uint32_t hl = (state->h << 8) | state->l;
+		uint32_t de = (state->d << 8) | state->e;
+		uint32_t result = hl + de;
+		state->h = (result & 0xff00) >> 8;
+		state->l = result & 0xff;
+		SET_CY(state, ((result & 0xffff0000) != 0));
+		NEXT;
+	}
+	/* LDAX D */
+	OP(0x1a):
+	{
+		uint16_t mem_addr = (state->d << 8) | state->e;
+		state->a = read_mem(state, mem_addr);
+		NEXT;
+	}
+	/* DCX D */
+	OP(0x1b):
+		state->e--;
+		if (state->e == 0xff)
+			state->d--;
+		NEXT;
+		/* INR E */
+	OP(0x1c):
+		state->e++;
+		flags_inr(state, state->e);
+		NEXT;
+		/* DCR E */
+	OP(0x1d):
+		state->e--;
+		flags_dcr(state, state->e);
+		NEXT;
+		/* MVI E, byte */
+	OP(0x1e):
+		state->e = opcode[1];
+		state->pc++;
+		NEXT;
+		/* RAR */
+	OP(0x1f):
+	{
+		uint8_t aux = state->a;
+		state->a = (GET_CY(state) << 7) | (aux >> 1);
+		SET_CY(state, (1 == (aux & 1)));
+		NEXT;
+	}
+	OP(0x20):
+		goto unknown;
+		/* LXI H, word */
+	OP(0x21):
+		state->l = opcode[1];
+		state->h = opcode[2];
+		state->pc += 2;
+		NEXT;
+		/* SHLD */
+	OP(0x22):
+	{
+		uint16_t mem_addr = opcode[1] | (opcode[2] << 8);
+		write_mem(state, mem_addr, state->l);
+		write_mem(state, mem_addr+1, state->h);
+		state->pc += 2;
+		NEXT;
+	}
+	/* INX H */
+	OP(0x23):
+		state->l++;
+		if (state->l == 0)
+			state->h++;
+		NEXT;
+		/* INR H */
+	OP(0x24):
+		state->h += 1;
+		flags_inr(state, state->h);
+		NEXT;
+		/* DCR H */
+	OP(0x25):
+		state->h--;
+		flags_dcr(state, state->h);
+		NEXT;
+		/* MVI H, byte */
+	OP(0x26):
+		state->h = opcode[1];
+		state->pc++;
+		NEXT;
+		/* DAA */
+	OP(0x27):
+	{
+		uint8_t lsb = state->a & 0xf;
+		uint8_t msb = state->a >> 4;
+		uint8_t correction = 0;
+		uint8_t cy, ac;
+
+		/* the only reader of AC, so it has to be brought up to date */
+		flags_sync(state);
+		cy = GET_CY(state);
+		ac = state->flags.ac;
+		if (ac || lsb > 9)
+			correction |= 0x06;
+		if (cy || msb > 9 || (msb >= 9 && lsb > 9)) {
+			correction |= 0x60;
+			cy = 1;
+		}
+		state->a = arith_add(state, correction, 0);
+		SET_CY(state, cy);
+		NEXT;
+	}
+	OP(0x28):
+		goto unknown;
+		/* DAD H */
+	OP(0x29):
+	{
+		uint32_t hl = (state->h << 8) | state->l;
+		uint32_t result = 2 * hl;
+		state->h = (result & 0xff00) >> 8;
+		state->l = (result & 0xff);
+		SET_CY(state, ((result & 0xffff0000) != 0));
+		NEXT;
+	}
+	/* LHLD addr */
+	OP(0x2a):
+	{
+		uint16_t mem_addr = opcode[1] | (opcode[2] << 8);
+		state->l = read_mem(state, mem_addr);
+		state->h = read_mem(state, mem_addr + 1); 
+		state->pc += 2;
+		NEXT;
+	}
+	/* DCX H */
+	OP(0x2b):
+		state->l--;
+		if (state->l == 0xff)
+			state->h--;
+		NEXT;
+		/* INR L */
+	OP(0x2c):
+		state->l++;
+		flags_inr(state, state->l);
+		NEXT;
+		/* DCR L */
+	OP(0x2d):
+		state->l--;
+		flags_dcr(state, state->l);
+		NEXT;
+		/* MVI L, byte */
+	OP(0x2e):
+		state->l = opcode[1];
+		state->pc++;
+		NEXT;
+		/* CMA */
+	OP(0x2f):
+		state->a = ~state->a;
+		NEXT;
+	OP(0x30):
+		goto unknown;
+		/* LXI SP, word */
+	OP(0x31):
+		state->sp = (opcode[2] << 8) | opcode[1];
+		state->pc += 2;
+		NEXT;
+		/* STA (word) */
+	OP(0x32):
+	{
+		uint16_t mem_addr = (opcode[2] << 8) | opcode[1];
+		write_mem(state, mem_addr, state->a);
+		state->pc += 2;
+		NEXT;
+	}	
+	/* INX SP */
+	OP(0x33):
+		state->sp++;
+		NEXT;
+		/* INR M */
+	OP(0x34):
+	{
+		uint8_t result = read_from_hl(state) + 1;
+		flags_inr(state, result);
+		write_to_hl(state, result);
+		NEXT;
+	}
+	/* DCR M */
+	OP(0x35):
+	{
+		uint8_t result = read_from_hl(state) - 1;
+		flags_dcr(state, result);
+		write_to_hl(state, result);
+		NEXT;
+	}
+	/* MVI M, byte */
+	OP(0x36):
+	{
+		write_to_hl(state, opcode[1]);
+		state->pc++;
+		NEXT;
+	}
+	/* STC */
+	OP(0x37):
+		SET_CY(state, 1);
+		NEXT;
+	OP(0x38):
+		goto unknown;
+		/* DAD SP */
+	OP(0x39):
+	{
+		uint32_t hl = (state->h << 8) | state->l;
+		uint32_t result = hl + state->sp;
+		state->h = (result & 0xff00) >> 8;
+		state->l = result & 0xff;
+		SET_CY(state, ((result & 0xffff0000) > 0));
+		NEXT;
+	}
+	/* LDA (word) */
+	OP(0x3a):
+	{
+		uint16_t mem_addr = (opcode[2] << 8) | opcode[1];
+		state->a = read_mem(state, mem_addr);
+		state->pc += 2;
+		NEXT;
+	}
+	/* DCX SP */
+	OP(0x3b):
+		state->sp--;
+		NEXT;
+		/* INR A */
+	OP(0x3c):
+		state->a++;
+		flags_inr(state, state->a);
+		NEXT;
+		/* DCR A */
+	OP(0x3d):
+		state->a--;
+		flags_dcr(state, state->a);
+		NEXT;
+		/* MVI A, byte */
+	OP(0x3e):
+		state->a = opcode[1];
+		state->pc++;
+		NEXT;
+		/* CMC */
+	OP(0x3f):
+		SET_CY(state, !GET_CY(state));
+		NEXT;
+		/* MOV B, ? */
+	OP(0x40): state->b = state->b; NEXT;
+	OP(0x41): state->b = state->c; NEXT;
+	OP(0x42): state->b = state->d; NEXT;
+	OP(0x43): state->b = state->e; NEXT;
+	OP(0x44): state->b = state->h; NEXT;
+	OP(0x45): state->b = state->l; NEXT;
+	OP(0x46): state->b = read_from_hl(state); NEXT;
+	OP(0x47): state->b = state->a; NEXT;
+		/* MOV C, ? */
+	OP(0x48): state->c = state->b; NEXT;
+	OP(0x49): state->c = state->c; NEXT;
+	OP(0x4a): state->c = state->d; NEXT;
+	OP(0x4b): state->c = state->e; NEXT;
+	OP(0x4c): state->c = state->h; NEXT;
+	OP(0x4d): state->c = state->l; NEXT;
+	OP(0x4e): state->c = read_from_hl(state); NEXT;
+	OP(0x4f): state->c = state->a; NEXT;
+		/* MOV D, ? */
+	OP(0x50): state->d = state->b; NEXT;
+	OP(0x51): state->d = state->c; NEXT;
+	OP(0x52): state->d = state->d; NEXT;
+	OP(0x53): state->d = state->e; NEXT;
+	OP(0x54): state->d = state->h; NEXT;
+	OP(0x55): state->d = state->l; NEXT;
+	OP(0x56): state->d = read_from_hl(state); NEXT;
+	OP(0x57): state->d = state->a; NEXT;
+		/* MOV E, ? */
+	OP(0x58): state->e = state->b; NEXT;
+	OP(0x59): state->e = state->c; NEXT;
+	OP(0x5a): state->e = state->d; NEXT;
+	OP(0x5b): state->e = state->e; NEXT;
+	OP(0x5c): state->e = state->h; NEXT;
+	OP(0x5d): state->e = state->l; NEXT;
+	OP(0x5e): state->e = read_from_hl(state); NEXT;
+	OP(0x5f): state->e = state->a; NEXT;
+		/* MOV H, ? */
+	OP(0x60): state->h = state->b; NEXT;
+	OP(0x61): state->h = state->c; NEXT;
+	OP(0x62): state->h = state->d; NEXT;
+	OP(0x63): state->h = state->e; NEXT;
+	OP(0x64): state->h = state->h; NEXT;
+	OP(0x65): state->h = state->l; NEXT;
+	OP(0x66): state->h = read_from_hl(state); NEXT;
+	OP(0x67): state->h = state->a; NEXT;
+		/* MOV L, ? */
+	OP(0x68): state->l = state->b; NEXT;
+	OP(0x69): state->l = state->c; NEXT;
+	OP(0x6a): state->l = state->d; NEXT;
+	OP(0x6b): state->l = state->e; NEXT;
+	OP(0x6c): state->l = state->h; NEXT;
+	OP(0x6d): state->l = state->l; NEXT;
+	OP(0x6e): state->l = read_from_hl(state); NEXT;
+	OP(0x6f): state->l = state->a; NEXT;
+		/* MOV M, ? */
+	OP(0x70): write_to_hl(state, state->b); NEXT;
+	OP(0x71): write_to_hl(state, state->c); NEXT;
+	OP(0x72): write_to_hl(state, state->d); NEXT;
+	OP(0x73): write_to_hl(state, state->e); NEXT;
+	OP(0x74): write_to_hl(state, state->h); NEXT;
+	OP(0x75): write_to_hl(state, state->l); NEXT;
+		/* HLT, run over and over until an interrupt */
+	OP(0x76):
+		state->halted = 1;
+		state->pc--;
+		LOOP();
+		NEXT;
+	OP(0x77): write_to_hl(state, state->a); NEXT;
+		/* MOV A, ? */
+	OP(0x78): state->a = state->b; NEXT;
+	OP(0x79): state->a = state->c; NEXT;
+	OP(0x7a): state->a = state->d; NEXT;
+	OP(0x7b): state->a = state->e; NEXT;
+	OP(0x7c): state->a = state->h; NEXT;
+	OP(0x7d): state->a = state->l; NEXT;
+	OP(0x7e): state->a = read_from_hl(state); NEXT;
+	OP(0x7f): state->a = state->a; NEXT;
+		/* ADD ? */
+	OP(0x80): state->a = arith_add(state, state->b, 0); NEXT;
+	OP(0x81): state->a = arith_add(state, state->c, 0); NEXT;
+	OP(0x82): state->a = arith_add(state, state->d, 0); NEXT;
+	OP(0x83): state->a = arith_add(state, state->e, 0); NEXT;
+	OP(0x84): state->a = arith_add(state, state->h, 0); NEXT;
+	OP(0x85): state->a = arith_add(state, state->l, 0); NEXT;
+	OP(0x86): state->a = arith_add(state, read_from_hl(state), 0); NEXT;
+	OP(0x87): state->a = arith_add(state, state->a, 0); NEXT;
+		/* ADC ? */
+	OP(0x88): state->a = arith_add(state, state->b, GET_CY(state)); NEXT;
+	OP(0x89): state->a = arith_add(state, state->c, GET_CY(state)); NEXT;
+	OP(0x8a): state->a = arith_add(state, state->d, GET_CY(state)); NEXT;
+	OP(0x8b): state->a = arith_add(state, state->e, GET_CY(state)); NEXT;
+	OP(0x8c): state->a = arith_add(state, state->h, GET_CY(state)); NEXT;
+	OP(0x8d): state->a = arith_add(state, state->l, GET_CY(state)); NEXT;
+	OP(0x8e): state->a = arith_add(state, read_from_hl(state), GET_CY(state)); NEXT;
+	OP(0x8f): state->a = arith_add(state, state->a, GET_CY(state)); NEXT;
+		/* SUB ? */
+	OP(0x90): state->a = arith_sub(state, state->b, 0); NEXT;
+	OP(0x91): state->a = arith_sub(state, state->c, 0); NEXT;
+	OP(0x92): state->a = arith_sub(state, state->d, 0); NEXT;
+	OP(0x93): state->a = arith_sub(state, state->e, 0); NEXT;
+	OP(0x94): state->a = arith_sub(state, state->h, 0); NEXT;
+	OP(0x95): state->a = arith_sub(state, state->l, 0); NEXT;
+	OP(0x96): state->a = arith_sub(state, read_from_hl(state), 0); NEXT;
+	OP(0x97): state->a = arith_sub(state, state->a, 0); NEXT;
+		/* SBB ? */
+	OP(0x98): state->a = arith_sub(state, state->b, GET_CY(state)); NEXT;
+	OP(0x99): state->a = arith_sub(state, state->c, GET_CY(state)); NEXT;
+	OP(0x9a): state->a = arith_sub(state, state->d, GET_CY(state)); NEXT;
+	OP(0x9b): state->a = arith_sub(state, state->e, GET_CY(state)); NEXT;
+	OP(0x9c): state->a = arith_sub(state, state->h, GET_CY(state)); NEXT;
+	OP(0x9d): state->a = arith_sub(state, state->l, GET_CY(state)); NEXT;
+	OP(0x9e): state->a = arith_sub(state, read_from_hl(state), GET_CY(state)); NEXT;
+	OP(0x9f): state->a = arith_sub(state, state->a, GET_CY(state)); NEXT;
+	/* ANA ? */
+	OP(0xa0):
+		state->a = state->a & state->b;
+		logic_flags(state);
+		NEXT;
+	OP(0xa1):
+		state->a = state->a & state->c;
+		logic_flags(state);
+		NEXT;
+	OP(0xa2):
+		state->a = state->a & state->d;
+		logic_flags(state);
+		NEXT;
+	OP(0xa3):
+		state->a = state->a & state->e;
+		logic_flags(state);
+		NEXT;
+	OP(0xa4):
+		state->a = state->a & state->h;
+		logic_flags(state);
+		NEXT;
+	OP(0xa5):
+		state->a = state->a & state->l;
+		logic_flags(state);
+		NEXT;
+	OP(0xa6):
+		state->a = state->a & read_from_hl(state);
+		logic_flags(state);
+		NEXT;
+	OP(0xa7):
+		state->a = state->a & state->a;
+		logic_flags(state);
+		NEXT;
+		/* XRA ? */
+	OP(0xa8):
+		state->a ^= state->b;
+		logic_flags(state);
+		NEXT;
+	OP(0xa9):
+		state->a ^= state->c;
+		logic_flags(state);
+		NEXT;
+	OP(0xaa):
+		state->a ^= state->d;
+		logic_flags(state);
+		NEXT;
+	OP(0xab):
+		state->a ^= state->e;
+		logic_flags(state);
+		NEXT;
+	OP(0xac):
+		state->a ^= state->h;
+		logic_flags(state);
+		NEXT;
+	OP(0xad):
+		state->a ^= state->l;
+		logic_flags(state);
+		NEXT;
+	OP(0xae):
+		state->a ^= read_from_hl(state);
+		logic_flags(state);
+		NEXT;
+	OP(0xaf):
+		state->a ^= state->a;
+		logic_flags(state);
+		NEXT;
+		/* ORA ? */
+		/* ^ not a Jojo reference */
+	OP(0xb0):
+		state->a |= state->b;
+		logic_flags(state);
+		NEXT;
+	OP(0xb1):
+		state->a |= state->c;
+		logic_flags(state);
+		NEXT;
+	OP(0xb2):
+		state->a |= state->d;
+		logic_flags(state);
+		NEXT;
+	OP(0xb3):
+		state->a |= state->e;
+		logic_flags(state);
+		NEXT;
+	OP(0xb4):
+		state->a |= state->h;
+		logic_flags(state);
+		NEXT;
+	OP(0xb5):
+		state->a |= state->l;
+		logic_flags(state);
+		NEXT;
+	OP(0xb6):
+		state->a |= read_from_hl(state);
+		logic_flags(state);
+		NEXT;
+	OP(0xb7):
+		state->a |= state->a;
+		logic_flags(state);
+		NEXT;
+		/* CMP ? */
+	OP(0xb8): arith_sub(state, state->b, 0); NEXT;
+	OP(0xb9): arith_sub(state, state->c, 0); NEXT;
+	OP(0xba): arith_sub(state, state->d, 0); NEXT;
+	OP(0xbb): arith_sub(state, state->e, 0); NEXT;
+	OP(0xbc): arith_sub(state, state->h, 0); NEXT;
+	OP(0xbd): arith_sub(state, state->l, 0); NEXT;
+	OP(0xbe): arith_sub(state, read_from_hl(state), 0); NEXT;
+	OP(0xbf): arith_sub(state, state->a, 0); NEXT;
+	/* RNZ */
+	OP(0xc0):
+		if (!GET_Z(state)) {
+			state->pc = read_mem(state, state->sp) | (read_mem(state, state->sp + 1) << 8);
+			state->sp += 2;
+		}
+		NEXT;
+		/* POP B */
+	OP(0xc1):
+		pop(state, &state->b, &state->c);
+		NEXT;
+		/* JNZ addr */
+	OP(0xc2):
+		if (!GET_Z(state)) {
+			state->pc = (opcode[2] << 8) | opcode[1];
+			LOOP();
+		} else
+			state->pc += 2;
+		NEXT;
+		/* JMP addr */
+	OP(0xc3):
+		state->pc = (opcode[2] << 8) | opcode[1];
+		LOOP();
+		NEXT;
+		/* CNZ addr */
+	OP(0xc4):
+		if (!GET_Z(state)) {
+			/*
+			 * will return to the next instruction; the address
+			 * is read first, the push may overwrite it
+			 */
+			uint16_t return_addr = state->pc + 2;
+			uint16_t target = (opcode[2] << 8) | opcode[1];
+			write_mem(state, state->sp-1, (return_addr >> 8) & 0xff);
+			write_mem(state, state->sp-2, (return_addr & 0xff));
+			state->sp = state->sp - 2;
+			state->pc = target;
+		} else
+			state->pc += 2;
+		NEXT;
+		/* PUSH B */
+	OP(0xc5):
+		push(state, state->b, state->c);
+		NEXT;
+		/* ADI byte */
+	OP(0xc6):
+	{
+		state->a = arith_add(state, opcode[1], 0);
+		state->pc++;
+		NEXT;
+	}
+	/* RST 0 */
+	OP(0xc7):
+	{
+		/* one byte long, it returns to the next instruction */
+		uint16_t return_addr = state->pc;
+		write_mem(state, state->sp-1, (return_addr >> 8) & 0xff);
+		write_mem(state, state->sp-2, (return_addr & 0xff));
+		state->sp -= 2;
+		state->pc = 0x0000;
+		NEXT;
+	}
+	/* RZ */
+	OP(0xc8):
+		if (GET_Z(state)) {
+			state->pc = read_mem(state, state->sp) | (read_mem(state, state->sp + 1) << 8);
+			state->sp += 2;
+		}
+		NEXT;
+		/* RET */
+	OP(0xc9):
+		state->pc = read_mem(state, state->sp) | (read_mem(state, state->sp + 1) << 8);
+		state->sp += 2;
+		NEXT;
+		/* JZ addr */
+	OP(0xca):
+		if (GET_Z(state)) {
+			state->pc = (opcode[2] << 8) | opcode[1];
+			LOOP();
+		} else
+			state->pc += 2;
+		NEXT;
+	OP(0xcb):
+		goto unknown;
+		/* CZ addr */
+	OP(0xcc):
+		if (GET_Z(state) == 1) {
+			uint16_t return_addr = state->pc + 2;
+			uint16_t target = (opcode[2] << 8) | opcode[1];
+			write_mem(state, state->sp-1, (return_addr >> 8) & 0xff);
+			write_mem(state, state->sp-2, (return_addr & 0xff));
+			state->sp -= 2;
+			state->pc = target;
+		} else
+			state->pc += 2;
+		NEXT;
+		/* CALL addr */
+	OP(0xcd):
+	{
+		uint16_t return_addr = state->pc + 2;
+		uint16_t target = (opcode[2] << 8) | opcode[1];
+		write_mem(state, state->sp-1, (return_addr >> 8) & 0xff);
+		write_mem(state, state->sp-2, (return_addr & 0xff));
+		state->sp -= 2;
+		state->pc = target;
+		NEXT;
+	}
+	/* ACI byte */
+	OP(0xce):
+	{
+		state->a = arith_add(state, opcode[1], GET_CY(state));
+		state->pc++;
+		NEXT;
+	}
+	/* RST 1 */
+	OP(0xcf):
+	{
+		uint16_t return_addr = state->pc;
+		write_mem(state, state->sp-1, (return_addr >> 8) & 0xff);
+		write_mem(state, state->sp-2, (return_addr & 0xff));
+		state->sp -= 2;
+		state->pc = 0x0008;
+		NEXT;
+	}
+	/* RNC */
+	OP(0xd0):
+		if (!GET_CY(state)) {
+			state->pc = read_mem(state, state->sp) | (read_mem(state, state->sp + 1) << 8);
+			state->sp += 2;
+		}
+		NEXT;
+		/* POP D */
+	OP(0xd1):
+		pop(state, &state->d, &state->e);
+		NEXT;
+		/* JNC */
+	OP(0xd2):
+		if (!GET_CY(state)) {
+			state->pc = (opcode[2] << 8) | opcode[1];
+			LOOP();
+		} else
+			state->pc += 2;
+		NEXT;
+		/* OUT d8 */
+	OP(0xd3):
+	{
+		uint8_t port = opcode[1];
+		state->ports->out[port](state->io, port, state->a);
+		state->pc++;
+		NEXT;
+	}
+		/* CNC addr */
+	OP(0xd4):
+		if (!GET_CY(state)) {
+			uint16_t return_addr = state->pc + 2;
+			uint16_t target = (opcode[2] << 8) | opcode[1];
+			write_mem(state, state->sp-1, (return_addr >> 8) & 0xff);
+			write_mem(state, state->sp-2, (return_addr & 0xff));
+			state->sp -= 2;
+			state->pc = target;
+		} else
+			state->pc += 2;
+		NEXT;
+		/* PUSH D */
+	OP(0xd5):
+		push(state, state->d, state->e);
+		NEXT;
+		/* SUI byte */
+	OP(0xd6):
+	{
+		state->a = arith_sub(state, opcode[1], 0);
+		state->pc++;
+		NEXT;
+	}
+	/* RST 2 */
+	OP(0xd7):
+	{
+		uint16_t return_addr = state->pc;
+		write_mem(state, state->sp-1, (return_addr >> 8) & 0xff);
+		write_mem(state, state->sp-2, (return_addr & 0xff));
+		state->sp -= 2;
+		state->pc = 0x10;
+		NEXT;
+	}
+	/* RN */
+	OP(0xd8):
+		if (GET_CY(state)) {
+			state->pc = read_mem(state, state->sp) | (read_mem(state, state->sp + 1) << 8);
+			state->sp += 2;
+		}
+		NEXT;
+	OP(0xd9):
+		goto unknown;
+		/* JC */
+	OP(0xda):
+		if (GET_CY(state)) {
+			state->pc = (opcode[2] << 8) | opcode[1];
+			LOOP();
+		} else
+			state->pc += 2;
+		NEXT;
+		/* IN d8 */
+	OP(0xdb):
+	{
+		uint8_t port = opcode[1];
+		state->a = state->ports->in[port](state->io, port);
+		state->pc++;
+		NEXT;
+	}
+		/* CC addr */
+	OP(0xdc):
+		if (GET_CY(state)) {
+			uint16_t return_addr = state->pc + 2;
+			uint16_t target = (opcode[2] << 8) | opcode[1];
+			write_mem(state, state->sp-1, (return_addr >> 8) & 0xff);
+			write_mem(state, state->sp-2, (return_addr & 0xff));
+			state->sp -= 2;
+			state->pc = target;
+		} else
+			state->pc += 2;
+		NEXT;
+	OP(0xdd):
+		goto unknown;
+		/* SBI byte */
+	OP(0xde):
+	{
+		state->a = arith_sub(state, opcode[1], GET_CY(state));
+		state->pc++;
+		NEXT;
+	}
+		/* RST 3 */
+	OP(0xdf):
+	{
+		uint16_t return_addr = state->pc;
+		write_mem(state, state->sp-1, (return_addr >> 8) & 0xff);
+		write_mem(state, state->sp-2, (return_addr & 0xff));
+		state->sp -= 2;
+		state->pc = 0x18;
+		NEXT;
+	}
+	/* RPO */
+	OP(0xe0):
+		if (GET_P(state) == 0) {
+			state->pc = read_mem(state, state->sp) | (read_mem(state, state->sp + 1) << 8);
+			state->sp += 2;
+		}
+		NEXT;
+		/* POP H */
+	OP(0xe1):
+		pop(state, &state->h, &state->l);
+		NEXT;
+		/* LPO */
+	OP(0xe2):
+		if (GET_P(state) == 0) {
+			state->pc = (opcode[2] << 8) | opcode[1];
+			LOOP();
+		} else
+			state->pc += 2;
+		NEXT;
+		/* XTHL */
+	OP(0xe3):
+	{
+		uint8_t h = state->h;
+		uint8_t l = state->l;
+		state->l = read_mem(state, state->sp);
+		state->h = read_mem(state, state->sp + 1);
+		write_mem(state, state->sp, l);
+		write_mem(state, state->sp + 1, h);
+		NEXT;
+	}
+	/* CPO addr */
+	OP(0xe4):
+		if (GET_P(state) == 0) {
+			uint16_t return_addr = state->pc + 2;
+			uint16_t target = (opcode[2] << 8) | opcode[1];
+			write_mem(state, state->sp - 1, (return_addr >> 8) & 0xff);
+			write_mem(state, state->sp - 2, (return_addr & 0xff));
+			state->sp -= 2;
+			state->pc = target;
+		} else
+			state->pc += 2;
+		NEXT;
+		/* PUSH H */
+	OP(0xe5):
+		push(state, state->h, state->l);
+		NEXT;
+		/* ANI byte */
+	OP(0xe6):
+	{
+		state->a &= opcode[1];
+		logic_flags(state);
+		state->pc++;
+		NEXT;
+	}
+	/* RST 4 */
+	OP(0xe7):
+	{
+		uint16_t return_addr = state->pc;
+		write_mem(state, state->sp - 1, (return_addr >> 8) & 0xff);
+		write_mem(state, state->sp - 2, (return_addr & 0xff));
+		state->sp -= 2;
+		state->pc = 0x20;
+		NEXT;
+	}
+	/* RPE */
+	OP(0xe8):
+		if (GET_P(state)) {
+			state->pc = read_mem(state, state->sp) | (read_mem(state, state->sp + 1) << 8);
+			state->sp += 2;
+		}
+		NEXT;
+		/* PCHL */
+	OP(0xe9):
+		state->pc = (state->h << 8) | state->l;
+		NEXT;
+		/* JPE addr */
+	OP(0xea):
+		if (GET_P(state)) {
+			state->pc = (opcode[2] << 8) | opcode[1];
+			LOOP();
+		} else
+			state->pc += 2;
+		NEXT;
+		/* XCHG */
+	OP(0xeb):
+	{
+		uint8_t aux = state->d;
+		state->d = state->h;
+		state->h = aux;
+		aux = state->e;
+		state->e = state->l;
+		state->l = aux;
+		NEXT;
+	}
+	/* CPE addr */
+	OP(0xec):
+		if (GET_P(state)) {
+			uint16_t return_addr = state->pc + 2;
+			uint16_t target = (opcode[2] << 8) | opcode[1];
+			write_mem(state, state->sp - 1, (return_addr >> 8) & 0xff);
+			write_mem(state, state->sp - 2, (return_addr & 0xff));
+			state->sp -= 2;
+			state->pc = target;
+		} else
+			state->pc += 2;
+		NEXT;
+	OP(0xed):
+		goto unknown;
+		/* XRI data */
+	OP(0xee):
+	{
+		state->a ^= opcode[1];
+		logic_flags(state);
+		state->pc++;
+		NEXT;
+	}
+	/* RST 5 */
+	OP(0xef):
+	{
+		uint16_t return_addr = state->pc;
+		write_mem(state, state->sp - 1, (return_addr >> 8) & 0xff);
+		write_mem(state, state->sp - 2, (return_addr & 0xff));
+		state->sp -= 2;
+		state->pc = 0x28;
+		NEXT;
+	}
+	/* RP */
+	OP(0xf0):
+		if (!GET_S(state)) {
+			state->pc = read_mem(state, state->sp) | (read_mem(state, state->sp + 1) << 8);
+			state->sp += 2;
+		}
+		NEXT;
+		/* POP PSW */
+	OP(0xf1):
+		flags_sync(state);
+		pop(state, &state->a, (unsigned char *) &state->flags);
+		NEXT;
+		/* JP addr */
+	OP(0xf2):
+		if (!GET_S(state)) {
+			state->pc = (opcode[2] << 8) | opcode[1];
+			LOOP();
+		} else
+			state->pc += 2;
+		NEXT;
+		/* DI */
+	OP(0xf3):
+		state->int_enable = 0;
+		NEXT;
+		/* CP addr */
+	OP(0xf4):
+		if (!GET_S(state)) {
+			uint16_t return_addr = state->pc + 2;
+			uint16_t target = (opcode[2] << 8) | opcode[1];
+			write_mem(state, state->sp - 1, (return_addr >> 8) & 0xff);
+			write_mem(state, state->sp - 2, (return_addr & 0xff));
+			state->sp -= 2;
+			state->pc = target;
+		} else
+			state->pc += 2;
+		NEXT;
+		/* PUSH PSW */
+	OP(0xf5):
+		flags_sync(state);
+		push(state, state->a, *(unsigned char *) &state->flags);
+		NEXT;
+		/* ORI byte */
+	OP(0xf6):
+	{
+		state->a |= opcode[1];
+		logic_flags(state);
+		state->pc++;
+		NEXT;
+	}
+	/* RST 6 */
+	OP(0xf7):
+	{
+		uint16_t return_addr = state->pc;
+		write_mem(state, state->sp - 1, (return_addr >> 8) & 0xff);
+		write_mem(state, state->sp - 2, (return_addr & 0xff));
+		state->sp -= 2;
+		state->pc = 0x30;
+		NEXT;
+	}
+	/* RM */
+	OP(0xf8):
+		if (GET_S(state)) {
+			state->pc = read_mem(state, state->sp) | (read_mem(state, state->sp + 1) << 8);
+			state->sp += 2;
+		}
+		NEXT;
+		/* SPHL */
+	OP(0xf9):
+		state->sp = state->l | (state->h << 8);
+		NEXT;
+		/* JM addr */
+	OP(0xfa):
+		if (GET_S(state)) {
+			state->pc = (opcode[2] << 8) | opcode[1];
+			LOOP();
+		} else
+			state->pc += 2;
+		NEXT;
+		/* EI */
+	OP(0xfb):
+		state->int_enable = 1;
+		NEXT;
+		/* CM addr */
+	OP(0xfc):
+		if (GET_S(state)) {
+			uint16_t return_addr = state->pc + 2;
+			uint16_t target = (opcode[2] << 8) | opcode[1];
+			write_mem(state, state->sp - 1, (return_addr >> 8) & 0xff);
+			write_mem(state, state->sp - 2, (return_addr & 0xff));
+			state->sp -= 2;
+			state->pc = target;
+		} else
+			state->pc += 2;
+		NEXT;
+	OP(0xfd):
+		goto unknown;
+		/* CPI byte */
+	OP(0xfe):
+	{
+		arith_sub(state, opcode[1], 0);
+		state->pc++;
+		NEXT;
+	}
+		/* RST 7 */
+	OP(0xff):
+	{
+		uint16_t return_addr = state->pc;
+		write_mem(state, state->sp - 1, (return_addr >> 8) & 0xff);
+		write_mem(state, state->sp - 2, (return_addr & 0xff));
+		state->sp -= 2;
+		state->pc = 0x38;
+		NEXT;
+	}
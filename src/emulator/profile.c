@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+
+/* twice the nodes, the chains stay short */
+#define PROFILE_BUCKETS (2 * PROFILE_NODES)
+
+extern const unsigned char length8080[];
+
+int profile_init (struct profile *prof)
+{
+	memset(prof, 0, sizeof(*prof));
+	prof->hits = calloc(0x10000, sizeof(*prof->hits));
+	prof->cycles = calloc(0x10000, sizeof(*prof->cycles));
+	prof->nodes = calloc(PROFILE_NODES, sizeof(*prof->nodes));
+	prof->buckets = malloc(PROFILE_BUCKETS * sizeof(*prof->buckets));
+	if (!prof->hits || !prof->cycles || !prof->nodes || !prof->buckets) {
+		fprintf(stderr, "Could not allocate the profile\n");
+		profile_destroy(prof);
+		return -1;
+	}
+	for (int i = 0; i < PROFILE_BUCKETS; i++)
+		prof->buckets[i] = -1;
+	prof->nodes[0].parent = -1;
+	prof->nodes[0].next = -1;
+	prof->count = 1;
+	return 0;
+}
+
+void profile_destroy (struct profile *prof)
+{
+	free(prof->hits);
+	free(prof->cycles);
+	free(prof->nodes);
+	free(prof->buckets);
+	prof->hits = prof->cycles = NULL;
+	prof->nodes = NULL;
+	prof->buckets = NULL;
+}
+
+void profile_attach (cpu8080_state *state, struct profile *prof)
+{
+	state->profile = prof;
+	if (prof) {
+		prof->pc = state->pc;
+		prof->sp = state->sp;
+	}
+}
+
+/*
+ * The call path of the routine at addr called from parent, made on
+ * first use. When the tree is full the caller's path stands in for it.
+ */
+static int child (struct profile *prof, int parent, uint16_t addr)
+{
+	unsigned hash = ((unsigned) parent * 0x9e3779b1u ^ addr) %
+		PROFILE_BUCKETS;
+	int n;
+
+	for (n = prof->buckets[hash]; n >= 0; n = prof->nodes[n].next)
+		if (prof->nodes[n].parent == parent &&
+		    prof->nodes[n].addr == addr)
+			return n;
+	if (prof->count == PROFILE_NODES)
+		return parent;
+
+	n = prof->count++;
+	prof->nodes[n].addr = addr;
+	prof->nodes[n].parent = parent;
+	prof->nodes[n].next = prof->buckets[hash];
+	prof->buckets[hash] = n;
+	return n;
+}
+
+/* the core called the routine at pc, its return address at sp */
+static void enter (struct profile *prof, uint16_t pc, uint16_t sp)
+{
+	if (prof->depth == PROFILE_DEPTH)
+		return;
+	prof->node = child(prof, prof->node, pc);
+	prof->frames[prof->depth].sp = sp;
+	prof->frames[prof->depth].node = prof->node;
+	prof->depth++;
+}
+
+/*
+ * The core returned with its stack back at sp: every call whose return
+ * address was below that is over. Games drop frames by reloading SP,
+ * which the next return cleans up.
+ */
+static void leave (struct profile *prof, uint16_t sp)
+{
+	while (prof->depth && prof->frames[prof->depth - 1].sp < sp)
+		prof->depth--;
+	prof->node = prof->depth ? prof->frames[prof->depth - 1].node : 0;
+}
+
+void profile_flow (struct profile *prof, const cpu8080_state *state,
+		   uint16_t pc, uint8_t op)
+{
+	/* taken if it did not go on to the next instruction */
+	if ((uint16_t) (pc + length8080[op]) == state->pc)
+		return;
+	if (0xc0 == (op & 0xc7) || 0xc9 == op)
+		leave(prof, state->sp);
+	else
+		enter(prof, state->pc, state->sp);
+}
+
+void profile_resume (struct profile *prof, const cpu8080_state *state)
+{
+	if (state->pc == prof->pc && state->sp == prof->sp)
+		return;
+	/*
+	 * An interrupt pushed pc and went to its RST vector. Anything else
+	 * (a restored state, a reset) starts over from the root.
+	 */
+	if (0 == (state->pc & ~0x38) && (uint16_t) (prof->sp - 2) == state->sp)
+		enter(prof, state->pc, state->sp);
+	else
+		prof->depth = prof->node = 0;
+}
+
+void profile_pause (struct profile *prof, const cpu8080_state *state)
+{
+	prof->pc = state->pc;
+	prof->sp = state->sp;
+}
+
+/* entries of the flat listing, most cycles first */
+struct row {
+	uint64_t cycles;
+	uint64_t hits;
+	int key;
+};
+
+static int by_cycles (const void *a, const void *b)
+{
+	const struct row *x = a;
+	const struct row *y = b;
+
+	if (x->cycles != y->cycles)
+		return x->cycles < y->cycles ? 1 : -1;
+	return x->key - y->key;
+}
+
+int profile_write_flat (const struct profile *prof, FILE *out)
+{
+	struct row *rows = malloc(0x10000 * sizeof(*rows));
+	uint64_t total = 0;
+	int count = 0;
+
+	if (!rows) {
+		fprintf(stderr, "Could not allocate the listing\n");
+		return -1;
+	}
+	for (int op = 0; op < 256; op++)
+		total += prof->op_cycles[op];
+	if (0 == total)
+		total = 1;
+
+	for (int op = 0; op < 256; op++)
+		if (prof->ops[op])
+			rows[count++] = (struct row) { prof->op_cycles[op],
+						       prof->ops[op], op };
+	qsort(rows, count, sizeof(*rows), by_cycles);
+	fprintf(out, "opcode       count       cycles      %%\n");
+	for (int i = 0; i < count; i++)
+		fprintf(out, "    %02x %11llu %12llu %6.2f\n", rows[i].key,
+			(unsigned long long) rows[i].hits,
+			(unsigned long long) rows[i].cycles,
+			100.0 * rows[i].cycles / total);
+
+	count = 0;
+	for (int pc = 0; pc < 0x10000; pc++)
+		if (prof->hits[pc])
+			rows[count++] = (struct row) { prof->cycles[pc],
+						       prof->hits[pc], pc };
+	qsort(rows, count, sizeof(*rows), by_cycles);
+	fprintf(out, "\naddress      count       cycles      %%\n");
+	for (int i = 0; i < count; i++)
+		fprintf(out, "   %04x %11llu %12llu %6.2f\n", rows[i].key,
+			(unsigned long long) rows[i].hits,
+			(unsigned long long) rows[i].cycles,
+			100.0 * rows[i].cycles / total);
+	free(rows);
+	return ferror(out) ? -1 : 0;
+}
+
+/* the routines of the path to node n, outermost first */
+static void write_path (const struct profile *prof, int n, FILE *out)
+{
+	if (prof->nodes[n].parent < 0) {
+		fprintf(out, "start");
+		return;
+	}
+	write_path(prof, prof->nodes[n].parent, out);
+	fprintf(out, ";%04x", prof->nodes[n].addr);
+}
+
+int profile_write_collapsed (const struct profile *prof, FILE *out)
+{
+	for (int n = 0; n < prof->count; n++) {
+		if (0 == prof->nodes[n].cycles)
+			continue;
+		write_path(prof, n, out);
+		fprintf(out, " %llu\n", (unsigned long long) prof->nodes[n].cycles);
+	}
+	return ferror(out) ? -1 : 0;
+}
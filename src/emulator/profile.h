@@ -0,0 +1,121 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "8080.h"
+
+/*
+ * An execution profile of a core: how often each opcode ran, and how
+ * often and for how many cycles each address did, plus a call tree
+ * inferred from CALL, RST, RET and the interrupts, for flame graphs.
+ *
+ * A core with a profile attached runs a dispatch loop of its own that
+ * records every instruction; without one it runs the usual loops,
+ * untouched, so leaving the profiler built in costs nothing. Machines
+ * in a lockstep group are not profiled while they run in lanes.
+ */
+
+/* calls tracked in the tree, deeper ones count towards their caller */
+#define PROFILE_DEPTH 256
+/* distinct call paths, later new ones count towards their caller */
+#define PROFILE_NODES 8192
+
+/* one call path: the routine at addr, called through parent */
+struct profile_node {
+	uint16_t addr;
+	int parent;		/* -1 for the root */
+	int next;		/* in its hash bucket, -1 at the end */
+	uint64_t cycles;	/* spent in the routine itself */
+};
+
+struct profile_frame {
+	uint16_t sp;		/* after the return address was pushed */
+	int node;
+};
+
+struct profile {
+	uint64_t ops[256];	/* instructions run, per opcode */
+	uint64_t op_cycles[256];
+	uint64_t *hits;		/* instructions run, per address */
+	uint64_t *cycles;	/* per address */
+
+	/* the call tree, node 0 is where profiling started */
+	struct profile_node *nodes;
+	int count;
+	int *buckets;
+
+	/* the calls the core is in, innermost last */
+	struct profile_frame frames[PROFILE_DEPTH];
+	int depth;
+	int node;		/* the innermost call path */
+
+	/* where the core stopped, to tell an interrupt from a jump */
+	uint16_t pc;
+	uint16_t sp;
+};
+
+/*
+ * Allocates an empty profile. Returns 0 on success, -1 on failure.
+ */
+int profile_init (struct profile *prof);
+
+void profile_destroy (struct profile *prof);
+
+/*
+ * Starts recording what the core runs into prof, which can carry on
+ * from another run, or stops it with prof NULL.
+ */
+void profile_attach (cpu8080_state *state, struct profile *prof);
+
+/*
+ * Writes the profile as text: opcodes, then addresses, each by the
+ * cycles they took, most first.
+ * Returns 0 on success, -1 on a write error.
+ */
+int profile_write_flat (const struct profile *prof, FILE *out);
+
+/*
+ * Writes the call tree in the collapsed stack format of flame graph
+ * tools: a line per call path, its routines from the outermost on
+ * separated by semicolons, then the cycles spent in the innermost.
+ * Routines are named by their address.
+ * Returns 0 on success, -1 on a write error.
+ */
+int profile_write_collapsed (const struct profile *prof, FILE *out);
+
+/*
+ * Called by the profiling dispatch loop: when the core starts running
+ * and stops, and after each CALL, RST and RET it runs.
+ */
+void profile_resume (struct profile *prof, const cpu8080_state *state);
+void profile_pause (struct profile *prof, const cpu8080_state *state);
+void profile_flow (struct profile *prof, const cpu8080_state *state,
+		   uint16_t pc, uint8_t op);
+
+/* the opcodes profile_flow wants to see */
+static inline int profile_is_flow (uint8_t op)
+{
+	/* Rcc, Ccc and RST are 11ccc000, 11ccc100 and 11nnn111 */
+	return 0xc0 == (op & 0xc7) || 0xc4 == (op & 0xc7) ||
+		0xc7 == (op & 0xc7) || 0xc9 == op || 0xcd == op;
+}
+
+/*
+ * Records the instruction at pc the core has just run
+ */
+static inline void profile_step (struct profile *prof,
+				 const cpu8080_state *state,
+				 uint16_t pc, uint8_t op, int cycles)
+{
+	prof->ops[op]++;
+	prof->op_cycles[op] += cycles;
+	prof->hits[pc]++;
+	prof->cycles[pc] += cycles;
+	prof->nodes[prof->node].cycles += cycles;
+	if (profile_is_flow(op))
+		profile_flow(prof, state, pc, op);
+}
+
+#endif
@@ -0,0 +1,209 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rewind.h"
+
+/*
+ * A frame is encoded as runs: 16 bits of unchanged bytes to skip, 16
+ * bits of changed bytes, then those bytes XORed with what they were.
+ * A skip is only taken for at least MIN_SKIP unchanged bytes, which
+ * bounds a frame to REWIND_FRAME_MAX.
+ */
+#define MIN_SKIP 4
+
+/* what keyframes are encoded against */
+static const uint8_t nothing[SAVESTATE_SIZE];
+
+static size_t encode (const uint8_t *prev, const uint8_t *cur, uint8_t *out)
+{
+	size_t n = 0;
+	int i = 0;
+
+	while (i < SAVESTATE_SIZE) {
+		int start = i;
+
+		while (i + 8 <= SAVESTATE_SIZE && !memcmp(prev + i, cur + i, 8))
+			i += 8;
+		while (i < SAVESTATE_SIZE && prev[i] == cur[i])
+			i++;
+		if (SAVESTATE_SIZE == i)
+			break;
+
+		/* changed bytes, up to MIN_SKIP unchanged ones in a row */
+		int changed = i;
+		int end = i;
+		while (i < SAVESTATE_SIZE && i - end < MIN_SKIP) {
+			if (prev[i] != cur[i])
+				end = i + 1;
+			i++;
+		}
+		i = end;
+
+		out[n] = changed - start;
+		out[n + 1] = (changed - start) >> 8;
+		out[n + 2] = end - changed;
+		out[n + 3] = (end - changed) >> 8;
+		n += 4;
+		for (int k = changed; k < end; k++)
+			out[n++] = prev[k] ^ cur[k];
+	}
+	return n;
+}
+
+static void apply (uint8_t *state, const uint8_t *in, size_t size)
+{
+	size_t pos = 0;
+	int at = 0;
+
+	while (pos < size) {
+		int len = in[pos + 2] | in[pos + 3] << 8;
+
+		at += in[pos] | in[pos + 1] << 8;
+		pos += 4;
+		for (int k = 0; k < len; k++)
+			state[at + k] ^= in[pos + k];
+		at += len;
+		pos += len;
+	}
+}
+
+/* the i-th frame, from the oldest */
+static struct rewind_frame *frame (const struct rewind_buffer *rw, int i)
+{
+	return &rw->frames[(rw->oldest + i) % rw->capacity];
+}
+
+/*
+ * Where n bytes fit in data without touching a frame, in *at.
+ * Frames are laid out one after the other, wrapping around to the
+ * start of data where the next one would not fit before the end.
+ */
+static int fits (const struct rewind_buffer *rw, size_t n, size_t *at)
+{
+	size_t tail;
+
+	if (0 == rw->count) {
+		*at = 0;
+		return n <= rw->size;
+	}
+	tail = frame(rw, 0)->offset;
+	if (rw->head > tail) {
+		if (rw->head + n <= rw->size) {
+			*at = rw->head;
+			return 1;
+		}
+		*at = 0;
+		return n <= tail;
+	}
+	*at = rw->head;
+	return rw->head + n <= tail;
+}
+
+/* drops the oldest keyframe with the frames that depend on it */
+static void drop_oldest (struct rewind_buffer *rw)
+{
+	do {
+		rw->oldest = (rw->oldest + 1) % rw->capacity;
+		rw->count--;
+	} while (rw->count && frame(rw, 0)->chain);
+}
+
+int rewind_init (struct rewind_buffer *rw, int frames, size_t bytes)
+{
+	if (frames < 1 || bytes < REWIND_FRAME_MAX) {
+		fprintf(stderr, "Rewind buffer too small\n");
+		return -1;
+	}
+	rw->frames = malloc(frames * sizeof(struct rewind_frame));
+	rw->data = malloc(bytes);
+	if (NULL == rw->frames || NULL == rw->data) {
+		fprintf(stderr, "Failed to alloc the rewind buffer\n");
+		free(rw->frames);
+		free(rw->data);
+		rw->frames = NULL;
+		rw->data = NULL;
+		return -1;
+	}
+	rw->capacity = frames;
+	rw->oldest = 0;
+	rw->count = 0;
+	rw->size = bytes;
+	rw->head = 0;
+	return 0;
+}
+
+void rewind_destroy (struct rewind_buffer *rw)
+{
+	free(rw->frames);
+	free(rw->data);
+	rw->frames = NULL;
+	rw->data = NULL;
+	rw->count = 0;
+}
+
+int rewind_push (struct rewind_buffer *rw, const struct invaders *machine)
+{
+	struct rewind_frame *f;
+	size_t at;
+	int chain = 0;
+
+	if (savestate_save(machine, rw->work, sizeof(rw->work)) < 0)
+		return -1;
+
+	if (rw->count == rw->capacity)
+		drop_oldest(rw);
+	while (!fits(rw, REWIND_FRAME_MAX, &at))
+		drop_oldest(rw);
+
+	/* a delta, unless it is time for a keyframe */
+	if (rw->count && frame(rw, rw->count - 1)->chain + 1 < REWIND_KEYFRAME)
+		chain = frame(rw, rw->count - 1)->chain + 1;
+
+	f = frame(rw, rw->count);
+	f->offset = at;
+	f->chain = chain;
+	f->size = encode(chain ? rw->last : nothing, rw->work, rw->data + at);
+	rw->head = at + f->size;
+	rw->count++;
+	memcpy(rw->last, rw->work, SAVESTATE_SIZE);
+	return 0;
+}
+
+int rewind_frames (const struct rewind_buffer *rw)
+{
+	return rw->count ? rw->count - 1 : 0;
+}
+
+int rewind_back (struct rewind_buffer *rw, struct invaders *machine, int back)
+{
+	int newest = rw->count - 1 - back;
+
+	if (back < 0 || newest < 0) {
+		fprintf(stderr, "Can't rewind %d frames\n", back);
+		return -1;
+	}
+
+	if (back) {
+		struct rewind_frame *f = frame(rw, newest);
+
+		/* from the keyframe, one delta after the other */
+		memset(rw->last, 0, SAVESTATE_SIZE);
+		for (int i = newest - f->chain; i <= newest; i++)
+			apply(rw->last, rw->data + frame(rw, i)->offset,
+			      frame(rw, i)->size);
+		rw->count = newest + 1;
+		rw->head = f->offset + f->size;
+	}
+	return savestate_restore(machine, rw->last, SAVESTATE_SIZE);
+}
+
+size_t rewind_used (const struct rewind_buffer *rw)
+{
+	size_t used = 0;
+
+	for (int i = 0; i < rw->count; i++)
+		used += frame(rw, i)->size;
+	return used;
+}
@@ -0,0 +1,79 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "invaders.h"
+#include "savestate.h"
+
+/*
+ * The last frames of a machine, to step back through. Each frame is
+ * its save state XORed with the one of the frame before and run length
+ * encoded, which leaves little more than what changed. Every
+ * REWIND_KEYFRAME frames one is encoded against nothing instead, so
+ * getting any frame back never takes more than that many deltas.
+ * It never grows past the frames and bytes it is given: the oldest
+ * second of frames makes room for the newest.
+ */
+#define REWIND_KEYFRAME 60
+
+struct rewind_frame {
+	size_t offset;		/* of the encoded frame in data */
+	uint16_t size;
+	uint16_t chain;		/* frames since the keyframe, 0 for one */
+};
+
+struct rewind_buffer {
+	struct rewind_frame *frames;
+	int capacity;		/* frames */
+	int oldest;		/* index in frames */
+	int count;
+
+	uint8_t *data;
+	size_t size;		/* bytes */
+	size_t head;		/* where the next frame goes */
+
+	/* the state of the newest frame, and room to decode one */
+	uint8_t last[SAVESTATE_SIZE];
+	uint8_t work[SAVESTATE_SIZE];
+};
+
+/* the most an encoded frame can take */
+#define REWIND_FRAME_MAX (SAVESTATE_SIZE + 4)
+
+/*
+ * Allocates room for up to frames frames in up to bytes bytes of
+ * encoded data, at least REWIND_FRAME_MAX.
+ * Returns 0 on success, -1 on failure.
+ */
+int rewind_init (struct rewind_buffer *rw, int frames, size_t bytes);
+
+void rewind_destroy (struct rewind_buffer *rw);
+
+/*
+ * Records the frame the machine just finished: call it after every
+ * run_until_frame, when the end of frame interrupt has been raised.
+ * Returns 0 on success, -1 on failure.
+ */
+int rewind_push (struct rewind_buffer *rw, const struct invaders *machine);
+
+/*
+ * How many frames back the buffer can go, not counting the newest.
+ */
+int rewind_frames (const struct rewind_buffer *rw);
+
+/*
+ * Puts the machine back to the frame back frames before the newest
+ * one (0 is the newest) and forgets the frames after it, so the next
+ * rewind_push follows from there.
+ * Returns 0 on success, -1 if the buffer does not go back that far.
+ */
+int rewind_back (struct rewind_buffer *rw, struct invaders *machine, int back);
+
+/*
+ * Bytes of encoded frames held, for reporting.
+ */
+size_t rewind_used (const struct rewind_buffer *rw);
+
+#endif
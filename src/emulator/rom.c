@@ -0,0 +1,110 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rom.h"
+
+/*
+ * Copies the chip at path into image at addr, through a read-only
+ * mapping of the file. Returns the size of the chip, or -1.
+ */
+static long load_chip (uint8_t *image, size_t addr, const char *path)
+{
+	struct stat st;
+	void *chip;
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0) {
+		fprintf(stderr, "Couldn't open file: %s\n", path);
+		return -1;
+	}
+	if (fstat(fd, &st) < 0 || 0 == st.st_size) {
+		fprintf(stderr, "Failed to read ROM!\n");
+		close(fd);
+		return -1;
+	}
+	if (addr + st.st_size > ROM_SIZE) {
+		fprintf(stderr, "ROM doesn't fit below the RAM: %s\n", path);
+		close(fd);
+		return -1;
+	}
+
+	chip = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (MAP_FAILED == chip) {
+		fprintf(stderr, "Couldn't map file: %s\n", path);
+		return -1;
+	}
+	memcpy(image + addr, chip, st.st_size);
+	munmap(chip, st.st_size);
+	return st.st_size;
+}
+
+int rom_load (struct rom *rom, char *paths[], int count)
+{
+	uint8_t *image;
+	size_t addr = 0;
+
+	/* an anonymous file, so every core can map the same pages */
+	rom->fd = memfd_create("rom", MFD_CLOEXEC);
+	if (rom->fd < 0) {
+		fprintf(stderr, "Couldn't create the ROM image\n");
+		return -1;
+	}
+	if (ftruncate(rom->fd, ROM_SIZE) < 0)
+		goto error;
+	image = mmap(NULL, ROM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+		     rom->fd, 0);
+	if (MAP_FAILED == image)
+		goto error;
+
+	for (int i = 0; i < count; i++) {
+		long size = load_chip(image, addr, paths[i]);
+		if (size < 0) {
+			munmap(image, ROM_SIZE);
+			goto error;
+		}
+		addr += size;
+	}
+	munmap(image, ROM_SIZE);
+
+	/* a mapping is whole pages, it must not cover the RAM */
+	rom->shared = 0 == ROM_SIZE % sysconf(_SC_PAGESIZE);
+	return 0;
+
+error:
+	fprintf(stderr, "Failed to load the ROM\n");
+	close(rom->fd);
+	rom->fd = -1;
+	return -1;
+}
+
+int rom_map (const struct rom *rom, cpu8080_state *state)
+{
+	if (!rom->shared) {
+		if (pread(rom->fd, state->memory, ROM_SIZE, 0) != ROM_SIZE) {
+			fprintf(stderr, "Failed to copy the ROM\n");
+			return -1;
+		}
+		return 0;
+	}
+
+	if (MAP_FAILED == mmap(state->memory, ROM_SIZE, PROT_READ,
+			       MAP_SHARED | MAP_FIXED, rom->fd, 0)) {
+		fprintf(stderr, "Failed to map the ROM\n");
+		return -1;
+	}
+	return 0;
+}
+
+void rom_destroy (struct rom *rom)
+{
+	if (rom->fd >= 0)
+		close(rom->fd);
+	rom->fd = -1;
+}
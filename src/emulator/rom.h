@@ -0,0 +1,40 @@
+#ifndef ROM_H
+#define ROM_H
+
+#include <stddef.h>
+
+#include "8080.h"
+
+/* the ROM fills the address space up to the RAM */
+#define ROM_SIZE 0x2000
+
+/*
+ * A ROM image, loaded once and mapped read-only into any number of
+ * cores, which then all share the same physical pages.
+ */
+struct rom {
+	int fd;			/* the assembled image */
+	int shared;		/* 0 if cores get a copy instead */
+};
+
+/*
+ * Assembles ROM chips back to back from address 0x0000: for Space
+ * Invaders invaders.h, .g, .f and .e, in this order, land at 0x0000,
+ * 0x0800, 0x1000 and 0x1800. The chips are mapped, not read.
+ * Returns 0 on success, -1 on failure.
+ */
+int rom_load (struct rom *rom, char *paths[], int count);
+
+/*
+ * Puts the ROM at the bottom of the memory of a core initialised by
+ * cpu8080_init. Where the host pages are larger than the ROM, the
+ * core gets a copy. Returns 0 on success, -1 on failure.
+ */
+int rom_map (const struct rom *rom, cpu8080_state *state);
+
+/*
+ * Frees the image. Cores it is mapped into keep their mapping.
+ */
+void rom_destroy (struct rom *rom);
+
+#endif
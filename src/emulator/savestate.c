@@ -0,0 +1,159 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "8080.h"
+#include "invaders.h"
+#include "rom.h"
+#include "savestate.h"
+
+/* the RAM, right above the ROM up to the end of the video RAM */
+#define RAM_START ROM_SIZE
+#define RAM_SIZE (VIDEO_END - RAM_START)
+
+#if SAVESTATE_SIZE != SAVESTATE_HEADER + RAM_SIZE
+#error "SAVESTATE_SIZE does not match the RAM of the board"
+#endif
+
+static const uint8_t magic[4] = { 'S', 'I', '8', '0' };
+
+/*
+ * Where each field is, all of them little endian. Bytes not listed
+ * up to SAVESTATE_HEADER are zero.
+ */
+enum {
+	AT_MAGIC = 0,
+	AT_VERSION = 4,		/* 16 bits */
+	AT_SOUNDS_STARTED = 6,	/* 16 bits */
+	AT_CYCLES = 8,		/* 64 bits */
+	AT_FRAME_AHEAD = 16,	/* 32 bits, signed */
+	AT_SP = 20,		/* 16 bits */
+	AT_PC = 22,		/* 16 bits */
+	AT_A = 24,		/* then b, c, d, e, h, l */
+	AT_FLAGS = 31,		/* as PUSH PSW sees them */
+	AT_INT_ENABLE = 32,
+	AT_SHIFT_OFFSET = 33,
+	AT_SHIFT = 34,		/* 16 bits */
+	AT_INPUTS = 36,		/* ports 0 to 2 */
+	AT_SOUND = 39,		/* ports 3 and 5 */
+	AT_HALTED = 41,
+	AT_END = 42
+};
+
+static void put16 (uint8_t *p, uint16_t val)
+{
+	p[0] = val;
+	p[1] = val >> 8;
+}
+
+static void put32 (uint8_t *p, uint32_t val)
+{
+	put16(p, val);
+	put16(p + 2, val >> 16);
+}
+
+static void put64 (uint8_t *p, uint64_t val)
+{
+	put32(p, val);
+	put32(p + 4, val >> 32);
+}
+
+static uint16_t get16 (const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static uint32_t get32 (const uint8_t *p)
+{
+	return get16(p) | (uint32_t) get16(p + 2) << 16;
+}
+
+static uint64_t get64 (const uint8_t *p)
+{
+	return get32(p) | (uint64_t) get32(p + 4) << 32;
+}
+
+/* the registers and the board, the first SAVESTATE_HEADER bytes */
+static void save_header (const struct invaders *machine, uint8_t *buf)
+{
+	const cpu8080_state *cpu = &machine->cpu;
+
+	memcpy(buf + AT_MAGIC, magic, sizeof(magic));
+	put16(buf + AT_VERSION, SAVESTATE_VERSION);
+	put16(buf + AT_SOUNDS_STARTED, machine->sounds_started);
+	put64(buf + AT_CYCLES, cpu->cycles);
+	put32(buf + AT_FRAME_AHEAD, cpu->frame_ahead);
+	put16(buf + AT_SP, cpu->sp);
+	put16(buf + AT_PC, cpu->pc);
+	buf[AT_A] = cpu->a;
+	buf[AT_A + 1] = cpu->b;
+	buf[AT_A + 2] = cpu->c;
+	buf[AT_A + 3] = cpu->d;
+	buf[AT_A + 4] = cpu->e;
+	buf[AT_A + 5] = cpu->h;
+	buf[AT_A + 6] = cpu->l;
+	buf[AT_FLAGS] = *(const uint8_t *) &cpu->flags;
+	buf[AT_INT_ENABLE] = cpu->int_enable;
+	buf[AT_HALTED] = cpu->halted;
+	buf[AT_SHIFT_OFFSET] = machine->shift_offset;
+	put16(buf + AT_SHIFT, machine->shift);
+	memcpy(buf + AT_INPUTS, machine->inputs, 3);
+	memcpy(buf + AT_SOUND, machine->sound, 2);
+	memset(buf + AT_END, 0, SAVESTATE_HEADER - AT_END);
+}
+
+static void restore_header (struct invaders *machine, const uint8_t *buf)
+{
+	cpu8080_state *cpu = &machine->cpu;
+
+	machine->sounds_started = get16(buf + AT_SOUNDS_STARTED);
+	cpu->cycles = get64(buf + AT_CYCLES);
+	cpu->frame_ahead = (int32_t) get32(buf + AT_FRAME_AHEAD);
+	cpu->sp = get16(buf + AT_SP);
+	cpu->pc = get16(buf + AT_PC);
+	cpu->a = buf[AT_A];
+	cpu->b = buf[AT_A + 1];
+	cpu->c = buf[AT_A + 2];
+	cpu->d = buf[AT_A + 3];
+	cpu->e = buf[AT_A + 4];
+	cpu->h = buf[AT_A + 5];
+	cpu->l = buf[AT_A + 6];
+	*(uint8_t *) &cpu->flags = buf[AT_FLAGS];
+	cpu->lazy_op = 0;
+	cpu->int_enable = buf[AT_INT_ENABLE];
+	cpu->halted = buf[AT_HALTED];
+	machine->shift_offset = buf[AT_SHIFT_OFFSET] & 7;
+	machine->shift = get16(buf + AT_SHIFT);
+	memcpy(machine->inputs, buf + AT_INPUTS, 3);
+	memcpy(machine->sound, buf + AT_SOUND, 2);
+}
+
+long savestate_save (const struct invaders *machine, uint8_t *buf,
+		     size_t size)
+{
+	if (size < SAVESTATE_SIZE) {
+		fprintf(stderr, "No room for the save state\n");
+		return -1;
+	}
+	save_header(machine, buf);
+	memcpy(buf + SAVESTATE_HEADER, machine->cpu.memory + RAM_START, RAM_SIZE);
+	return SAVESTATE_SIZE;
+}
+
+int savestate_restore (struct invaders *machine, const uint8_t *buf,
+		       size_t size)
+{
+	if (size < SAVESTATE_SIZE || memcmp(buf + AT_MAGIC, magic, sizeof(magic))) {
+		fprintf(stderr, "Not a save state\n");
+		return -1;
+	}
+	if (get16(buf + AT_VERSION) != SAVESTATE_VERSION) {
+		fprintf(stderr, "Save state version %d, expected %d\n",
+			get16(buf + AT_VERSION), SAVESTATE_VERSION);
+		return -1;
+	}
+	restore_header(machine, buf);
+	memcpy(machine->cpu.memory + RAM_START, buf + SAVESTATE_HEADER, RAM_SIZE);
+	cpu8080_invalidate(&machine->cpu, RAM_START, RAM_SIZE);
+	return 0;
+}
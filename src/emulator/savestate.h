@@ -0,0 +1,49 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "invaders.h"
+
+/*
+ * Save states of the Space Invaders machine: a versioned, fixed size
+ * little endian image of everything that decides what the machine
+ * does next, the registers, the flags, the RAM, the board's shift
+ * register, ports and sound latches, and the cycle counter.
+ *
+ * The ROM is not part of it, a state only restores into a machine
+ * loaded with the same ROM.
+ */
+
+/* bumped whenever the layout below changes */
+#define SAVESTATE_VERSION 2
+
+/* 48 bytes of header, registers and board, then the 8K of RAM */
+#define SAVESTATE_HEADER 48
+#define SAVESTATE_SIZE (SAVESTATE_HEADER + 0x2000)
+
+/*
+ * Writes the state of the machine to buf, which has room for size
+ * bytes. Returns the bytes written, SAVESTATE_SIZE, or -1 if they
+ * don't fit.
+ */
+long savestate_save (const struct invaders *machine, uint8_t *buf,
+		     size_t size);
+
+/*
+ * Puts a machine initialised and loaded as usual back in the state
+ * saved in buf, straight from buf: nothing is allocated or parsed
+ * into a copy first, so a mapped file or one checkpoint in memory can
+ * be restored from any number of times. Only what the RAM restore
+ * overwrote of the cached code is dropped, compiled ROM code stays.
+ * This is also how a machine is forked: save it once, then restore
+ * the checkpoint into as many other machines as needed, each of
+ * which then goes its own way.
+ * Returns 0 on success, -1 (with the machine untouched) if buf is not
+ * a save state of this version.
+ */
+int savestate_restore (struct invaders *machine, const uint8_t *buf,
+		       size_t size);
+
+#endif
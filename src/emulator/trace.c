@@ -0,0 +1,222 @@
+#define _DEFAULT_SOURCE
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+
+/* the writer encodes this many records at most before writing them */
+#define TRACE_CHUNK 4096
+/* a record, encoded, is never larger than this */
+#define TRACE_ENCODED_MAX (3 + TRACE_RECORD_SIZE)
+
+static void pack (const struct trace_record *rec, uint8_t *out)
+{
+	for (int i = 0; i < 8; i++)
+		out[i] = rec->cycle >> (8 * i);
+	out[8] = rec->pc;
+	out[9] = rec->pc >> 8;
+	out[10] = rec->sp;
+	out[11] = rec->sp >> 8;
+	out[12] = rec->code[0];
+	out[13] = rec->code[1];
+	out[14] = rec->code[2];
+	out[15] = rec->a;
+	out[16] = rec->b;
+	out[17] = rec->c;
+	out[18] = rec->d;
+	out[19] = rec->e;
+	out[20] = rec->h;
+	out[21] = rec->l;
+	out[22] = rec->flags;
+}
+
+static void unpack (const uint8_t *in, struct trace_record *rec)
+{
+	rec->cycle = 0;
+	for (int i = 0; i < 8; i++)
+		rec->cycle |= (uint64_t) in[i] << (8 * i);
+	rec->pc = in[8] | in[9] << 8;
+	rec->sp = in[10] | in[11] << 8;
+	rec->code[0] = in[12];
+	rec->code[1] = in[13];
+	rec->code[2] = in[14];
+	rec->a = in[15];
+	rec->b = in[16];
+	rec->c = in[17];
+	rec->d = in[18];
+	rec->e = in[19];
+	rec->h = in[20];
+	rec->l = in[21];
+	rec->flags = in[22];
+}
+
+/*
+ * Encodes rec against the record before it, in last, which it then
+ * replaces. Returns the bytes written to out.
+ */
+static int encode (uint8_t *last, const struct trace_record *rec,
+		   uint8_t *out)
+{
+	uint8_t cur[TRACE_RECORD_SIZE];
+	uint32_t mask = 0;
+	int n = 3;
+
+	pack(rec, cur);
+	for (int i = 0; i < TRACE_RECORD_SIZE; i++) {
+		uint8_t diff = cur[i] ^ last[i];
+
+		if (diff) {
+			mask |= 1u << i;
+			out[n++] = diff;
+		}
+	}
+	out[0] = mask;
+	out[1] = mask >> 8;
+	out[2] = mask >> 16;
+	memcpy(last, cur, TRACE_RECORD_SIZE);
+	return n;
+}
+
+/* writes what the core put in the ring until it is stopped */
+static void *writer (void *arg)
+{
+	struct trace *trace = arg;
+	static const struct timespec nap = { 0, 100000 };
+	uint8_t buf[TRACE_CHUNK * TRACE_ENCODED_MAX];
+
+	for (;;) {
+		int stop = __atomic_load_n(&trace->stop, __ATOMIC_ACQUIRE);
+		uint64_t head = __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE);
+		uint64_t tail = trace->tail;
+
+		if (head == tail) {
+			/* stop was read first, nothing can come after this */
+			if (stop)
+				break;
+			nanosleep(&nap, NULL);
+			continue;
+		}
+		if (head - tail > TRACE_CHUNK)
+			head = tail + TRACE_CHUNK;
+
+		size_t n = 0;
+		for (uint64_t i = tail; i < head; i++)
+			n += encode(trace->last,
+				    &trace->ring[i & (TRACE_RING - 1)], buf + n);
+		/* room for the core, whatever happens to the file */
+		__atomic_store_n(&trace->tail, head, __ATOMIC_RELEASE);
+		if (!trace->error && fwrite(buf, 1, n, trace->out) != n)
+			trace->error = 1;
+		trace->records += head - tail;
+		trace->bytes += n;
+	}
+	return NULL;
+}
+
+int trace_start (struct trace *trace, const char *path,
+		 cpu8080_state *state)
+{
+	memset(trace, 0, sizeof(*trace));
+	trace->ring = malloc(TRACE_RING * sizeof(*trace->ring));
+	if (!trace->ring) {
+		fprintf(stderr, "Could not allocate the trace ring\n");
+		return -1;
+	}
+	trace->out = fopen(path, "wb");
+	if (!trace->out) {
+		fprintf(stderr, "Could not create %s\n", path);
+		free(trace->ring);
+		return -1;
+	}
+	if (fwrite(TRACE_MAGIC, 1, 8, trace->out) != 8) {
+		fprintf(stderr, "Could not write %s\n", path);
+		goto error;
+	}
+	trace->bytes = 8;
+	if (pthread_create(&trace->thread, NULL, writer, trace)) {
+		fprintf(stderr, "Could not start the trace writer\n");
+		goto error;
+	}
+	state->trace = trace;
+	return 0;
+
+error:
+	fclose(trace->out);
+	free(trace->ring);
+	return -1;
+}
+
+int trace_stop (struct trace *trace, cpu8080_state *state)
+{
+	state->trace = NULL;
+	__atomic_store_n(&trace->stop, 1, __ATOMIC_RELEASE);
+	pthread_join(trace->thread, NULL);
+	if (fclose(trace->out))
+		trace->error = 1;
+	free(trace->ring);
+	if (trace->error) {
+		fprintf(stderr, "Could not write the trace\n");
+		return -1;
+	}
+	return 0;
+}
+
+void trace_wait (struct trace *trace)
+{
+	trace->waits++;
+	for (;;) {
+		trace->tail_seen = __atomic_load_n(&trace->tail, __ATOMIC_ACQUIRE);
+		if (trace->head - trace->tail_seen < TRACE_RING)
+			return;
+		sched_yield();
+	}
+}
+
+int trace_open (struct trace_reader *reader, const char *path)
+{
+	char magic[8];
+
+	memset(reader->last, 0, sizeof(reader->last));
+	reader->in = fopen(path, "rb");
+	if (!reader->in) {
+		fprintf(stderr, "Could not open %s\n", path);
+		return -1;
+	}
+	if (fread(magic, 1, 8, reader->in) != 8 ||
+	    memcmp(magic, TRACE_MAGIC, 8)) {
+		fprintf(stderr, "%s is not a trace\n", path);
+		fclose(reader->in);
+		return -1;
+	}
+	return 0;
+}
+
+int trace_read (struct trace_reader *reader, struct trace_record *rec)
+{
+	uint8_t head[3];
+	size_t got = fread(head, 1, 3, reader->in);
+	uint32_t mask;
+
+	if (0 == got)
+		return 0;
+	if (got < 3)
+		return -1;
+	mask = head[0] | head[1] << 8 | head[2] << 16;
+	for (int i = 0; i < TRACE_RECORD_SIZE; i++) {
+		if (!(mask & 1u << i))
+			continue;
+		int diff = getc(reader->in);
+		if (EOF == diff)
+			return -1;
+		reader->last[i] ^= diff;
+	}
+	unpack(reader->last, rec);
+	return 1;
+}
+
+void trace_close (struct trace_reader *reader)
+{
+	fclose(reader->in);
+}
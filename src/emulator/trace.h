@@ -0,0 +1,140 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "8080.h"
+
+/*
+ * A binary trace of everything a core runs: a record per instruction,
+ * put by the core into a ring that a thread of the trace drains into
+ * a compressed file. The ring has one producer and one consumer and
+ * no lock, each side only moves its own end. When the writer falls
+ * behind by a whole ring, the core waits for it.
+ *
+ * Like the profiler, tracing runs the instrumented dispatch loop, the
+ * usual ones stay as they are.
+ */
+
+/* records in the ring, a power of two */
+#define TRACE_RING (1 << 16)
+
+/*
+ * An instruction, with the registers and flags as it left them
+ */
+struct trace_record {
+	uint64_t cycle;		/* of the core when it was done */
+	uint16_t pc;		/* of the instruction */
+	uint16_t sp;
+	uint8_t code[3];	/* the instruction, as it was in memory */
+	uint8_t a;
+	uint8_t b;
+	uint8_t c;
+	uint8_t d;
+	uint8_t e;
+	uint8_t h;
+	uint8_t l;
+	uint8_t flags;
+};
+
+/*
+ * In the file, a record is its 23 bytes (the cycle little endian
+ * first, then the fields in order) XORed with those of the record
+ * before, 3 bytes of a mask of which of them are not 0, and those.
+ */
+#define TRACE_RECORD_SIZE 23
+#define TRACE_MAGIC "8080TRC1"
+
+struct trace {
+	struct trace_record *ring;
+
+	/* written by the core only */
+	uint64_t head __attribute__((aligned(64)));
+	uint64_t tail_seen;	/* tail, last time it was read */
+	long waits;		/* times the ring was full */
+
+	/* written by the writer thread only */
+	uint64_t tail __attribute__((aligned(64)));
+	uint8_t last[TRACE_RECORD_SIZE];
+	uint64_t records;
+	uint64_t bytes;		/* of the file */
+	int error;
+
+	int stop;
+	FILE *out;
+	pthread_t thread;
+};
+
+/*
+ * Creates the file at path and starts tracing the core into it.
+ * Returns 0 on success, -1 on failure.
+ */
+int trace_start (struct trace *trace, const char *path,
+		 cpu8080_state *state);
+
+/*
+ * Stops tracing the core, writes out what is left and closes the file.
+ * Returns 0 on success, -1 if the file could not be written.
+ */
+int trace_stop (struct trace *trace, cpu8080_state *state);
+
+/* waits for the writer to make room in the ring */
+void trace_wait (struct trace *trace);
+
+/*
+ * Records the instruction at code the core has just run, with the
+ * flags byte, its cycle count and sp after it.
+ */
+static inline void trace_step (struct trace *trace,
+			       const cpu8080_state *state,
+			       const uint8_t *code, uint8_t flags,
+			       uint64_t cycle)
+{
+	uint64_t head = trace->head;
+	struct trace_record *rec;
+
+	if (head - trace->tail_seen == TRACE_RING)
+		trace_wait(trace);
+	rec = &trace->ring[head & (TRACE_RING - 1)];
+	rec->cycle = cycle;
+	rec->pc = code - state->memory;
+	rec->sp = state->sp;
+	/* operands past the top of memory wrap around to the bottom */
+	rec->code[0] = code[0];
+	rec->code[1] = state->memory[(uint16_t) (rec->pc + 1)];
+	rec->code[2] = state->memory[(uint16_t) (rec->pc + 2)];
+	rec->a = state->a;
+	rec->b = state->b;
+	rec->c = state->c;
+	rec->d = state->d;
+	rec->e = state->e;
+	rec->h = state->h;
+	rec->l = state->l;
+	rec->flags = flags;
+	__atomic_store_n(&trace->head, head + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Reads a trace file back, record by record.
+ */
+struct trace_reader {
+	FILE *in;
+	uint8_t last[TRACE_RECORD_SIZE];
+};
+
+/*
+ * Returns 0 on success, -1 if path is not a trace file.
+ */
+int trace_open (struct trace_reader *reader, const char *path);
+
+/*
+ * Reads the next record into rec. Returns 1, 0 at the end of the
+ * trace, or -1 if the file is cut short.
+ */
+int trace_read (struct trace_reader *reader, struct trace_record *rec);
+
+void trace_close (struct trace_reader *reader);
+
+#endif
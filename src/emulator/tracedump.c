@@ -0,0 +1,47 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../disassembler/disassembler.h"
+#include "trace.h"
+
+/*
+ * Lists a trace written by emu -T, an instruction a line: the cycle
+ * it finished on, the flags and registers it left, then the
+ * instruction, disassembled. An optional count stops it early.
+ */
+int main (int argc, char *argv[])
+{
+	struct trace_reader reader;
+	struct trace_record rec;
+	long count = argc > 2 ? atol(argv[2]) : -1;
+	int got = 0;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: tracedump trace [count]\n");
+		return -1;
+	}
+	if (trace_open(&reader, argv[1]) < 0)
+		return -1;
+
+	while (count-- && (got = trace_read(&reader, &rec)) > 0) {
+		struct insn8080 insn;
+		char line[LINE8080_MAX];
+
+		decode8080(rec.code, sizeof(rec.code), rec.pc, &insn);
+		printf("%12llu %c%c%c%c%c  A $%02x B $%02x C $%02x D $%02x "
+		       "E $%02x H $%02x L $%02x SP %04x  ",
+		       (unsigned long long) rec.cycle,
+		       rec.flags & 0x40 ? 'z' : '.', rec.flags & 0x80 ? 's' : '.',
+		       rec.flags & 0x04 ? 'p' : '.', rec.flags & 0x01 ? 'c' : '.',
+		       rec.flags & 0x10 ? 'a' : '.', rec.a, rec.b, rec.c, rec.d,
+		       rec.e, rec.h, rec.l, rec.sp);
+		fwrite(line, 1, format8080_line(&insn, line), stdout);
+	}
+	trace_close(&reader);
+	if (got < 0) {
+		fprintf(stderr, "%s is cut short\n", argv[1]);
+		return -1;
+	}
+	return 0;
+}